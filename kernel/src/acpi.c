@@ -0,0 +1,91 @@
+// acpi.c - Localização de tabelas ACPI (RSDP do Limine, RSDT/XSDT)
+//
+// O Limine entrega o RSDP; dali vem a XSDT (ACPI 2.0+, ponteiros de 64
+// bits) ou a RSDT (32 bits). As tabelas ficam em memória física baixa,
+// coberta pelo mapa identidade dos 4 GiB; tabela acima disso é ignorada.
+
+#include <stddef.h>
+#include <limine.h>
+#include "acpi.h"
+#include "string.h"
+
+extern void klog(int level, const char *fmt, ...);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+extern volatile struct limine_rsdp_request rsdp_request; // de limine_requests.c
+
+typedef struct acpi_rsdp {
+    char signature[8];                      /* "RSD PTR " */
+    uint8_t checksum;                       /* Dos 20 primeiros bytes */
+    char oem_id[6];
+    uint8_t revision;                       /* 0 = ACPI 1.0, 2 = 2.0+ */
+    uint32_t rsdt_address;
+    uint32_t length;                        /* Daqui em diante só na 2.0+ */
+    uint64_t xsdt_address;
+    uint8_t ext_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+static const acpi_sdt_header_t *root;       /* XSDT ou RSDT */
+static int root_is_xsdt;
+
+static int acpi_checksum_ok(const void *p, uint32_t len) {
+    const uint8_t *b = (const uint8_t *)p;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) sum += b[i];
+    return sum == 0;
+}
+
+static const void *acpi_phys(uint64_t phys) {
+    if (!phys || phys >= 0x100000000ULL) return NULL;
+    return (const void *)phys;
+}
+
+int acpi_init(void) {
+    if (root) return 0;
+    if (!rsdp_request.response || !rsdp_request.response->address) {
+        klog(KLOG_WARN, "[ACPI] No RSDP from the bootloader");
+        return -1;
+    }
+
+    const acpi_rsdp_t *rsdp = (const acpi_rsdp_t *)rsdp_request.response->address;
+    if (memcmp(rsdp->signature, "RSD PTR ", 8) != 0 || !acpi_checksum_ok(rsdp, 20)) {
+        klog(KLOG_WARN, "[ACPI] Invalid RSDP");
+        return -1;
+    }
+
+    if (rsdp->revision >= 2 && acpi_checksum_ok(rsdp, rsdp->length)) {
+        root = acpi_phys(rsdp->xsdt_address);
+        root_is_xsdt = root != NULL;
+    }
+    if (!root) root = acpi_phys(rsdp->rsdt_address);
+    if (!root || !acpi_checksum_ok(root, root->length)) {
+        klog(KLOG_WARN, "[ACPI] Invalid %s", root_is_xsdt ? "XSDT" : "RSDT");
+        root = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+const acpi_sdt_header_t *acpi_find_table(const char *sig) {
+    if (!root && acpi_init() < 0) return NULL;
+
+    uint32_t width = root_is_xsdt ? 8 : 4;
+    uint32_t count = (root->length - sizeof(acpi_sdt_header_t)) / width;
+    const uint8_t *entries = (const uint8_t *)root + sizeof(acpi_sdt_header_t);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t phys;
+        if (root_is_xsdt) memcpy(&phys, entries + i * 8, 8);
+        else phys = *(const uint32_t *)(entries + i * 4);
+
+        const acpi_sdt_header_t *t = acpi_phys(phys);
+        if (!t || memcmp(t->signature, sig, 4) != 0) continue;
+        if (acpi_checksum_ok(t, t->length)) return t;
+    }
+    return NULL;
+}
@@ -0,0 +1,22 @@
+// acpi.h - Localização de tabelas ACPI (RSDP do Limine, RSDT/XSDT)
+#pragma once
+#include <stdint.h>
+
+typedef struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+/* Acha e valida RSDP e RSDT/XSDT; 0 ou -1 se não há ACPI */
+int acpi_init(void);
+
+/* Tabela com a assinatura 'sig' (4 letras, ex. "MCFG") e checksum
+ * válido; NULL se não existe */
+const acpi_sdt_header_t *acpi_find_table(const char *sig);
@@ -0,0 +1,707 @@
+/*
+ahci.c - Driver AHCI (SATA) com NCQ
+
+A HBA é assumida pelo driver PCI "ahci" (classe 01h/06h, prog-if 01h) e
+acessada pelo ABAR (BAR5, pci_map_bar). Cada porta com disco ganha:
+
+  - lista de comandos (32 cabeçalhos) e área de FIS recebidos;
+  - 32 tabelas de comando, cada uma com o FIS do comando e uma PRDT de
+    até AHCI_PRDT_ENTRIES entradas;
+  - blockdev "ahciN" com request_queue (merge/elevador de blkqueue.c);
+  - uma thread ("ahciN") que tira pedidos da fila enquanto há slot livre
+    e recolhe os que terminaram.
+
+Com NCQ cada pedido vira READ/WRITE FPDMA QUEUED com tag = slot, e até
+min(profundidade do disco, slots da HBA) ficam em voo; o disco reordena
+e responde com Set Device Bits (bit do slot some de PxSACT). Sem NCQ sai
+READ/WRITE DMA EXT, um por vez. FLUSH nunca é enfileirado junto de nada:
+a blkqueue só o entrega com a fila vazia, e nada sai enquanto ele roda.
+
+Os dados vão direto dos segmentos dos bios (memória do PMM, identidade);
+buffer fora disso (pilha/estáticos no higher half) passa pelo bounce da
+porta, um pedido por vez.
+
+Ainda não há roteamento de IRQ PCI: as conclusões são por polling de
+PxSACT/PxCI (a thread cede o CPU entre uma olhada e outra). Erro de task
+file ou da HBA falha todos os comandos em voo e reinicia a porta.
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include "ahci.h"
+#include "blockdev.h"
+#include "blkqueue.h"
+#include "waitqueue.h"
+#include "sched.h"
+#include "cpu.h"
+#include "bitops.h"
+#include "lapic.h"
+#include "pci.h"
+#include "pmm.h"
+#include "kmalloc.h"
+#include "string.h"
+
+extern void klog(int level, const char *fmt, ...);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+/* ===================== REGISTRADORES ===================== */
+
+#define PCI_SUBCLASS_SATA   0x06
+#define PCI_PROG_IF_AHCI    0x01
+#define AHCI_ABAR           5           /* BAR5 */
+
+/* HBA (ABAR) */
+#define HBA_CAP             0x00
+#define HBA_GHC             0x04
+#define HBA_IS              0x08
+#define HBA_PI              0x0C
+#define HBA_VS              0x10
+#define HBA_CAP2            0x24
+#define HBA_BOHC            0x28
+
+#define CAP_S64A            (1u << 31)
+#define CAP_SNCQ            (1u << 30)
+#define CAP_NCS(c)          ((((c) >> 8) & 0x1F) + 1)
+#define GHC_AE              (1u << 31)
+#define GHC_IE              (1u << 1)
+#define CAP2_BOH            (1u << 0)
+#define BOHC_BOS            (1u << 0)
+#define BOHC_OOS            (1u << 1)
+
+/* Porta: ABAR + 0x100 + n * 0x80 */
+#define PX_CLB              0x00
+#define PX_CLBU             0x04
+#define PX_FB               0x08
+#define PX_FBU              0x0C
+#define PX_IS               0x10
+#define PX_IE               0x14
+#define PX_CMD              0x18
+#define PX_TFD              0x20
+#define PX_SIG              0x24
+#define PX_SSTS             0x28
+#define PX_SCTL             0x2C
+#define PX_SERR             0x30
+#define PX_SACT             0x34
+#define PX_CI               0x38
+
+#define PXCMD_ST            (1u << 0)
+#define PXCMD_SUD           (1u << 1)
+#define PXCMD_POD           (1u << 2)
+#define PXCMD_FRE           (1u << 4)
+#define PXCMD_FR            (1u << 14)
+#define PXCMD_CR            (1u << 15)
+
+/* PxIS: erros que param a porta */
+#define PXIS_TFES           (1u << 30)  /* Task file error */
+#define PXIS_HBFS           (1u << 29)  /* Host bus fatal */
+#define PXIS_HBDS           (1u << 28)  /* Host bus data */
+#define PXIS_IFS            (1u << 27)  /* Interface fatal */
+#define PXIS_ERRORS         (PXIS_TFES | PXIS_HBFS | PXIS_HBDS | PXIS_IFS)
+
+#define TFD_ERR             0x01
+#define TFD_DRQ             0x08
+#define TFD_BSY             0x80
+
+#define SSTS_DET_PRESENT    0x3
+#define SSTS_IPM_ACTIVE     0x1
+#define SIG_SATA            0x00000101
+
+/* Comandos ATA */
+#define ATA_CMD_READ_DMA        0xC8
+#define ATA_CMD_WRITE_DMA       0xCA
+#define ATA_CMD_READ_DMA_EXT    0x25
+#define ATA_CMD_WRITE_DMA_EXT   0x35
+#define ATA_CMD_READ_FPDMA      0x60
+#define ATA_CMD_WRITE_FPDMA     0x61
+#define ATA_CMD_FLUSH           0xE7
+#define ATA_CMD_FLUSH_EXT       0xEA
+#define ATA_CMD_IDENTIFY        0xEC
+
+#define FIS_TYPE_REG_H2D    0x27
+
+/* ===================== ESTRUTURAS DA HBA ===================== */
+
+#define AHCI_SLOTS          32
+#define AHCI_PRDT_ENTRIES   BLK_MAX_REQ_SEGS
+#define AHCI_MAX_SECTORS    1024        /* 512 KiB por pedido juntado */
+#define AHCI_BOUNCE_PAGES   (AHCI_MAX_SECTORS * 512 / PMM_PAGE_SIZE)
+#define AHCI_PRD_MAX_BYTES  (4u * 1024 * 1024)
+
+#define AHCI_TIMEOUT_MS     5000        /* Por comando */
+#define AHCI_STOP_TIMEOUT_MS 500
+
+/* Cabeçalho de comando (lista de comandos, 32 bytes) */
+typedef struct ahci_cmd_header {
+    uint16_t flags;                     /* CFL (dwords do FIS), W, P, C... */
+    uint16_t prdtl;                     /* Entradas da PRDT */
+    volatile uint32_t prdbc;            /* Bytes transferidos (HBA escreve) */
+    uint32_t ctba;
+    uint32_t ctbau;
+    uint32_t reserved[4];
+} __attribute__((packed)) ahci_cmd_header_t;
+
+#define CMDH_CFL_H2D        5           /* FIS H2D = 20 bytes */
+#define CMDH_WRITE          (1u << 6)
+
+typedef struct ahci_prd {
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t reserved;
+    uint32_t dbc;                       /* Bytes - 1 (bits 21:0) */
+} __attribute__((packed)) ahci_prd_t;
+
+/* Tabela de comando: alinhada em 128 bytes (o tamanho já é múltiplo) */
+typedef struct ahci_cmd_table {
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t reserved[48];
+    ahci_prd_t prdt[AHCI_PRDT_ENTRIES];
+} __attribute__((packed)) ahci_cmd_table_t;
+
+#define AHCI_TABLE_PAGES \
+    ((AHCI_SLOTS * sizeof(ahci_cmd_table_t) + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE)
+
+typedef struct ahci_port {
+    int num;                            /* Porta na HBA */
+    volatile uint8_t *regs;
+    ahci_cmd_header_t *clb;             /* 1 KiB; FIS recebidos logo depois */
+    uint8_t *fis;
+    ahci_cmd_table_t *tables;
+
+    /* Disco (IDENTIFY) */
+    char model[41];
+    uint64_t sectors;
+    int lba48;
+    int ncq;
+
+    /* Comandos em voo; só a thread da porta (ou o kick inline) mexe */
+    blk_slots_t slots;                  /* Bit por slot; depth = slots usados */
+    int nonqueued;                      /* Comando sem NCQ em voo: nada mais sai */
+    request_t *slot_rq[AHCI_SLOTS];
+    uint64_t slot_deadline[AHCI_SLOTS];
+    uint8_t *bounce;
+    int bounce_slot;                    /* -1 = livre */
+
+    blockdev_t bdev;
+    request_queue_t queue;
+    blk_poller_t poller;
+    char name[8];
+
+    /* Estatísticas */
+    uint64_t commands;
+    uint64_t ncq_commands;
+    uint64_t bounced;
+    uint64_t errors;
+} ahci_port_t;
+
+static struct {
+    volatile uint8_t *abar;
+    uint32_t cap;
+    int s64a;
+    ahci_port_t *disks[AHCI_MAX_DISKS];
+    int ndisks;
+} hba;
+
+/* ===================== ACESSO E TEMPO ===================== */
+
+static inline uint32_t hba_read(uint32_t off) {
+    return *(volatile uint32_t *)(hba.abar + off);
+}
+
+static inline void hba_write(uint32_t off, uint32_t val) {
+    *(volatile uint32_t *)(hba.abar + off) = val;
+}
+
+static inline uint32_t port_read(ahci_port_t *p, uint32_t off) {
+    return *(volatile uint32_t *)(p->regs + off);
+}
+
+static inline void port_write(ahci_port_t *p, uint32_t off, uint32_t val) {
+    *(volatile uint32_t *)(p->regs + off) = val;
+}
+
+static uint64_t ahci_deadline(uint32_t ms) {
+    return rdtsc() + (uint64_t)ms * tsc_ticks_per_ms();
+}
+
+/* Espera (reg & mask) == val; 0 ou -1 no timeout */
+static int port_wait(ahci_port_t *p, uint32_t off, uint32_t mask, uint32_t val, uint32_t ms) {
+    uint64_t deadline = ahci_deadline(ms);
+    while ((port_read(p, off) & mask) != val) {
+        if (rdtsc() >= deadline) return -1;
+        cpu_relax();
+    }
+    return 0;
+}
+
+/* Buffer usável direto pela HBA: memória identidade (abaixo de 4 GiB) e
+ * endereço par */
+static int ahci_direct_ok(const void *buf, uint32_t bytes) {
+    uint64_t v = (uint64_t)buf;
+    return !(v & 1) && v + bytes <= 0x100000000ULL;
+}
+
+/* ===================== PORTA ===================== */
+
+static int ahci_port_stop(ahci_port_t *p) {
+    uint32_t cmd = port_read(p, PX_CMD);
+    port_write(p, PX_CMD, cmd & ~(PXCMD_ST | PXCMD_FRE));
+    return port_wait(p, PX_CMD, PXCMD_CR | PXCMD_FR, 0, AHCI_STOP_TIMEOUT_MS);
+}
+
+static int ahci_port_start(ahci_port_t *p) {
+    port_write(p, PX_SERR, 0xFFFFFFFF);
+    port_write(p, PX_IS, 0xFFFFFFFF);
+    port_write(p, PX_CMD, port_read(p, PX_CMD) | PXCMD_FRE);
+    if (port_wait(p, PX_TFD, TFD_BSY | TFD_DRQ, 0, 1000) < 0) return -1;
+    port_write(p, PX_CMD, port_read(p, PX_CMD) | PXCMD_ST);
+    return 0;
+}
+
+/* COMRESET: reinicia o link quando o device ficou preso em BSY/DRQ */
+static void ahci_port_comreset(ahci_port_t *p) {
+    uint32_t sctl = port_read(p, PX_SCTL) & ~0xFu;
+    port_write(p, PX_SCTL, sctl | 1);
+    uint64_t deadline = ahci_deadline(2);
+    while (rdtsc() < deadline) cpu_relax();
+    port_write(p, PX_SCTL, sctl);
+    port_wait(p, PX_SSTS, 0xF, SSTS_DET_PRESENT, 1000);
+    port_write(p, PX_SERR, 0xFFFFFFFF);
+}
+
+static int ahci_port_setup(ahci_port_t *p) {
+    if (ahci_port_stop(p) < 0) return -1;
+
+    /* Lista de comandos (1 KiB) e FIS recebidos (256 B) na mesma página */
+    uint8_t *page = pmalloc(1);
+    p->tables = pmalloc(AHCI_TABLE_PAGES);
+    if (!page || !p->tables) return -1;
+    memset(page, 0, PMM_PAGE_SIZE);
+    memset(p->tables, 0, AHCI_TABLE_PAGES * PMM_PAGE_SIZE);
+    p->clb = (ahci_cmd_header_t *)page;
+    p->fis = page + 1024;
+
+    uint64_t clb = pmm_virt_to_phys(p->clb);
+    uint64_t fb = pmm_virt_to_phys(p->fis);
+    uint64_t tb = pmm_virt_to_phys(p->tables);
+    if (!hba.s64a && tb + AHCI_TABLE_PAGES * PMM_PAGE_SIZE > 0x100000000ULL) return -1;
+
+    for (int s = 0; s < AHCI_SLOTS; s++) {
+        uint64_t ctba = tb + (uint64_t)s * sizeof(ahci_cmd_table_t);
+        p->clb[s].ctba = (uint32_t)ctba;
+        p->clb[s].ctbau = (uint32_t)(ctba >> 32);
+    }
+    port_write(p, PX_CLB, (uint32_t)clb);
+    port_write(p, PX_CLBU, (uint32_t)(clb >> 32));
+    port_write(p, PX_FB, (uint32_t)fb);
+    port_write(p, PX_FBU, (uint32_t)(fb >> 32));
+    port_write(p, PX_IE, 0);                    /* Polling */
+
+    p->bounce_slot = -1;
+    return ahci_port_start(p);
+}
+
+/* ===================== MONTAGEM DO COMANDO ===================== */
+
+static void ahci_fis(ahci_cmd_table_t *t, uint8_t cmd, uint64_t lba,
+                     uint16_t count, uint16_t features, uint8_t device) {
+    uint8_t *f = t->cfis;
+    memset(f, 0, 20);
+    f[0] = FIS_TYPE_REG_H2D;
+    f[1] = 0x80;                                /* C: é comando */
+    f[2] = cmd;
+    f[3] = (uint8_t)features;
+    f[4] = (uint8_t)lba;
+    f[5] = (uint8_t)(lba >> 8);
+    f[6] = (uint8_t)(lba >> 16);
+    f[7] = device;
+    f[8] = (uint8_t)(lba >> 24);
+    f[9] = (uint8_t)(lba >> 32);
+    f[10] = (uint8_t)(lba >> 40);
+    f[11] = (uint8_t)(features >> 8);
+    f[12] = (uint8_t)count;
+    f[13] = (uint8_t)(count >> 8);
+}
+
+/* Acrescenta [phys, phys+bytes) à PRDT, juntando com a entrada anterior
+ * quando continua; devolve o novo total ou -1 se não coube */
+static int ahci_prd_add(ahci_cmd_table_t *t, int n, uint64_t phys, uint32_t bytes) {
+    if (n > 0) {
+        ahci_prd_t *last = &t->prdt[n - 1];
+        uint64_t end = ((uint64_t)last->dbau << 32 | last->dba) + (last->dbc & 0x3FFFFF) + 1;
+        uint32_t len = (last->dbc & 0x3FFFFF) + 1;
+        if (end == phys && len + bytes <= AHCI_PRD_MAX_BYTES) {
+            last->dbc = len + bytes - 1;
+            return n;
+        }
+    }
+    if (n >= AHCI_PRDT_ENTRIES) return -1;
+    t->prdt[n] = (ahci_prd_t){
+        .dba = (uint32_t)phys, .dbau = (uint32_t)(phys >> 32), .dbc = bytes - 1,
+    };
+    return n + 1;
+}
+
+/* PRDT direto dos segmentos do pedido; -1 se algum trecho não serve */
+static int ahci_build_prdt(ahci_cmd_table_t *t, request_t *rq) {
+    blk_cursor_t cur;
+    blk_cursor_init(&cur, rq->bio_head);
+    uint32_t left = rq->sectors;
+    int n = 0;
+    while (left) {
+        uint32_t k;
+        void *p = blk_cursor_next(&cur, left, &k);
+        if (!ahci_direct_ok(p, k * 512)) return -1;
+        n = ahci_prd_add(t, n, pmm_virt_to_phys(p), k * 512);
+        if (n < 0) return -1;
+        left -= k;
+    }
+    return n;
+}
+
+static void ahci_issue_slot(ahci_port_t *p, int slot, int queued) {
+    /* Tabela e cabeçalho visíveis à HBA antes do doorbell */
+    __sync_synchronize();
+    if (queued) port_write(p, PX_SACT, 1u << slot);
+    port_write(p, PX_CI, 1u << slot);
+
+    blk_slots_get(&p->slots, slot);
+    p->slot_deadline[slot] = ahci_deadline(AHCI_TIMEOUT_MS);
+    p->commands++;
+}
+
+/* Monta o pedido no slot e dispara. 1 = saiu; 0 = precisa esperar
+ * (bounce ocupado ou NCQ/não-NCQ misturados); -1 = erro (pedido falha) */
+static int ahci_start_request(blk_slots_t *s, int slot, request_t *rq, void *ctx) {
+    (void)ctx;
+    ahci_port_t *p = (ahci_port_t *)s->driver;
+    if (p->nonqueued) return 0;
+
+    ahci_cmd_header_t *h = &p->clb[slot];
+    ahci_cmd_table_t *t = &p->tables[slot];
+    int write = rq->op == BIO_WRITE;
+
+    if (rq->op == BIO_FLUSH) {
+        if (p->slots.busy) return 0;
+        ahci_fis(t, p->lba48 ? ATA_CMD_FLUSH_EXT : ATA_CMD_FLUSH, 0, 0, 0, 0);
+        h->flags = CMDH_CFL_H2D;
+        h->prdtl = 0;
+        h->prdbc = 0;
+        p->slot_rq[slot] = rq;
+        p->nonqueued = 1;
+        ahci_issue_slot(p, slot, 0);
+        return 1;
+    }
+
+    if (!p->ncq && p->slots.busy) return 0;
+
+    int n = ahci_build_prdt(t, rq);
+    int bounced = n < 0;
+    if (bounced) {
+        if (p->bounce_slot >= 0 || !p->bounce) return p->bounce ? 0 : -1;
+        if (rq->sectors > AHCI_MAX_SECTORS) return -1;
+        if (write) blk_bounce_copy(rq, p->bounce, 1);
+        n = ahci_prd_add(t, 0, pmm_virt_to_phys(p->bounce), rq->sectors * 512);
+        p->bounce_slot = slot;
+        p->bounced++;
+    }
+
+    uint16_t count = (uint16_t)rq->sectors;     /* 0 = 65536, nunca passa de AHCI_MAX_SECTORS */
+    if (p->ncq) {
+        /* FPDMA: contagem em FEATURES, tag em COUNT[7:3] */
+        ahci_fis(t, write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA,
+                 rq->lba, (uint16_t)(slot << 3), count, 0x40);
+        p->ncq_commands++;
+    } else if (p->lba48) {
+        ahci_fis(t, write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT,
+                 rq->lba, count, 0, 0x40);
+    } else {
+        ahci_fis(t, write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA,
+                 rq->lba & 0xFFFFFF, count, 0, 0x40 | ((rq->lba >> 24) & 0x0F));
+    }
+
+    h->flags = CMDH_CFL_H2D | (write ? CMDH_WRITE : 0);
+    h->prdtl = (uint16_t)n;
+    h->prdbc = 0;
+    p->slot_rq[slot] = rq;
+    p->nonqueued = !p->ncq;
+    ahci_issue_slot(p, slot, p->ncq);
+    return 1;
+}
+
+/* ===================== CONCLUSÃO ===================== */
+
+static void ahci_finish_slot(ahci_port_t *p, int slot, int status) {
+    request_t *rq = p->slot_rq[slot];
+    p->slot_rq[slot] = NULL;
+    blk_slots_put(&p->slots, slot);
+    if (!p->slots.busy) p->nonqueued = 0;
+
+    if (p->bounce_slot == slot) {
+        if (status == 0 && rq->op == BIO_READ) blk_bounce_copy(rq, p->bounce, 0);
+        p->bounce_slot = -1;
+    }
+    blk_end_request(&p->queue, rq, status);
+}
+
+/* Erro ou timeout: falha tudo em voo e reinicia a porta */
+static void ahci_port_error(ahci_port_t *p, const char *why) {
+    uint32_t is = port_read(p, PX_IS);
+    uint32_t tfd = port_read(p, PX_TFD);
+    klog(KLOG_WARN, "[AHCI] %s: %s (IS=0x%x TFD=0x%x SERR=0x%x), failing %u commands",
+         p->name, why, is, tfd, port_read(p, PX_SERR),
+         bit_count(p->slots.busy));
+    p->errors++;
+
+    ahci_port_stop(p);
+    if (port_read(p, PX_TFD) & (TFD_BSY | TFD_DRQ)) ahci_port_comreset(p);
+    ahci_port_start(p);
+
+    for (int s = 0; s < AHCI_SLOTS; s++) {
+        if (p->slots.busy & (1u << s)) ahci_finish_slot(p, s, -1);
+    }
+}
+
+/* Recolhe os slots cujo bit saiu de PxSACT/PxCI */
+static void ahci_reap(ahci_port_t *p) {
+    if (!p->slots.busy) return;
+
+    if (port_read(p, PX_IS) & PXIS_ERRORS) {
+        ahci_port_error(p, "command failed");
+        return;
+    }
+
+    uint32_t busy = port_read(p, PX_CI) | (p->ncq ? port_read(p, PX_SACT) : 0);
+    uint32_t done = p->slots.busy & ~busy;
+    port_write(p, PX_IS, port_read(p, PX_IS));
+
+    while (done) {
+        int s = __builtin_ctz(done);
+        done &= done - 1;
+        ahci_finish_slot(p, s, 0);
+    }
+
+    uint64_t now = rdtsc();
+    for (uint32_t left = p->slots.busy; left; left &= left - 1) {
+        if (now >= p->slot_deadline[__builtin_ctz(left)]) {
+            blockdev_account_timeout(&p->bdev);
+            ahci_port_error(p, "command timeout");
+            return;
+        }
+    }
+}
+
+static const blk_slot_ops_t ahci_slot_ops = { .start = ahci_start_request };
+
+/* Um passo da porta: recolhe o que terminou e enche os slots livres */
+static void ahci_service(void *arg) {
+    ahci_port_t *p = (ahci_port_t *)arg;
+    ahci_reap(p);
+    blk_slots_fill(&p->slots);
+}
+
+static int ahci_port_busy(void *arg) {
+    return blk_slots_busy(&((ahci_port_t *)arg)->slots);
+}
+
+static int ahci_port_inflight(void *arg) {
+    return ((ahci_port_t *)arg)->slots.busy != 0;
+}
+
+static const blk_poll_ops_t ahci_poll_ops = {
+    .service = ahci_service, .busy = ahci_port_busy, .inflight = ahci_port_inflight,
+};
+
+static void ahci_queue_kick(request_queue_t *q) {
+    blk_poller_kick(&((ahci_port_t *)q->driver_data)->poller);
+}
+
+/* ===================== IDENTIFY ===================== */
+
+/* Comando síncrono no slot 0 (só na inicialização, porta ociosa) */
+static int ahci_exec_sync(ahci_port_t *p, uint8_t cmd, void *buf, uint32_t bytes) {
+    ahci_cmd_header_t *h = &p->clb[0];
+    ahci_cmd_table_t *t = &p->tables[0];
+
+    ahci_fis(t, cmd, 0, 0, 0, 0);
+    h->flags = CMDH_CFL_H2D;
+    h->prdtl = buf ? 1 : 0;
+    h->prdbc = 0;
+    if (buf) t->prdt[0] = (ahci_prd_t){
+        .dba = (uint32_t)pmm_virt_to_phys(buf),
+        .dbau = (uint32_t)(pmm_virt_to_phys(buf) >> 32), .dbc = bytes - 1,
+    };
+
+    __sync_synchronize();
+    port_write(p, PX_CI, 1);
+    uint64_t deadline = ahci_deadline(1000);
+    while (port_read(p, PX_CI) & 1) {
+        if (port_read(p, PX_IS) & PXIS_TFES) return -1;
+        if (rdtsc() >= deadline) return -1;
+        cpu_relax();
+    }
+    port_write(p, PX_IS, port_read(p, PX_IS));
+    return (port_read(p, PX_TFD) & TFD_ERR) ? -1 : 0;
+}
+
+static int ahci_identify(ahci_port_t *p) {
+    uint16_t *id = pmalloc(1);
+    if (!id) return -1;
+    if (ahci_exec_sync(p, ATA_CMD_IDENTIFY, id, 512) < 0) {
+        pfree(id, 1);
+        return -1;
+    }
+
+    for (int i = 0; i < 20; i++) {
+        p->model[i * 2] = (char)(id[27 + i] >> 8);
+        p->model[i * 2 + 1] = (char)id[27 + i];
+    }
+    p->model[40] = 0;
+    for (int i = 39; i >= 0 && p->model[i] == ' '; i--) p->model[i] = 0;
+
+    p->lba48 = (id[83] & 0x0400) != 0;
+    if (p->lba48) {
+        p->sectors = (uint64_t)id[100] | ((uint64_t)id[101] << 16) |
+                     ((uint64_t)id[102] << 32) | ((uint64_t)id[103] << 48);
+    } else {
+        p->sectors = (uint32_t)id[60] | ((uint32_t)id[61] << 16);
+    }
+
+    /* Word 76 bit 8: NCQ; word 75: profundidade - 1 */
+    uint32_t slots = CAP_NCS(hba.cap);
+    p->ncq = (hba.cap & CAP_SNCQ) && (id[76] & 0x0100);
+    if (p->ncq) {
+        uint32_t qd = (id[75] & 0x1F) + 1;
+        p->slots.depth = qd < slots ? qd : slots;
+    } else {
+        p->slots.depth = 1;
+    }
+
+    pfree(id, 1);
+    return 0;
+}
+
+/* ===================== INICIALIZAÇÃO ===================== */
+
+/* Pede a HBA ao firmware (BIOS/OS handoff), se ele anuncia */
+static void ahci_handoff(void) {
+    if (!(hba_read(HBA_CAP2) & CAP2_BOH)) return;
+    hba_write(HBA_BOHC, hba_read(HBA_BOHC) | BOHC_OOS);
+    uint64_t deadline = ahci_deadline(25);
+    while ((hba_read(HBA_BOHC) & BOHC_BOS) && rdtsc() < deadline) cpu_relax();
+}
+
+static void ahci_probe_port(int n) {
+    if (hba.ndisks >= AHCI_MAX_DISKS) return;
+
+    volatile uint8_t *regs = hba.abar + 0x100 + n * 0x80;
+    uint32_t ssts = *(volatile uint32_t *)(regs + PX_SSTS);
+    if ((ssts & 0xF) != SSTS_DET_PRESENT || ((ssts >> 8) & 0xF) != SSTS_IPM_ACTIVE) return;
+    if (*(volatile uint32_t *)(regs + PX_SIG) != SIG_SATA) return;   /* ATAPI, PM... */
+
+    ahci_port_t *p = kmalloc(sizeof(*p));
+    if (!p) return;
+    memset(p, 0, sizeof(*p));
+    p->num = n;
+    p->regs = regs;
+    blk_slots_init(&p->slots, &ahci_slot_ops, &p->queue, p, 1);
+    blk_poller_init(&p->poller, &ahci_poll_ops, p);
+
+    if (ahci_port_setup(p) < 0 || ahci_identify(p) < 0) {
+        klog(KLOG_WARN, "[AHCI] Port %d: disk did not come up", n);
+        kfree(p);
+        return;
+    }
+    p->bounce = pmalloc(AHCI_BOUNCE_PAGES);
+
+    int idx = hba.ndisks++;
+    hba.disks[idx] = p;
+    p->name[0] = 'a'; p->name[1] = 'h'; p->name[2] = 'c'; p->name[3] = 'i';
+    p->name[4] = (char)('0' + idx);
+    p->name[5] = 0;
+
+    p->bdev.name = p->name;
+    p->bdev.sector_size = 512;
+    p->bdev.sectors = p->sectors;
+    p->bdev.priv = p;
+    blk_queue_init(&p->queue, p->lba48 ? AHCI_MAX_SECTORS : 256, ahci_queue_kick, p);
+    p->bdev.queue = &p->queue;
+
+    klog(KLOG_INFO, "[AHCI] %s (port %d): %s, %u MiB, LBA%d, %s depth %u",
+         p->name, n, p->model, (uint32_t)(p->sectors / 2048), p->lba48 ? 48 : 28,
+         p->ncq ? "NCQ" : "no NCQ,", p->slots.depth);
+
+    /* Sem scheduler os pedidos rodam inline no kick */
+    blk_poller_start(&p->poller, p->name);
+    blockdev_add_disk(&p->bdev);
+}
+
+/* Só a primeira HBA: os discos dela bastam */
+static int ahci_pci_probe(pci_dev_t *d) {
+    if (hba.abar) return -1;
+
+    volatile uint8_t *abar = pci_map_bar(d, AHCI_ABAR);
+    if (!abar) {
+        klog(KLOG_WARN, "[AHCI] ABAR is not a memory BAR");
+        return -1;
+    }
+    pci_addr_t pa = d->addr;
+    pci_enable_bus_master(pa);
+    hba.abar = abar;
+
+    ahci_handoff();
+    hba_write(HBA_GHC, hba_read(HBA_GHC) | GHC_AE);
+    hba_write(HBA_GHC, hba_read(HBA_GHC) & ~GHC_IE);        /* Polling */
+    hba.cap = hba_read(HBA_CAP);
+    hba.s64a = (hba.cap & CAP_S64A) != 0;
+
+    uint32_t vs = hba_read(HBA_VS);
+    uint32_t pi = hba_read(HBA_PI);
+    klog(KLOG_INFO, "[AHCI] HBA %x:%x.%x, AHCI %u.%u, %u slots, ports 0x%x%s",
+         pa.bus, pa.dev, pa.func, vs >> 16, (vs >> 8) & 0xFF, CAP_NCS(hba.cap), pi,
+         (hba.cap & CAP_SNCQ) ? ", NCQ" : "");
+
+    for (int n = 0; n < 32; n++) {
+        if (pi & (1u << n)) ahci_probe_port(n);
+    }
+    hba_write(HBA_IS, 0xFFFFFFFF);
+    return 0;
+}
+
+static const pci_match_t ahci_pci_ids[] = {
+    PCI_MATCH_CLASS(PCI_CLASS_STORAGE, PCI_SUBCLASS_SATA, PCI_PROG_IF_AHCI),
+    { 0 },
+};
+
+static const pci_driver_t ahci_pci_driver = {
+    .name = "ahci", .ids = ahci_pci_ids, .probe = ahci_pci_probe,
+};
+
+int ahci_init(void) {
+    if (pci_register_driver(&ahci_pci_driver) <= 0) {
+        klog(KLOG_INFO, "[AHCI] No AHCI controller");
+        return -1;
+    }
+    return hba.ndisks ? 0 : -1;
+}
+
+int ahci_disk_count(void) {
+    return hba.ndisks;
+}
+
+blockdev_t *ahci_blockdev(int idx) {
+    if (idx < 0 || idx >= hba.ndisks) return NULL;
+    return &hba.disks[idx]->bdev;
+}
+
+void ahci_dump_stats(void) {
+    for (int i = 0; i < hba.ndisks; i++) {
+        ahci_port_t *p = hba.disks[i];
+        klog(KLOG_INFO, "[AHCI] %s: %u commands (%u NCQ), max %u in flight, %u bounced, %u errors",
+             p->name, (uint32_t)p->commands, (uint32_t)p->ncq_commands,
+             p->slots.max_inflight, (uint32_t)p->bounced, (uint32_t)p->errors);
+    }
+}
@@ -0,0 +1,25 @@
+// ahci.h - Driver AHCI (SATA) com NCQ
+//
+// Acha a HBA pelo PCI (classe 01h/06h, prog-if 01h), liga cada porta com
+// disco SATA e a expõe como blockdev ("ahci0", "ahci1"...). Cada porta tem
+// lista de comandos, área de FIS recebidos e 32 tabelas de comando com
+// PRDT (scatter-gather direto dos segmentos dos bios). Com NCQ (READ/WRITE
+// FPDMA QUEUED) a thread da porta mantém até 32 comandos em voo; sem NCQ,
+// um por vez. Conclusões são por polling de PxSACT/PxCI.
+#pragma once
+#include <stdint.h>
+#include "blockdev.h"
+
+#define AHCI_MAX_DISKS      8
+
+/* Acha a HBA e inicializa as portas com disco; 0 se achou algum disco */
+int ahci_init(void);
+
+/* Quantos discos SATA foram achados */
+int ahci_disk_count(void);
+
+/* Disco 'idx' (ordem das portas) como blockdev; NULL se não existe */
+blockdev_t *ahci_blockdev(int idx);
+
+/* Loga comandos, NCQ e profundidade máxima atingida por porta */
+void ahci_dump_stats(void);
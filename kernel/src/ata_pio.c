@@ -1,8 +1,52 @@
 /*
 ata_pio.c - Driver ATA PIO com API compatível
+
+Com o scheduler rodando, os comandos são completados pela interrupção do
+canal (IRQ14/IRQ15): quem pediu dorme numa completion e o handler move os
+setores pela porta de dados. Antes disso (ou se a IRQ não chegar) cai no
+polling antigo do registrador de status.
+
+Se a controladora IDE PCI tem bus master (PIIX no QEMU) e o drive anuncia
+DMA, as transferências vão por DMA com PRD table; erro da controladora
+desliga o DMA e o comando é refeito em PIO.
+
+Em PIO o drive é posto em SET MULTIPLE MODE e os comandos são READ/WRITE
+MULTIPLE: um handshake de DRQ (e uma IRQ) por bloco de setores, movido com
+rep insw/outsw.
+
+Probe: os dois canais são varridos ao mesmo tempo (o secundário num
+kworker), com um reset por canal, barramento flutuante (status 0xFF)
+descartado na hora e timeouts medidos em tempo pelo TSC. Todos os drives
+ATA encontrados ficam em drives[]; a API sem índice usa o primeiro.
+
+Camada de blocos: cada drive é um blockdev_t com request_queue própria
+(merge e elevador em blkqueue.c). Uma thread por canal ("ata0"/"ata1")
+tira pedidos das filas do master e do slave e executa cada um como um só
+comando, espalhando os setores pelos segmentos dos bios (PIO pelo cursor,
+DMA com uma entrada de PRD por trecho).
 */
 #include <stdint.h>
 #include <stddef.h>
+#include "ata_pio.h"
+#include "blockdev.h"
+#include "blkqueue.h"
+#include "waitqueue.h"
+#include "workqueue.h"
+#include "spinlock.h"
+#include "cpu.h"
+#include "lapic.h"
+#include "pci.h"
+#include "pmm.h"
+#include "string.h"
+
+extern void klog(int level, const char *fmt, ...);
+extern void enable_irq(uint8_t irq);
+extern void disable_irq(uint8_t irq);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
 
 #define ATA_DATA 0x00
 #define ATA_ERROR 0x01
@@ -15,190 +59,1057 @@ ata_pio.c - Driver ATA PIO com API compatível
 #define ATA_STATUS 0x07
 #define ATA_COMMAND 0x07
 #define ATA_DEV_CTL 0x206
+#define ATA_ALT_STATUS 0x206
+
+#define ATA_CTL_nIEN 0x02
+
+#define ATA_STATUS_RDY ATA_STATUS_DRDY
 
-#define ATA_STATUS_ERR 0x01
-#define ATA_STATUS_DRQ 0x08
-#define ATA_STATUS_RDY 0x40
-#define ATA_STATUS_BSY 0x80
+#define ATA_CMD_READ_MULTIPLE 0xC4
+#define ATA_CMD_WRITE_MULTIPLE 0xC5
+#define ATA_CMD_SET_MULTIPLE 0xC6
+#define ATA_CMD_READ_MULTIPLE_EXT 0x29
+#define ATA_CMD_WRITE_MULTIPLE_EXT 0x39
+#define ATA_CMD_READ_PIO_EXT 0x24
+#define ATA_CMD_WRITE_PIO_EXT 0x34
+#define ATA_CMD_READ_DMA_EXT 0x25
+#define ATA_CMD_WRITE_DMA_EXT 0x35
+#define ATA_CMD_FLUSH_CACHE_EXT 0xEA
 
-#define ATA_CMD_IDENTIFY 0xEC
-#define ATA_CMD_READ_PIO 0x20
-#define ATA_CMD_WRITE_PIO 0x30
-#define ATA_CMD_FLUSH_CACHE 0xE7
+/* Limites por comando: 28 bits = 256 setores, 48 bits = 65536 */
+#define ATA_LBA28_LIMIT (1ULL << 28)
+#define ATA_MAX_SECTORS_28 256
+#define ATA_MAX_SECTORS_48 65536
+
+/* Registradores do bus master IDE (offset do canal dentro do BAR4) */
+#define BM_CMD 0x00
+#define BM_STATUS 0x02
+#define BM_PRDT 0x04
+
+#define BM_CMD_START 0x01
+#define BM_CMD_READ 0x08              /* Direção: device -> memória */
+#define BM_STATUS_ACTIVE 0x01
+#define BM_STATUS_ERR 0x02
+#define BM_STATUS_IRQ 0x04
 
-static inline void io_wait(void) { asm volatile("outb %%al, $0x80" : : "a"(0)); }
 static inline uint8_t inb(uint16_t port) { uint8_t ret; asm volatile("inb %1, %0" : "=a"(ret) : "Nd"(port)); return ret; }
 static inline void outb(uint16_t port, uint8_t val) { asm volatile("outb %0, %1" : : "a"(val), "Nd"(port)); }
-static inline uint16_t inw(uint16_t port) { uint16_t ret; asm volatile("inw %1, %0" : "=a"(ret) : "Nd"(port)); return ret; }
-static inline void outw(uint16_t port, uint16_t val) { asm volatile("outw %0, %1" : : "a"(val), "Nd"(port)); }
+
+/* Timeouts em microssegundos, medidos pelo TSC (não em voltas de loop) */
+#define ATA_TIMEOUT_RESET_US    2000000   /* BSY depois do SRST */
+#define ATA_TIMEOUT_IDENTIFY_US 1000000
+#define ATA_TIMEOUT_DRQ_US      1000000   /* Cada bloco de um comando */
+#define ATA_TIMEOUT_BSY_US      1000000
+#define ATA_TIMEOUT_FLUSH_US    10000000
+
+/* Tempo máximo esperando a IRQ de um comando antes de voltar ao polling */
+#define ATA_IRQ_TIMEOUT_MS 2000
+
+/* Bounce buffer de 256 setores; pedidos maiores fora do identity map
+ * são quebrados nesse tamanho */
+#define ATA_DMA_BOUNCE_SECTORS 256
+#define ATA_DMA_BOUNCE_PAGES (ATA_DMA_BOUNCE_SECTORS * 512 / PMM_PAGE_SIZE)
+
+/* 65536 setores desalinhados precisam de 513 PRDs, mais um por segmento
+ * de scatter-gather; 2 páginas alinhadas em 8 KiB dão 1024 e nunca cruzam
+ * 64 KiB */
+#define ATA_PRDT_PAGES 2
+#define ATA_PRDT_ENTRIES (ATA_PRDT_PAGES * PMM_PAGE_SIZE / 8)
+
+/* Physical Region Descriptor: região contígua que não cruza 64 KiB */
+typedef struct __attribute__((packed)) {
+    uint32_t addr;
+    uint16_t bytes;           /* 0 = 64 KiB */
+    uint16_t flags;
+} ata_prd_t;
+
+#define PRD_EOT 0x8000
+
+/* Estado de um canal IDE e do comando em curso nele */
+typedef struct {
+    uint16_t base;
+    uint8_t irq;
+    int irq_mode;             /* nIEN limpo e IRQ desmascarada */
+    uint16_t bmbase;          /* Bus master do canal (0 = sem DMA) */
+    ata_prd_t *prdt;          /* Duas páginas do PMM, abaixo de 4 GiB */
+    uint8_t *bounce;          /* Para buffers fora do identity map */
+    mutex_t io_lock;          /* Um comando por vez no canal */
+    completion_t probed;
+    spinlock_t lock;          /* Comando em curso vs. handler da IRQ */
+    completion_t done;
+    int active;               /* Há comando esperando IRQ */
+    int dma;
+    int write;
+    blk_cursor_t *cur;        /* Segmentos do comando em curso */
+    uint32_t remaining;       /* Setores que ainda passam pela porta */
+    uint32_t block;           /* Setores por DRQ (READ/WRITE MULTIPLE) */
+    int status;
+    uint64_t busy_cycles;     /* CPU preso no I/O: polling ou emissão */
+    uint64_t irq_cycles;      /* TSC gasto no handler (benchmark) */
+    uint32_t irqs;
+    uint32_t spurious;
+    wait_queue_t bio_wq;      /* Thread do canal espera pedidos aqui */
+    thread_t *worker;
+} ata_channel_t;
+
+static ata_channel_t channels[2] = {
+    { .base = 0x1F0, .irq = 14, .io_lock = MUTEX_INIT, .lock = SPINLOCK_INIT,
+      .probed = { 0, WAIT_QUEUE_INIT }, .done = { 0, WAIT_QUEUE_INIT },
+      .bio_wq = WAIT_QUEUE_INIT },
+    { .base = 0x170, .irq = 15, .io_lock = MUTEX_INIT, .lock = SPINLOCK_INIT,
+      .probed = { 0, WAIT_QUEUE_INIT }, .done = { 0, WAIT_QUEUE_INIT },
+      .bio_wq = WAIT_QUEUE_INIT },
+};
 
 typedef struct {
     uint16_t base;
     uint8_t slave;
-    uint32_t sectors;
+    uint64_t sectors;
     int present;
+    int lba48;
+    int dma_capable;
+    uint32_t multiple;        /* Setores por bloco aceitos (0 = sem MULTIPLE) */
     char model[41];
+    ata_channel_t *ch;
+    blockdev_t bdev;
+    request_queue_t queue;
 } ata_drive_t;
 
-static ata_drive_t drive;
+/* Índice = canal * 2 + slave */
+static ata_drive_t drives[ATA_MAX_DRIVES];
+
+static const char *const ata_drive_names[ATA_MAX_DRIVES] = {
+    "ata0", "ata1", "ata2", "ata3"
+};
+
+/* Drive da API sem índice (o primeiro encontrado) */
+static ata_drive_t *default_drive = NULL;
 
-static int ata_wait(uint16_t base, uint8_t mask, uint8_t val, int timeout) {
-    for(int i=0;i<timeout;i++){
+/* Chaves globais dos modos (o benchmark alterna entre eles); o canal e o
+ * drive ainda precisam suportar o modo para ele ser usado */
+static int ata_allow_irq = 1;
+static int ata_allow_dma = 1;
+static int ata_allow_multi = 1;
+
+/* Tipos de transferência para ata_issue_rw */
+#define ATA_XFER_PIO 0
+#define ATA_XFER_MULTI 1
+#define ATA_XFER_DMA 2
+
+/* ===================== TEMPO ===================== */
+
+static uint64_t ata_us_to_tsc(uint32_t us) {
+    return (uint64_t)us * tsc_ticks_per_ms() / 1000;
+}
+
+/* Espera ocupada curta (pulso de SRST, settle do reset) */
+static void ata_delay_us(uint32_t us) {
+    uint64_t end = rdtsc() + ata_us_to_tsc(us);
+    while (rdtsc() < end) cpu_relax();
+}
+
+/* 400 ns depois de selecionar o drive: quatro leituras do alt status */
+static void ata_select_delay(uint16_t base) {
+    for (int i = 0; i < 4; i++) (void)inb(base + ATA_ALT_STATUS);
+}
+
+/* 0 pronto, -1 ERR, -2 prazo estourado */
+static int ata_wait(uint16_t base, uint8_t mask, uint8_t val, uint32_t timeout_us) {
+    uint64_t deadline = rdtsc() + ata_us_to_tsc(timeout_us);
+    for(;;){
         uint8_t s = inb(base + ATA_STATUS);
         if(s & ATA_STATUS_ERR) return -1;
         if((s & mask) == val) return 0;
-        for(int j=0;j<1000;j++) asm volatile("nop");
+        if(rdtsc() >= deadline) return -2;
+        wait_poll_relax();
     }
-    return -1;
 }
 
+/* ata_wait de um comando do drive: o timeout entra no iostat dele */
+static int ata_wait_drive(ata_drive_t *d, uint8_t mask, uint8_t val, uint32_t timeout_us) {
+    int ret = ata_wait(d->base, mask, val, timeout_us);
+    if (ret == -2) blockdev_account_timeout(&d->bdev);
+    return ret;
+}
+
+/* ===================== PROBE ===================== */
+
 static void ata_reset(uint16_t base) {
-    outb(base + ATA_DEV_CTL, 0x04);
-    for(int i=0;i<500;i++) io_wait();
+    outb(base + ATA_DEV_CTL, ATA_CONTROL_SRST);
+    ata_delay_us(5);
     outb(base + ATA_DEV_CTL, 0x00);
-    for(int i=0;i<20000;i++) io_wait();
-    ata_wait(base, ATA_STATUS_BSY, 0, 30000);
+    ata_delay_us(2000);
+    ata_wait(base, ATA_STATUS_BSY, 0, ATA_TIMEOUT_RESET_US);
 }
 
-static int ata_detect(uint16_t base, uint8_t slave) {
+/* Detecta e identifica numa passada só (um IDENTIFY por slot) */
+static int ata_identify(ata_drive_t *d, uint16_t base, uint8_t slave) {
     outb(base + ATA_DRIVE_HEAD, 0xA0 | (slave << 4));
-    for(int i=0;i<1000;i++) io_wait();
-    
+    ata_select_delay(base);
+
+    /* Slot vazio: status 0 (sem device) ou 0xFF (flutuando) */
+    uint8_t s = inb(base + ATA_STATUS);
+    if (s == 0x00 || s == 0xFF) return -1;
+
     outb(base + ATA_SECTOR_CNT, 0);
     outb(base + ATA_SECTOR_NUM, 0);
     outb(base + ATA_CYL_LOW, 0);
     outb(base + ATA_CYL_HIGH, 0);
-    
     outb(base + ATA_COMMAND, ATA_CMD_IDENTIFY);
-    
-    if(inb(base + ATA_STATUS) == 0) return 0;
-    if(ata_wait(base, ATA_STATUS_BSY, 0, 10000) < 0) return 0;
-    
-    uint8_t mid = inb(base + ATA_CYL_LOW);
-    uint8_t high = inb(base + ATA_CYL_HIGH);
-    if(mid == 0x14 && high == 0xEB) return 0;
-    
-    uint8_t s = inb(base + ATA_STATUS);
-    if(!(s & ATA_STATUS_DRQ) && !(s & ATA_STATUS_ERR)) return 0;
-    if(s & ATA_STATUS_ERR) return 0;
-    
-    return 1;
-}
+    ata_select_delay(base);
+
+    if (inb(base + ATA_STATUS) == 0) return -1;
+
+    /* ATAPI/SATA abortam o IDENTIFY e deixam assinatura em CYL_LOW/HIGH:
+     * confere antes de esperar DRQ (ERR acabaria o wait de qualquer jeito) */
+    uint64_t deadline = rdtsc() + ata_us_to_tsc(ATA_TIMEOUT_IDENTIFY_US);
+    while ((inb(base + ATA_STATUS) & ATA_STATUS_BSY) && rdtsc() < deadline) {
+        wait_poll_relax();
+    }
+    if (inb(base + ATA_CYL_LOW) != 0 || inb(base + ATA_CYL_HIGH) != 0) return -1;
+
+    if (ata_wait(base, ATA_STATUS_DRQ, ATA_STATUS_DRQ, ATA_TIMEOUT_IDENTIFY_US) < 0) return -1;
 
-static int ata_identify(uint16_t base, uint8_t slave) {
-    outb(base + ATA_DRIVE_HEAD, 0xA0 | (slave << 4));
-    if(ata_wait(base, ATA_STATUS_BSY|ATA_STATUS_RDY, ATA_STATUS_RDY, 30000)<0) return -1;
-    
-    outb(base + ATA_COMMAND, ATA_CMD_IDENTIFY);
-    if(ata_wait(base, ATA_STATUS_DRQ, ATA_STATUS_DRQ, 10000)<0) return -1;
-    
     uint16_t buf[256];
-    for(int i=0;i<256;i++) buf[i] = inw(base + ATA_DATA);
-    
+    ata_insw(base + ATA_DATA, buf, 256);
+
     for(int i=0;i<20;i++){
-        drive.model[i*2] = (buf[27+i]>>8)&0xFF;
-        drive.model[i*2+1] = buf[27+i]&0xFF;
-    }
-    drive.model[40]=0;
-    for(int i=39;i>=0&&drive.model[i]==' ';i--) drive.model[i]=0;
-    
-    if(buf[49] & 0x0200) drive.sectors = *(uint32_t*)&buf[60];
-    
-    drive.base = base;
-    drive.slave = slave;
-    drive.present = 1;
-    
+        d->model[i*2] = (buf[27+i]>>8)&0xFF;
+        d->model[i*2+1] = buf[27+i]&0xFF;
+    }
+    d->model[40]=0;
+    for(int i=39;i>=0&&d->model[i]==' ';i--) d->model[i]=0;
+
+    /* Word 83 bit 10: LBA48, capacidade em 100-103; senão 60-61 */
+    d->lba48 = (buf[83] & 0x0400) != 0;
+    if (d->lba48) {
+        d->sectors = (uint64_t)buf[100] | ((uint64_t)buf[101] << 16) |
+                     ((uint64_t)buf[102] << 32) | ((uint64_t)buf[103] << 48);
+    } else if (buf[49] & 0x0200) {
+        d->sectors = (uint32_t)buf[60] | ((uint32_t)buf[61] << 16);
+    }
+    d->dma_capable = (buf[49] & 0x0100) != 0;
+    /* Word 47: máximo de setores por DRQ em READ/WRITE MULTIPLE */
+    d->multiple = buf[47] & 0xFF;
+
+    d->base = base;
+    d->slave = slave;
+    d->present = 1;
+
     return 0;
 }
 
-/* API PÚBLICA - NOMES QUE O SEU KERNEL ESPERA */
+/* SET MULTIPLE MODE com o maior bloco (potência de 2) que o drive aceita */
+static void ata_multiple_init(ata_drive_t *d) {
+    uint16_t base = d->base;
+    uint32_t block = 1;
+
+    if (d->multiple < 2) {
+        d->multiple = 0;
+        return;
+    }
+    while (block * 2 <= d->multiple && block * 2 <= 128) block *= 2;
+
+    outb(base + ATA_DRIVE_HEAD, 0xA0 | (d->slave << 4));
+    ata_select_delay(base);
+    outb(base + ATA_SECTOR_CNT, block);
+    outb(base + ATA_COMMAND, ATA_CMD_SET_MULTIPLE);
+    if (ata_wait_drive(d, ATA_STATUS_BSY, 0, ATA_TIMEOUT_BSY_US) < 0) {
+        klog(KLOG_WARN, "[ATA] %s: SET MULTIPLE MODE %u rejected", d->model, block);
+        d->multiple = 0;
+        return;
+    }
+
+    d->multiple = block;
+}
+
+/* Varre um canal: um reset só, depois master e slave */
+static void ata_probe_channel(ata_channel_t *ch) {
+    int idx = ch == &channels[0] ? 0 : 1;
 
-void ata_pio_init(void) {
-    uint16_t bases[] = {0x1F0, 0x170};
-    
-    for(int b=0;b<2;b++){
-        for(int s=0;s<2;s++){
-            uint16_t base = bases[b];
-            ata_reset(base);
-            if(ata_detect(base, s)){
-                if(ata_identify(base, s)==0){
-                    return;
-                }
+    for (uint8_t s = 0; s < 2; s++) drives[idx * 2 + s].ch = ch;
+
+    /* Sem controladora nem drives as linhas flutuam em 1 */
+    if (inb(ch->base + ATA_STATUS) == 0xFF) return;
+
+    ata_reset(ch->base);
+
+    for (uint8_t s = 0; s < 2; s++) {
+        ata_drive_t *d = &drives[idx * 2 + s];
+        if (ata_identify(d, ch->base, s) == 0) {
+            ata_multiple_init(d);
+        }
+    }
+}
+
+static void ata_probe_work(void *arg) {
+    ata_channel_t *ch = (ata_channel_t *)arg;
+    ata_probe_channel(ch);
+    complete(&ch->probed);
+}
+
+/* Liga a interrupção do canal: nIEN=0 no device, IRQ no PIC */
+static void ata_enable_irq(ata_channel_t *ch) {
+    /* Descarta INTRQ pendente do IDENTIFY antes de desmascarar */
+    (void)inb(ch->base + ATA_STATUS);
+    outb(ch->base + ATA_DEV_CTL, 0x00);
+
+    enable_irq(2);            /* Cascata do PIC escravo */
+    enable_irq(ch->irq);
+    ch->irq_mode = 1;
+
+    klog(KLOG_INFO, "[ATA] IRQ%d enabled, transfers are interrupt-driven", ch->irq);
+}
+
+/* Polling por comando se a IRQ falhou; não tenta mais interrupções */
+static void ata_disable_irq(ata_channel_t *ch) {
+    ch->irq_mode = 0;
+    disable_irq(ch->irq);
+    outb(ch->base + ATA_DEV_CTL, ATA_CTL_nIEN);
+}
+
+/* Acha o bus master da controladora IDE PCI e prepara PRDT e bounce nos
+ * canais que têm drive com DMA */
+static void ata_dma_init(void) {
+    pci_addr_t pa;
+
+    if (pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &pa) < 0) {
+        klog(KLOG_INFO, "[ATA] No PCI IDE controller, using PIO");
+        return;
+    }
+    /* prog-if bit 7: controladora com bus master */
+    uint32_t bar4 = pci_read32(pa, PCI_BAR0 + 4 * 4);
+    if (!(pci_read8(pa, PCI_PROG_IF) & 0x80) || !(bar4 & 1)) {
+        klog(KLOG_INFO, "[ATA] IDE controller has no bus master, using PIO");
+        return;
+    }
+
+    int enabled = 0;
+    for (int c = 0; c < 2; c++) {
+        ata_channel_t *ch = &channels[c];
+        if (!drives[c * 2].dma_capable && !drives[c * 2 + 1].dma_capable) continue;
+
+        ch->prdt = pmalloc_aligned(ATA_PRDT_PAGES, ATA_PRDT_PAGES * PMM_PAGE_SIZE);
+        ch->bounce = pmalloc(ATA_DMA_BOUNCE_PAGES);
+
+        /* PRD só tem endereço de 32 bits */
+        if (!ch->prdt || !ch->bounce ||
+            pmm_virt_to_phys(ch->prdt) + ATA_PRDT_PAGES * PMM_PAGE_SIZE > 0x100000000ULL ||
+            pmm_virt_to_phys(ch->bounce) + ATA_DMA_BOUNCE_PAGES * PMM_PAGE_SIZE > 0x100000000ULL) {
+            if (ch->prdt) pfree(ch->prdt, ATA_PRDT_PAGES);
+            if (ch->bounce) pfree(ch->bounce, ATA_DMA_BOUNCE_PAGES);
+            ch->prdt = NULL;
+            ch->bounce = NULL;
+            klog(KLOG_WARN, "[ATA] No DMA-able memory below 4 GiB, using PIO");
+            return;
+        }
+
+        if (!enabled) pci_enable_bus_master(pa);
+        enabled = 1;
+        ch->bmbase = (bar4 & 0xFFFC) + (c == 1 ? 8 : 0);
+        outb(ch->bmbase + BM_CMD, 0);
+        outb(ch->bmbase + BM_STATUS, BM_STATUS_ERR | BM_STATUS_IRQ);
+
+        klog(KLOG_INFO, "[ATA] IRQ%d channel: bus-master DMA at I/O 0x%x",
+             ch->irq, ch->bmbase);
+    }
+}
+
+static void ata_queue_kick(request_queue_t *q);
+static void ata_channel_thread(void *arg);
+
+int ata_pio_init(void) {
+    uint64_t t0 = rdtsc();
+
+    /* Canais independentes: o secundário vai para um kworker enquanto o
+     * boot varre o primário (sem workqueue, queue_work roda inline) */
+    completion_init(&channels[1].probed);
+    if (queue_work(ata_probe_work, &channels[1]) < 0) {
+        ata_probe_work(&channels[1]);
+    }
+    ata_probe_channel(&channels[0]);
+    wait_for_completion(&channels[1].probed);
+
+    uint32_t probe_us = (uint32_t)((rdtsc() - t0) * 1000 / tsc_ticks_per_ms());
+
+    int found = 0;
+    for (int i = 0; i < ATA_MAX_DRIVES; i++) {
+        ata_drive_t *d = &drives[i];
+        if (!d->present) continue;
+
+        klog(KLOG_INFO, "[ATA] %s %s: %s, %u MiB, LBA%d, multiple %u",
+             i < 2 ? "primary" : "secondary", (i & 1) ? "slave" : "master",
+             d->model, (uint32_t)(d->sectors / 2048), d->lba48 ? 48 : 28,
+             d->multiple);
+        d->bdev.name = ata_drive_names[i];
+        d->bdev.sector_size = ATA_SECTOR_SIZE;
+        d->bdev.sectors = d->sectors;
+        d->bdev.priv = d;
+        /* Pedido juntado até 1 MiB (LBA48) ou o máximo de 28 bits */
+        blk_queue_init(&d->queue, d->lba48 ? 2048 : ATA_MAX_SECTORS_28,
+                       ata_queue_kick, d);
+        d->bdev.queue = &d->queue;
+
+        if (!default_drive) default_drive = d;
+        found++;
+    }
+    klog(KLOG_INFO, "[ATA] Probe: %d drive(s) in %u us", found, probe_us);
+
+    if (!found) return -1;
+
+    for (int c = 0; c < 2; c++) {
+        if (drives[c * 2].present || drives[c * 2 + 1].present) {
+            ata_enable_irq(&channels[c]);
+            /* Sem scheduler os pedidos rodam inline em ata_queue_kick */
+            if (sched_active()) {
+                channels[c].worker = thread_create(c ? "ata1" : "ata0",
+                                                   ata_channel_thread, &channels[c]);
             }
         }
     }
-    drive.present = 0;
-}
-
-int ata_pio_read(uint32_t lba, uint16_t count, void *buffer) {
-    if(!drive.present) return -1;
-    if(count==0||count>256) return -1;
-    
-    uint16_t base = drive.base;
-    
-    outb(base + ATA_DRIVE_HEAD, 0xE0 | (drive.slave<<4) | ((lba>>24)&0x0F));
-    outb(base + ATA_SECTOR_CNT, count & 0xFF);
-    outb(base + ATA_SECTOR_NUM, lba & 0xFF);
-    outb(base + ATA_CYL_LOW, (lba>>8) & 0xFF);
-    outb(base + ATA_CYL_HIGH, (lba>>16) & 0xFF);
-    
-    outb(base + ATA_COMMAND, ATA_CMD_READ_PIO);
-    
-    uint16_t *buf = (uint16_t*)buffer;
-    for(int sector=0;sector<count;sector++){
-        if(ata_wait(base, ATA_STATUS_DRQ, ATA_STATUS_DRQ, 10000)<0) return -1;
-        for(int i=0;i<256;i++) buf[i] = inw(base + ATA_DATA);
-        buf += 256;
-    }
-    
-    if(ata_wait(base, ATA_STATUS_BSY, 0, 30000)<0) return -1;
+    ata_dma_init();
+
+    for (int i = 0; i < ATA_MAX_DRIVES; i++) {
+        if (drives[i].present) blockdev_add_disk(&drives[i].bdev);
+    }
+    return 0;
+}
+
+/* ===================== CAMINHO POR INTERRUPÇÃO ===================== */
+
+/* Move 'n' setores entre a porta de dados e os segmentos do cursor */
+static void ata_pio_move(uint16_t base, blk_cursor_t *cur, uint32_t n, int write) {
+    while (n) {
+        uint32_t k;
+        void *p = blk_cursor_next(cur, n, &k);
+        if (write) ata_outsw(base + ATA_DATA, p, k * 256);
+        else ata_insw(base + ATA_DATA, p, k * 256);
+        n -= k;
+    }
+}
+
+/* Encerra o comando em curso; lock do canal preso */
+static void ata_irq_finish(ata_channel_t *ch, int status) {
+    ch->status = status;
+    ch->active = 0;
+    complete(&ch->done);
+}
+
+/* Chamado pelos stubs de IRQ14/IRQ15 (idx = canal). O EOI fica no stub. */
+void ata_irq_handler(int idx) {
+    ata_channel_t *ch = &channels[idx];
+    uint64_t t0 = rdtsc();
+
+    spinlock_lock(&ch->lock);
+
+    /* Ler STATUS reconhece o INTRQ do device */
+    uint8_t s = inb(ch->base + ATA_STATUS);
+
+    if (!ch->active) {
+        ch->spurious++;
+        spinlock_unlock(&ch->lock);
+        return;
+    }
+    ch->irqs++;
+
+    if (ch->dma) {
+        /* DMA: uma IRQ só, no fim; o bit IRQ do bus master diz se é nossa */
+        uint8_t bms = inb(ch->bmbase + BM_STATUS);
+        if (!(bms & BM_STATUS_IRQ)) {
+            ch->spurious++;
+        } else {
+            outb(ch->bmbase + BM_CMD, 0);
+            outb(ch->bmbase + BM_STATUS, BM_STATUS_ERR | BM_STATUS_IRQ);
+            if (bms & BM_STATUS_ERR) ata_irq_finish(ch, -2);
+            else if (s & (ATA_STATUS_ERR | ATA_STATUS_DF)) ata_irq_finish(ch, -1);
+            else ata_irq_finish(ch, 0);
+        }
+    } else if (s & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+        ata_irq_finish(ch, -1);
+    } else if (s & ATA_STATUS_BSY) {
+        /* Ainda ocupado: outra IRQ vem */
+    } else if (!ch->write) {
+        /* Leitura: uma IRQ por bloco pronto na porta de dados */
+        if (!(s & ATA_STATUS_DRQ)) {
+            ata_irq_finish(ch, -1);
+        } else {
+            uint32_t n = ch->remaining < ch->block ? ch->remaining : ch->block;
+            ata_pio_move(ch->base, ch->cur, n, 0);
+            ch->remaining -= n;
+            if (ch->remaining == 0) ata_irq_finish(ch, 0);
+        }
+    } else {
+        /* Escrita: uma IRQ por bloco gravado; manda o próximo se houver */
+        if (ch->remaining == 0) {
+            ata_irq_finish(ch, 0);
+        } else if (s & ATA_STATUS_DRQ) {
+            uint32_t n = ch->remaining < ch->block ? ch->remaining : ch->block;
+            ata_pio_move(ch->base, ch->cur, n, 1);
+            ch->remaining -= n;
+        } else {
+            ata_irq_finish(ch, -1);
+        }
+    }
+
+    ch->irq_cycles += rdtsc() - t0;
+    spinlock_unlock(&ch->lock);
+}
+
+/* Comando de 48 bits só quando precisa: os de 28 custam menos outb */
+static int ata_need_ext(uint64_t lba, uint32_t count) {
+    return lba + count > ATA_LBA28_LIMIT || count > ATA_MAX_SECTORS_28;
+}
+
+/* Opcodes por [48 bits][ATA_XFER_*][escrita] */
+static const uint8_t ata_rw_opcodes[2][3][2] = {
+    { { ATA_CMD_READ_PIO, ATA_CMD_WRITE_PIO },
+      { ATA_CMD_READ_MULTIPLE, ATA_CMD_WRITE_MULTIPLE },
+      { ATA_CMD_READ_DMA, ATA_CMD_WRITE_DMA } },
+    { { ATA_CMD_READ_PIO_EXT, ATA_CMD_WRITE_PIO_EXT },
+      { ATA_CMD_READ_MULTIPLE_EXT, ATA_CMD_WRITE_MULTIPLE_EXT },
+      { ATA_CMD_READ_DMA_EXT, ATA_CMD_WRITE_DMA_EXT } },
+};
+
+/* Programa LBA/contagem e emite READ/WRITE (PIO, MULTIPLE ou DMA).
+ * Contagem 0 no registrador vale o máximo (256 ou 65536). No LBA48 cada
+ * registrador é um FIFO de 2 bytes: escreve a metade alta primeiro. */
+static void ata_issue_rw(ata_drive_t *d, uint64_t lba, uint32_t count, int xfer, int write) {
+    uint16_t base = d->base;
+    int ext = ata_need_ext(lba, count);
+
+    if (ext) {
+        outb(base + ATA_DRIVE_HEAD, 0x40 | (d->slave<<4));
+        outb(base + ATA_SECTOR_CNT, (count>>8) & 0xFF);
+        outb(base + ATA_SECTOR_NUM, (lba>>24) & 0xFF);
+        outb(base + ATA_CYL_LOW, (lba>>32) & 0xFF);
+        outb(base + ATA_CYL_HIGH, (lba>>40) & 0xFF);
+        outb(base + ATA_SECTOR_CNT, count & 0xFF);
+        outb(base + ATA_SECTOR_NUM, lba & 0xFF);
+        outb(base + ATA_CYL_LOW, (lba>>8) & 0xFF);
+        outb(base + ATA_CYL_HIGH, (lba>>16) & 0xFF);
+    } else {
+        outb(base + ATA_DRIVE_HEAD, 0xE0 | (d->slave<<4) | ((lba>>24)&0x0F));
+        outb(base + ATA_SECTOR_CNT, count & 0xFF);
+        outb(base + ATA_SECTOR_NUM, lba & 0xFF);
+        outb(base + ATA_CYL_LOW, (lba>>8) & 0xFF);
+        outb(base + ATA_CYL_HIGH, (lba>>16) & 0xFF);
+    }
+
+    outb(base + ATA_COMMAND, ata_rw_opcodes[ext][xfer][write ? 1 : 0]);
+}
+
+/* Setores por DRQ e tipo de comando do PIO atual */
+static uint32_t ata_pio_block(ata_drive_t *d) {
+    return (ata_allow_multi && d->multiple) ? d->multiple : 1;
+}
+
+static int ata_pio_xfer(ata_drive_t *d) {
+    return (ata_allow_multi && d->multiple) ? ATA_XFER_MULTI : ATA_XFER_PIO;
+}
+
+/* IRQ só quando quem chama pode dormir (scheduler ativo, IF=1) */
+static int ata_use_irq(ata_channel_t *ch) {
+    return ata_allow_irq && ch->irq_mode && can_block();
+}
+
+static int ata_use_dma(ata_drive_t *d) {
+    return ata_allow_dma && d->ch->bmbase && d->dma_capable;
+}
+
+/* Emite o comando e dorme até o handler terminar os 'count' setores */
+static int ata_irq_transfer(ata_drive_t *d, uint64_t lba, uint32_t count, blk_cursor_t *cur, int write) {
+    ata_channel_t *ch = d->ch;
+    uint16_t base = ch->base;
+    uint64_t t0 = rdtsc();
+
+    completion_reinit(&ch->done);
+
+    uint64_t flags = spinlock_lock_irqsave(&ch->lock);
+    ch->dma = 0;
+    ch->write = write;
+    ch->cur = cur;
+    ch->remaining = count;
+    ch->block = ata_pio_block(d);
+    ch->status = 0;
+    ch->active = 1;
+
+    ata_issue_rw(d, lba, count, ata_pio_xfer(d), write);
+
+    if (write) {
+        /* O primeiro bloco de PIO-out não gera IRQ: vai já, os outros o
+         * handler manda a cada IRQ de bloco gravado */
+        if (ata_wait_drive(d, ATA_STATUS_DRQ, ATA_STATUS_DRQ, ATA_TIMEOUT_DRQ_US) < 0) {
+            ch->active = 0;
+            spinlock_unlock_irqrestore(&ch->lock, flags);
+            return -1;
+        }
+        uint32_t n = count < ch->block ? count : ch->block;
+        ata_pio_move(base, cur, n, 1);
+        ch->remaining -= n;
+    }
+    spinlock_unlock_irqrestore(&ch->lock, flags);
+    ch->busy_cycles += rdtsc() - t0;
+
+    if (!wait_for_completion_timeout(&ch->done, ATA_IRQ_TIMEOUT_MS)) {
+        flags = spinlock_lock_irqsave(&ch->lock);
+        int lost = ch->active;
+        ch->active = 0;
+        spinlock_unlock_irqrestore(&ch->lock, flags);
+
+        if (lost) {
+            klog(KLOG_WARN, "[ATA] IRQ%d timeout, falling back to polling", ch->irq);
+            blockdev_account_timeout(&d->bdev);
+            ata_disable_irq(ch);
+            return -1;
+        }
+    }
+    return ch->status;
+}
+
+/* ===================== BUS MASTER DMA ===================== */
+
+/* O identity map cobre os 4 GiB baixos: ali virtual == físico e contíguo,
+ * então o DMA vai direto no buffer. Fora dele (stack/estáticos do kernel
+ * no higher half) passa pelo bounce buffer. */
+static int ata_dma_direct_ok(const void *buf, uint32_t bytes) {
+    uint64_t v = (uint64_t)buf;
+    return !(v & 1) && v + bytes <= 0x100000000ULL;
+}
+
+/* 1 se todos os trechos dos próximos 'count' setores servem para DMA direto */
+static int ata_dma_direct_cursor(blk_cursor_t cur, uint32_t count) {
+    while (count) {
+        uint32_t k;
+        void *p = blk_cursor_next(&cur, count, &k);
+        if (!ata_dma_direct_ok(p, k * 512)) return 0;
+        count -= k;
+    }
+    return 1;
+}
+
+/* Acrescenta [phys, phys+bytes) à PRDT a partir da entrada 'n' sem cruzar
+ * fronteiras de 64 KiB; devolve o novo total ou -1 se não coube */
+static int ata_prdt_add(ata_channel_t *ch, int n, uint64_t phys, uint32_t bytes) {
+    while (bytes) {
+        if (n >= ATA_PRDT_ENTRIES) return -1;
+        uint32_t room = 0x10000 - (uint32_t)(phys & 0xFFFF);
+        uint32_t len = bytes < room ? bytes : room;
+        ch->prdt[n].addr = (uint32_t)phys;
+        ch->prdt[n].bytes = (uint16_t)len;
+        ch->prdt[n].flags = 0;
+        phys += len;
+        bytes -= len;
+        n++;
+    }
+    return n;
+}
+
+/* PRDT com um trecho por segmento do cursor (que avança) ou com o bounce */
+static int ata_build_prdt(ata_channel_t *ch, blk_cursor_t *cur, uint32_t count, int direct) {
+    int n = 0;
+    if (!direct) {
+        n = ata_prdt_add(ch, 0, pmm_virt_to_phys(ch->bounce), count * 512);
+    } else {
+        while (count && n >= 0) {
+            uint32_t k;
+            void *p = blk_cursor_next(cur, count, &k);
+            n = ata_prdt_add(ch, n, pmm_virt_to_phys(p), k * 512);
+            count -= k;
+        }
+    }
+    if (n <= 0) return -1;
+    ch->prdt[n - 1].flags = PRD_EOT;
     return 0;
 }
 
-int ata_pio_write(uint32_t lba, uint16_t count, void *buffer) {
-    if(!drive.present) return -1;
-    if(count==0||count>256) return -1;
-    
-    uint16_t base = drive.base;
-    
-    outb(base + ATA_DRIVE_HEAD, 0xE0 | (drive.slave<<4) | ((lba>>24)&0x0F));
-    outb(base + ATA_SECTOR_CNT, count & 0xFF);
-    outb(base + ATA_SECTOR_NUM, lba & 0xFF);
-    outb(base + ATA_CYL_LOW, (lba>>8) & 0xFF);
-    outb(base + ATA_CYL_HIGH, (lba>>16) & 0xFF);
-    
-    outb(base + ATA_COMMAND, ATA_CMD_WRITE_PIO);
-    
-    uint16_t *buf = (uint16_t*)buffer;
-    for(int sector=0;sector<count;sector++){
-        if(ata_wait(base, ATA_STATUS_DRQ, ATA_STATUS_DRQ, 10000)<0) return -1;
-        for(int i=0;i<256;i++) outw(base + ATA_DATA, buf[i]);
-        buf += 256;
-        if(ata_wait(base, ATA_STATUS_BSY, 0, 10000)<0) return -1;
-    }
-    
+/* Copia entre o bounce buffer e os segmentos do cursor (que avança) */
+static void ata_bounce_copy(ata_channel_t *ch, blk_cursor_t *cur, uint32_t count, int to_bounce) {
+    uint8_t *b = ch->bounce;
+    while (count) {
+        uint32_t k;
+        void *p = blk_cursor_next(cur, count, &k);
+        if (to_bounce) memcpy(b, p, k * 512);
+        else memcpy(p, b, k * 512);
+        b += k * 512;
+        count -= k;
+    }
+}
+
+/* Polling do fim do DMA (sem IRQ); mesma semântica de status do handler */
+static int ata_dma_poll(ata_drive_t *d) {
+    ata_channel_t *ch = d->ch;
+    uint64_t deadline = rdtsc() + ata_us_to_tsc(ATA_IRQ_TIMEOUT_MS * 1000);
+    while (rdtsc() < deadline) {
+        uint8_t bms = inb(ch->bmbase + BM_STATUS);
+        if (bms & (BM_STATUS_IRQ | BM_STATUS_ERR)) {
+            outb(ch->bmbase + BM_CMD, 0);
+            uint8_t s = inb(ch->base + ATA_STATUS);
+            outb(ch->bmbase + BM_STATUS, BM_STATUS_ERR | BM_STATUS_IRQ);
+            if (bms & BM_STATUS_ERR) return -2;
+            return (s & (ATA_STATUS_ERR | ATA_STATUS_DF)) ? -1 : 0;
+        }
+        wait_poll_relax();
+    }
+    outb(ch->bmbase + BM_CMD, 0);
+    blockdev_account_timeout(&d->bdev);
+    return -2;
+}
+
+/* -1: erro do device; -2: problema do DMA (quem chama cai para PIO) */
+static int ata_dma_transfer(ata_drive_t *d, uint64_t lba, uint32_t count, blk_cursor_t *cur, int write) {
+    ata_channel_t *ch = d->ch;
+    uint64_t t0 = rdtsc();
+
+    /* Fora do identity map: via bounce (ata_transfer_locked limita a
+     * ATA_DMA_BOUNCE_SECTORS) */
+    int direct = ata_dma_direct_cursor(*cur, count);
+    if (!direct && write) ata_bounce_copy(ch, cur, count, 1);
+
+    if (ata_build_prdt(ch, cur, count, direct) < 0) return -2;
+    outb(ch->bmbase + BM_CMD, 0);
+    outb(ch->bmbase + BM_STATUS, BM_STATUS_ERR | BM_STATUS_IRQ);
+    ata_outl(ch->bmbase + BM_PRDT, (uint32_t)pmm_virt_to_phys(ch->prdt));
+
+    int irq = ata_use_irq(ch);
+    uint64_t flags = 0;
+    if (irq) {
+        completion_reinit(&ch->done);
+        flags = spinlock_lock_irqsave(&ch->lock);
+        ch->dma = 1;
+        ch->status = 0;
+        ch->active = 1;
+    }
+
+    ata_issue_rw(d, lba, count, ATA_XFER_DMA, write);
+    outb(ch->bmbase + BM_CMD, BM_CMD_START | (write ? 0 : BM_CMD_READ));
+
+    int ret;
+    if (irq) {
+        spinlock_unlock_irqrestore(&ch->lock, flags);
+        ch->busy_cycles += rdtsc() - t0;
+
+        if (wait_for_completion_timeout(&ch->done, ATA_IRQ_TIMEOUT_MS)) {
+            ret = ch->status;
+        } else {
+            flags = spinlock_lock_irqsave(&ch->lock);
+            ret = ch->active ? -2 : ch->status;
+            if (ch->active) blockdev_account_timeout(&d->bdev);
+            ch->active = 0;
+            spinlock_unlock_irqrestore(&ch->lock, flags);
+            if (ret == -2) outb(ch->bmbase + BM_CMD, 0);
+        }
+        t0 = rdtsc();
+    } else {
+        ret = ata_dma_poll(d);
+    }
+
+    if (ret == 0 && !direct && !write) ata_bounce_copy(ch, cur, count, 0);
+    ch->busy_cycles += rdtsc() - t0;
+    return ret;
+}
+
+/* ===================== CAMINHO POR POLLING ===================== */
+
+static int ata_pio_read_locked(ata_drive_t *d, uint64_t lba, uint32_t count, blk_cursor_t *cur) {
+    uint16_t base = d->base;
+
+    uint32_t block = ata_pio_block(d);
+    ata_issue_rw(d, lba, count, ata_pio_xfer(d), 0);
+
+    for(uint32_t done=0;done<count;){
+        uint32_t n = count - done < block ? count - done : block;
+        if(ata_wait_drive(d, ATA_STATUS_DRQ, ATA_STATUS_DRQ, ATA_TIMEOUT_DRQ_US)<0) return -1;
+        ata_pio_move(base, cur, n, 0);
+        done += n;
+    }
+
+    if(ata_wait_drive(d, ATA_STATUS_BSY, 0, ATA_TIMEOUT_BSY_US)<0) return -1;
     return 0;
 }
 
-int ata_pio_flush(void) {
-    if(!drive.present) return -1;
-    
-    uint16_t base = drive.base;
-    outb(base + ATA_COMMAND, ATA_CMD_FLUSH_CACHE);
-    if(ata_wait(base, ATA_STATUS_BSY, 0, 30000)<0) return -1;
+static int ata_pio_write_locked(ata_drive_t *d, uint64_t lba, uint32_t count, blk_cursor_t *cur) {
+    uint16_t base = d->base;
+
+    uint32_t block = ata_pio_block(d);
+    ata_issue_rw(d, lba, count, ata_pio_xfer(d), 1);
+
+    for(uint32_t done=0;done<count;){
+        uint32_t n = count - done < block ? count - done : block;
+        if(ata_wait_drive(d, ATA_STATUS_DRQ, ATA_STATUS_DRQ, ATA_TIMEOUT_DRQ_US)<0) return -1;
+        ata_pio_move(base, cur, n, 1);
+        done += n;
+        if(ata_wait_drive(d, ATA_STATUS_BSY, 0, ATA_TIMEOUT_BSY_US)<0) return -1;
+    }
+
     return 0;
 }
 
+/* Um comando: DMA se disponível, senão PIO por IRQ ou polling */
+static int ata_command_locked(ata_drive_t *d, uint64_t lba, uint32_t count, blk_cursor_t *cur, int write) {
+    ata_channel_t *ch = d->ch;
+
+    if (ata_use_dma(d)) {
+        blk_cursor_t save = *cur;
+        int ret = ata_dma_transfer(d, lba, count, cur, write);
+        if (ret != -2) return ret;
+
+        klog(KLOG_WARN, "[ATA] DMA error, falling back to PIO");
+        d->dma_capable = 0;
+        ata_reset(d->base);
+        *cur = save;
+    }
+
+    if (ata_use_irq(ch)) return ata_irq_transfer(d, lba, count, cur, write);
+
+    uint64_t t0 = rdtsc();
+    int ret = write ? ata_pio_write_locked(d, lba, count, cur)
+                    : ata_pio_read_locked(d, lba, count, cur);
+    ch->busy_cycles += rdtsc() - t0;
+    return ret;
+}
+
+/* Quebra o pedido no maior comando que o drive aceita; io_lock preso */
+static int ata_transfer_locked(ata_drive_t *d, uint64_t lba, uint32_t count, blk_cursor_t *cur, int write) {
+    uint32_t max = d->lba48 ? ATA_MAX_SECTORS_48 : ATA_MAX_SECTORS_28;
+
+    while (count) {
+        uint32_t n = count < max ? count : max;
+        if (ata_use_dma(d) && n > ATA_DMA_BOUNCE_SECTORS &&
+            !ata_dma_direct_cursor(*cur, n)) {
+            n = ATA_DMA_BOUNCE_SECTORS;
+        }
+
+        int ret = ata_command_locked(d, lba, n, cur, write);
+        if (ret < 0) return ret;
+
+        lba += n;
+        count -= n;
+    }
+    return 0;
+}
+
+/* Valida o intervalo contra a capacidade e o modo de endereçamento */
+static int ata_range_ok(ata_drive_t *d, uint64_t lba, uint32_t count) {
+    if (count == 0 || count > ATA_MAX_SECTORS_48) return 0;
+    if (d->sectors && lba + count > d->sectors) return 0;
+    if (!d->lba48 && lba + count > ATA_LBA28_LIMIT) return 0;
+    return 1;
+}
+
+static int ata_rw(ata_drive_t *d, uint64_t lba, uint32_t count, void *buffer, int write) {
+    if(!d || !d->present) return -1;
+    if(!ata_range_ok(d, lba, count)) return -1;
+
+    /* Buffer plano: um bio de um segmento só para o cursor */
+    bio_t bio;
+    blk_cursor_t cur;
+    bio_init(&bio, write ? BIO_WRITE : BIO_READ, lba, NULL, NULL);
+    bio_add_seg(&bio, buffer, count);
+    blk_cursor_init(&cur, &bio);
+
+    mutex_lock(&d->ch->io_lock);
+    int ret = ata_transfer_locked(d, lba, count, &cur, write);
+    mutex_unlock(&d->ch->io_lock);
+    return ret;
+}
+
+/* API PÚBLICA - NOMES QUE O SEU KERNEL ESPERA */
+
+int ata_pio_read_ext(uint64_t lba, uint32_t count, void *buffer) {
+    return ata_rw(default_drive, lba, count, buffer, 0);
+}
+
+int ata_pio_write_ext(uint64_t lba, uint32_t count, const void *buffer) {
+    return ata_rw(default_drive, lba, count, (void*)buffer, 1);
+}
+
+int ata_pio_read(uint32_t lba, uint32_t count, void *buffer) {
+    return ata_pio_read_ext(lba, count, buffer);
+}
+
+int ata_pio_write(uint32_t lba, uint32_t count, const void *buffer) {
+    return ata_pio_write_ext(lba, count, buffer);
+}
+
+static int ata_flush_drive(ata_drive_t *d) {
+    if(!d || !d->present) return -1;
+
+    mutex_lock(&d->ch->io_lock);
+    uint16_t base = d->base;
+    outb(base + ATA_DRIVE_HEAD, 0xA0 | (d->slave<<4));
+    outb(base + ATA_COMMAND, d->lba48 ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE);
+    int ret = ata_wait_drive(d, ATA_STATUS_BSY, 0, ATA_TIMEOUT_FLUSH_US);
+    mutex_unlock(&d->ch->io_lock);
+    return ret < 0 ? -1 : 0;
+}
+
+int ata_pio_flush(void) {
+    return ata_flush_drive(default_drive);
+}
+
 /* Funções auxiliares extras */
 
 int ata_pio_get_sectors(void) {
-    return drive.present ? drive.sectors : 0;
+    if (!default_drive) return 0;
+    uint64_t n = default_drive->sectors;
+    return n > 0x7FFFFFFF ? 0x7FFFFFFF : (int)n;
+}
+
+uint64_t ata_pio_get_capacity(void) {
+    return default_drive ? default_drive->sectors : 0;
 }
 
 const char *ata_pio_get_model(void) {
-    return drive.present ? drive.model : "No drive";
+    return default_drive ? default_drive->model : "No drive";
 }
 
 int ata_pio_present(void) {
-    return drive.present;
+    return default_drive != NULL;
+}
+
+int ata_pio_drive_present(int idx) {
+    return idx >= 0 && idx < ATA_MAX_DRIVES && drives[idx].present;
+}
+
+blockdev_t *ata_pio_blockdev(int idx) {
+    return ata_pio_drive_present(idx) ? &drives[idx].bdev : NULL;
+}
+
+blockdev_t *ata_pio_get_blockdev(void) {
+    return default_drive ? &default_drive->bdev : NULL;
+}
+
+/* ===================== BACKEND DA CAMADA DE BLOCOS ===================== */
+
+/* Executa um pedido (bios juntados) como um comando; io_lock preso do
+ * primeiro ao último setor */
+static int ata_request_exec(ata_drive_t *d, request_t *rq) {
+    if (rq->op == BIO_FLUSH) return ata_flush_drive(d);
+    if (!ata_range_ok(d, rq->lba, rq->sectors)) return -1;
+
+    blk_cursor_t cur;
+    blk_cursor_init(&cur, rq->bio_head);
+
+    mutex_lock(&d->ch->io_lock);
+    int ret = ata_transfer_locked(d, rq->lba, rq->sectors, &cur, rq->op == BIO_WRITE);
+    mutex_unlock(&d->ch->io_lock);
+    return ret < 0 ? -1 : 0;
+}
+
+static int ata_channel_pending(ata_channel_t *ch) {
+    int c = ch == &channels[0] ? 0 : 1;
+    for (int s = 0; s < 2; s++) {
+        ata_drive_t *d = &drives[c * 2 + s];
+        if (d->present && blk_queue_pending(&d->queue)) return 1;
+    }
+    return 0;
+}
+
+/* Thread do canal: um pedido de cada drive por volta (master, slave) */
+static void ata_channel_thread(void *arg) {
+    ata_channel_t *ch = (ata_channel_t *)arg;
+    int c = ch == &channels[0] ? 0 : 1;
+
+    for (;;) {
+        wait_event(&ch->bio_wq, ata_channel_pending(ch));
+
+        for (int s = 0; s < 2; s++) {
+            ata_drive_t *d = &drives[c * 2 + s];
+            if (!d->present) continue;
+            request_t *rq = blk_fetch_request(&d->queue);
+            if (rq) blk_end_request(&d->queue, rq, ata_request_exec(d, rq));
+        }
+    }
+}
+
+/* Há pedidos na fila do drive (chamado pela blkqueue) */
+static void ata_queue_kick(request_queue_t *q) {
+    ata_drive_t *d = (ata_drive_t *)q->driver_data;
+    ata_channel_t *ch = d->ch;
+
+    if (ch->worker && can_block()) {
+        wake_up_one(&ch->bio_wq);
+        return;
+    }
+
+    /* Boot (sem thread do canal) ou quem não pode dormir: despacha já */
+    request_t *rq;
+    while ((rq = blk_fetch_request(q)) != NULL) {
+        blk_end_request(q, rq, ata_request_exec(d, rq));
+    }
+}
+
+/* ===================== BENCHMARK ===================== */
+
+/* Uma passada de leitura sequencial; devolve ms e ciclos ocupados */
+static int ata_bench_pass(uint32_t sectors, void *buf, uint32_t chunk,
+                          uint64_t *ms, uint64_t *busy, uint64_t *total) {
+    ata_channel_t *ch = default_drive->ch;
+    uint64_t busy0 = ch->busy_cycles, irq0 = ch->irq_cycles;
+    uint64_t tick0 = sched_ticks(), tsc0 = rdtsc();
+
+    for (uint32_t lba = 0; lba < sectors; lba += chunk) {
+        uint32_t n = sectors - lba < chunk ? sectors - lba : chunk;
+        if (ata_pio_read(lba, n, buf) < 0) return -1;
+    }
+
+    *total = rdtsc() - tsc0;
+    *ms = (sched_ticks() - tick0) * 1000 / SCHED_HZ;
+    *busy = (ch->busy_cycles - busy0) + (ch->irq_cycles - irq0);
+    return 0;
+}
+
+/* Modos do benchmark: PIO setor a setor, PIO MULTIPLE, IRQ e DMA */
+static const struct {
+    const char *name;
+    int irq, multi, dma;
+} ata_bench_modes[] = {
+    { "poll      ", 0, 0, 0 },
+    { "poll-multi", 0, 1, 0 },
+    { "irq       ", 1, 0, 0 },
+    { "irq-multi ", 1, 1, 0 },
+    { "dma       ", 1, 0, 1 },
+};
+
+/* Compara os modos de transferência lendo 'sectors' setores a partir do
+ * LBA 0. "CPU busy" é a fração do tempo em que o CPU ficou preso no I/O
+ * (o resto fica livre para outras threads); cyc/sector é o custo por setor. */
+void ata_pio_benchmark(uint32_t sectors) {
+    ata_drive_t *d = default_drive;
+    if (!d || !can_block()) return;
+
+    /* Com LBA48, 1 MiB por comando; senão o máximo de 28 bits */
+    const uint32_t chunk = d->lba48 ? 2048 : ATA_MAX_SECTORS_28;
+    const size_t pages = chunk * 512 / PMM_PAGE_SIZE;
+    if (d->sectors && sectors > d->sectors) sectors = (uint32_t)d->sectors;
+    void *buf = pmalloc(pages);
+    if (!buf) return;
+
+    int has_irq = d->ch->irq_mode, has_dma = ata_use_dma(d), has_multi = d->multiple != 0;
+    for (size_t m = 0; m < sizeof(ata_bench_modes) / sizeof(ata_bench_modes[0]); m++) {
+        if ((ata_bench_modes[m].irq && !has_irq) ||
+            (ata_bench_modes[m].dma && !has_dma) ||
+            (ata_bench_modes[m].multi && !has_multi)) continue;
+        ata_allow_irq = ata_bench_modes[m].irq;
+        ata_allow_dma = ata_bench_modes[m].dma;
+        ata_allow_multi = ata_bench_modes[m].multi;
+
+        uint64_t ms, busy, total;
+        if (ata_bench_pass(sectors, buf, chunk, &ms, &busy, &total) < 0) {
+            klog(KLOG_ERROR, "[ATA] bench: read failed");
+            break;
+        }
+
+        uint32_t kib = sectors / 2;
+        klog(KLOG_INFO, "[ATA] bench %s x%u: %u KiB in %u ms (%u KiB/s), CPU busy %u%%, %u cyc/sector",
+             ata_bench_modes[m].name, chunk, kib, (uint32_t)ms,
+             ms ? (uint32_t)(kib * 1000 / ms) : 0,
+             total ? (uint32_t)(busy * 100 / total) : 0,
+             (uint32_t)(busy / sectors));
+    }
+    ata_allow_irq = 1;
+    ata_allow_dma = 1;
+    ata_allow_multi = 1;
+
+    pfree(buf, pages);
 }
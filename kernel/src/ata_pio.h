@@ -2,6 +2,7 @@
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#include "blockdev.h"
 
 /* Registradores ATA PIO (Primary Master) */
 #define ATA_DATA_PORT       0x1F0
@@ -40,25 +41,77 @@
 
 #define ATA_SECTOR_SIZE     512
 
-/* Inicializa driver ATA PIO */
+/* Dois canais (primário/secundário) x master/slave */
+#define ATA_MAX_DRIVES      4
+
+/* Inicializa driver ATA PIO: varre os dois canais e loga cada drive.
+ * As funções sem índice operam no primeiro drive encontrado. */
 int ata_pio_init(void);
 
+/* 1 se há drive ATA no índice (canal * 2 + slave) */
+int ata_pio_drive_present(int idx);
+
+/* Drive como dispositivo de bloco ("ata0".."ata3"); NULL se ausente.
+ * ata_pio_get_blockdev() devolve o do primeiro drive encontrado. */
+blockdev_t *ata_pio_blockdev(int idx);
+blockdev_t *ata_pio_get_blockdev(void);
+
 /* Lê setores */
 int ata_pio_read(uint32_t lba, uint32_t count, void *buf);
 
 /* Escreve setores */
 int ata_pio_write(uint32_t lba, uint32_t count, const void *buf);
 
+/* Versões de 64 bits: LBA48 quando o drive suporta, até 65536 setores */
+int ata_pio_read_ext(uint64_t lba, uint32_t count, void *buf);
+int ata_pio_write_ext(uint64_t lba, uint32_t count, const void *buf);
+
+/* Capacidade em setores (IDENTIFY 100-103 com LBA48, senão 60-61) */
+uint64_t ata_pio_get_capacity(void);
+
 /* Flush cache */
 int ata_pio_flush(void);
 
-// Funções de E/S privadas (não exportadas globalmente, mas usadas internamente)
-static inline void ata_outb(uint16_t port, uint8_t val);
-static inline void ata_outw(uint16_t port, uint16_t val);
-static inline void ata_outl(uint16_t port, uint32_t val);
-static inline uint8_t ata_inb(uint16_t port);
-static inline uint16_t ata_inw(uint16_t port);
-static inline uint32_t ata_inl(uint16_t port);
-static inline void ata_outsw(uint16_t port, const void* data, size_t count);
-static inline void ata_insw(uint16_t port, void* data, size_t count);
-static inline void io_wait(void);
+/* Leitura sequencial do início do disco em cada modo (PIO simples e
+ * MULTIPLE, por polling e por IRQ, e DMA); loga throughput, fração de CPU
+ * ocupada e ciclos por setor */
+void ata_pio_benchmark(uint32_t sectors);
+
+/* E/S nas portas do canal (rep insw/outsw: 'count' em words) */
+static inline void ata_outb(uint16_t port, uint8_t val) {
+    asm volatile("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline void ata_outw(uint16_t port, uint16_t val) {
+    asm volatile("outw %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline void ata_outl(uint16_t port, uint32_t val) {
+    asm volatile("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint8_t ata_inb(uint16_t port) {
+    uint8_t ret;
+    asm volatile("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline uint16_t ata_inw(uint16_t port) {
+    uint16_t ret;
+    asm volatile("inw %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline uint32_t ata_inl(uint16_t port) {
+    uint32_t ret;
+    asm volatile("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void ata_outsw(uint16_t port, const void* data, size_t count) {
+    asm volatile("rep outsw" : "+S"(data), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void ata_insw(uint16_t port, void* data, size_t count) {
+    asm volatile("rep insw" : "+D"(data), "+c"(count) : "d"(port) : "memory");
+}
@@ -0,0 +1,570 @@
+// bcache.c - Cache de blocos: hash (dev, LBA), refcount, CLOCK e write-back
+#include "bcache.h"
+#include "pmm.h"
+#include "spinlock.h"
+#include "string.h"
+#include "kmalloc.h"
+#include "sched.h"
+#include "blktrace.h"
+
+extern void klog(int level, const char *fmt, ...);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+#define BUFS_PER_PAGE (PMM_PAGE_SIZE / BCACHE_BLOCK_SIZE)
+
+static struct {
+    spinlock_t lock;              /* Hash, refcounts, CLOCK */
+    buf_t *bufs;                  /* Cabeçalhos (max_buffers) */
+    uint32_t nbufs;               /* Quantos já têm memória de dados */
+    uint32_t max_buffers;
+    uint32_t hand;                /* Ponteiro do CLOCK */
+    buf_t *hash[BCACHE_HASH_SIZE];
+    wait_queue_t io_wq;           /* Quem espera B_IO/B_WB de outro */
+    uint32_t ndirty;
+    buf_t **wb_list;              /* Sujos a gravar (max_buffers), sob wb_lock */
+    mutex_t wb_lock;              /* Um write-back por vez */
+    int pressure;                 /* bflush deve gravar tudo */
+    completion_t flush_kick;
+    thread_t *flusher;
+    bcache_stats_t stats;
+} bc = { .lock = SPINLOCK_INIT, .io_wq = WAIT_QUEUE_INIT, .wb_lock = MUTEX_INIT,
+         .flush_kick = { 0, WAIT_QUEUE_INIT } };
+
+static void bcache_flusher(void *arg);
+
+static inline uint32_t bcache_hash(blockdev_t *dev, uint64_t lba) {
+    uint64_t h = lba * 0x9E3779B97F4A7C15ULL ^ (uint64_t)dev;
+    return (uint32_t)(h >> 32) & (BCACHE_HASH_SIZE - 1);
+}
+
+int bcache_init(uint32_t pages) {
+    if (bc.bufs) return 0;
+    if (!pages) pages = BCACHE_PAGES;
+
+    uint32_t max = pages * BUFS_PER_PAGE;
+    size_t hdr_pages = (max * sizeof(buf_t) + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE;
+    size_t list_pages = (max * sizeof(buf_t *) + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE;
+    buf_t *bufs = pmalloc(hdr_pages);
+    buf_t **list = pmalloc(list_pages);
+    if (!bufs || !list) return -1;
+    memset(bufs, 0, hdr_pages * PMM_PAGE_SIZE);
+    for (uint32_t i = 0; i < max; i++) mutex_init(&bufs[i].lock);
+
+    bc.max_buffers = max;
+    bc.stats.max_buffers = max;
+    bc.wb_list = list;
+    bc.bufs = bufs;
+
+    /* Sem scheduler o write-back só acontece em sync e sob pressão */
+    if (sched_active()) bc.flusher = thread_create("bflush", bcache_flusher, NULL);
+
+    klog(KLOG_INFO, "[BCACHE] %u KiB budget (%u buffers)",
+         pages * PMM_PAGE_SIZE / 1024, max);
+    return 0;
+}
+
+/* ===================== HASH ===================== */
+
+static buf_t *bcache_lookup(blockdev_t *dev, uint64_t lba) {
+    for (buf_t *b = bc.hash[bcache_hash(dev, lba)]; b; b = b->hash_next) {
+        if (b->dev == dev && b->lba == lba) return b;
+    }
+    return NULL;
+}
+
+static void bcache_unhash(buf_t *b) {
+    buf_t **pp = &bc.hash[bcache_hash(b->dev, b->lba)];
+    while (*pp && *pp != b) pp = &(*pp)->hash_next;
+    if (*pp) *pp = b->hash_next;
+    b->hash_next = NULL;
+    b->dev = NULL;
+}
+
+/* ===================== ALOCAÇÃO ===================== */
+
+/* Buffer para reutilizar: cresce dentro do orçamento, senão CLOCK; lock preso */
+static buf_t *bcache_victim(void) {
+    if (bc.nbufs < bc.max_buffers) {
+        uint8_t *page = pmalloc(1);
+        if (page) {
+            for (uint32_t i = 0; i < BUFS_PER_PAGE; i++) {
+                bc.bufs[bc.nbufs + i].data = page + i * BCACHE_BLOCK_SIZE;
+            }
+            bc.nbufs += BUFS_PER_PAGE;
+            bc.stats.buffers = bc.nbufs;
+            return &bc.bufs[bc.nbufs - BUFS_PER_PAGE];
+        }
+    }
+
+    /* Duas voltas: a primeira só limpa bits de referência */
+    for (uint32_t n = 0; n < 2 * bc.nbufs; n++) {
+        buf_t *b = &bc.bufs[bc.hand];
+        bc.hand = (bc.hand + 1) % bc.nbufs;
+
+        if (b->refcount || (b->flags & (B_IO | B_DIRTY | B_WB))) continue;
+        if (b->referenced) {
+            b->referenced = 0;
+            continue;
+        }
+        if (b->dev) {
+            bcache_unhash(b);
+            bc.stats.evictions++;
+        }
+        return b;
+    }
+    return NULL;
+}
+
+buf_t *bget(blockdev_t *dev, uint64_t lba) {
+    if (!dev || !bc.bufs) return NULL;
+
+    spinlock_lock(&bc.lock);
+    buf_t *b = bcache_lookup(dev, lba);
+    if (!b) {
+        b = bcache_victim();
+        if (!b && bc.ndirty) {
+            /* Só sobraram sujos: grava tudo e tenta de novo */
+            spinlock_unlock(&bc.lock);
+            bcache_writeback(NULL, UINT64_MAX);
+            spinlock_lock(&bc.lock);
+            b = bcache_lookup(dev, lba);
+            if (!b) b = bcache_victim();
+            else goto found;
+        }
+        if (!b) {
+            spinlock_unlock(&bc.lock);
+            klog(KLOG_WARN, "[BCACHE] All buffers referenced");
+            return NULL;
+        }
+        b->dev = dev;
+        b->lba = lba;
+        b->flags = 0;
+        uint32_t h = bcache_hash(dev, lba);
+        b->hash_next = bc.hash[h];
+        bc.hash[h] = b;
+    }
+found:
+    b->refcount++;
+    b->referenced = 1;
+    spinlock_unlock(&bc.lock);
+    return b;
+}
+
+/* ===================== LEITURA ===================== */
+
+/* Garante data[] válido; só um leitor faz o I/O, os outros esperam.
+ * Esperar I/O já em curso (read-ahead) conta como hit: não custa outro
+ * comando ao disco. Com um escritor em buf_lock (B_LOCKED) a leitura
+ * também espera: o setor dele (bget sem ler) viraria o do disco.
+ * 'caller' (quem chamou bread) vai para o blktrace. */
+static int bcache_fill(buf_t *b, void *caller) {
+    int counted = 0;
+    for (;;) {
+        spinlock_lock(&bc.lock);
+        if (b->flags & B_VALID) {
+            if (!counted) bc.stats.hits++;
+            spinlock_unlock(&bc.lock);
+            if (!counted) blktrace_record(BLKTRACE_HIT, b->dev, BIO_READ, b->lba, 1, 0, caller);
+            return 0;
+        }
+        if (!(b->flags & (B_IO | B_LOCKED))) {
+            b->flags |= B_IO;
+            bc.stats.misses++;
+            spinlock_unlock(&bc.lock);
+            blktrace_record(BLKTRACE_MISS, b->dev, BIO_READ, b->lba, 1, 0, caller);
+            break;
+        }
+        if (!counted) bc.stats.hits++;
+        counted = 1;
+        spinlock_unlock(&bc.lock);
+        blktrace_record(BLKTRACE_HIT, b->dev, BIO_READ, b->lba, 1, 0, caller);
+        wait_event(&bc.io_wq, !(b->flags & (B_IO | B_LOCKED)));
+    }
+
+    int ret = blockdev_read(b->dev, b->lba, 1, b->data);
+
+    spinlock_lock(&bc.lock);
+    b->flags &= ~B_IO;
+    if (ret == 0) b->flags |= B_VALID;
+    spinlock_unlock(&bc.lock);
+    wake_up_all(&bc.io_wq);
+    return ret;
+}
+
+buf_t *bread(blockdev_t *dev, uint64_t lba) {
+    buf_t *b = bget(dev, lba);
+    if (!b) return NULL;
+    if (bcache_fill(b, __builtin_return_address(0)) < 0) {
+        brelse(b);
+        return NULL;
+    }
+    return b;
+}
+
+/* ===================== I/O ASSÍNCRONO ===================== */
+
+/* Write-back em andamento: o último bio a terminar acorda quem espera */
+typedef struct bcache_batch {
+    completion_t done;
+    uint32_t pending;             /* Bios em voo + 1 do submissor (bc.lock) */
+    int error;
+} bcache_batch_t;
+
+/* Um bio do cache e os buffers (LBAs seguidos) que ele lê ou grava */
+typedef struct bcache_io {
+    bio_t bio;
+    bcache_batch_t *batch;        /* NULL no read-ahead */
+    uint32_t count;
+    buf_t *bufs[BCACHE_BIO_BUFS];
+} bcache_io_t;
+
+/* Completion (contexto do driver): atualiza flags e solta os buffers */
+static void bcache_io_end(bio_t *bio) {
+    bcache_io_t *io = (bcache_io_t *)bio->private;
+    bcache_batch_t *batch = io->batch;
+    int last = 0;
+
+    spinlock_lock(&bc.lock);
+    for (uint32_t i = 0; i < io->count; i++) {
+        buf_t *b = io->bufs[i];
+        if (bio->op == BIO_READ) {
+            b->flags &= ~B_IO;
+            if (bio->status == 0) b->flags |= B_VALID;
+        } else {
+            b->flags &= ~B_WB;
+            /* Falhou: volta a ser sujo (se não sujou de novo no meio) */
+            if (bio->status != 0 && !(b->flags & B_DIRTY)) {
+                b->flags |= B_DIRTY;
+                bc.ndirty++;
+            }
+        }
+        if (b->refcount) b->refcount--;
+    }
+    if (bio->op == BIO_WRITE && bio->status == 0) bc.stats.written += io->count;
+    if (batch) {
+        if (bio->status != 0) batch->error = -1;
+        last = --batch->pending == 0;
+    }
+    spinlock_unlock(&bc.lock);
+
+    wake_up_all(&bc.io_wq);
+    if (last) complete(&batch->done);
+    kfree(io);
+}
+
+static void bcache_io_submit(blockdev_t *dev, bcache_io_t *io) {
+    if (submit_bio(dev, &io->bio) < 0) bio_endio(&io->bio, -1);
+}
+
+/* Põe 'b' (LBA seguinte ao último de 'io') no bio em montagem; submete o
+ * atual quando enche. Devolve o bio em montagem, ou NULL sem memória. */
+static bcache_io_t *bcache_io_add(blockdev_t *dev, bcache_io_t *io, buf_t *b,
+                                  int op, bcache_batch_t *batch) {
+    /* Buffers vizinhos na mesma página viram um segmento só */
+    bio_seg_t *last = io && io->bio.seg_count ? &io->bio.segs[io->bio.seg_count - 1] : NULL;
+    int contiguous = last &&
+        (uint8_t *)last->buf + last->sectors * BCACHE_BLOCK_SIZE == b->data;
+    if (io && (io->count == BCACHE_BIO_BUFS ||
+               (!contiguous && io->bio.seg_count == BIO_MAX_SEGS))) {
+        bcache_io_submit(dev, io);
+        io = NULL;
+        contiguous = 0;
+    }
+
+    if (!io) {
+        io = kmalloc(sizeof(*io));
+        if (!io) return NULL;
+        bio_init(&io->bio, op, b->lba, bcache_io_end, io);
+        io->batch = batch;
+        io->count = 0;
+        if (batch) {
+            spinlock_lock(&bc.lock);
+            batch->pending++;
+            spinlock_unlock(&bc.lock);
+        }
+    }
+
+    if (contiguous) io->bio.segs[io->bio.seg_count - 1].sectors++;
+    else bio_add_seg(&io->bio, b->data, 1);
+    io->bufs[io->count++] = b;
+    return io;
+}
+
+/* ===================== READ-AHEAD ===================== */
+
+int bcache_prefetch(blockdev_t *dev, uint64_t lba, uint32_t count) {
+    bcache_io_t *io = NULL;
+    uint32_t issued = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        buf_t *b = bget(dev, lba + i);
+        if (!b) break;
+
+        spinlock_lock(&bc.lock);
+        int cached = b->flags & (B_VALID | B_IO | B_LOCKED);
+        if (!cached) b->flags |= B_IO;
+        spinlock_unlock(&bc.lock);
+
+        if (cached) {
+            /* Já no cache, a caminho ou com escritor: o bio corrente
+             * termina aqui */
+            brelse(b);
+            if (io) bcache_io_submit(dev, io);
+            io = NULL;
+            continue;
+        }
+
+        io = bcache_io_add(dev, io, b, BIO_READ, NULL);
+        if (!io) {
+            spinlock_lock(&bc.lock);
+            b->flags &= ~B_IO;
+            spinlock_unlock(&bc.lock);
+            brelse(b);
+            break;
+        }
+        issued++;
+    }
+    if (io) bcache_io_submit(dev, io);
+
+    spinlock_lock(&bc.lock);
+    bc.stats.prefetched += issued;
+    spinlock_unlock(&bc.lock);
+    return (int)issued;
+}
+
+/* ===================== ESCRITA ===================== */
+
+static uint64_t bcache_ms_to_ticks(uint32_t ms) {
+    uint64_t t = (uint64_t)ms * SCHED_HZ / 1000;
+    return t ? t : 1;
+}
+
+void bdirty(buf_t *b) {
+    int kick = 0;
+
+    spinlock_lock(&bc.lock);
+    if (!(b->flags & B_DIRTY)) {
+        b->flags |= B_DIRTY;
+        b->dirty_since = sched_ticks();
+        bc.ndirty++;
+    }
+    b->flags |= B_VALID;
+    bc.stats.dirtied++;
+    if (!bc.pressure && bc.ndirty * 100 >= bc.max_buffers * BCACHE_DIRTY_HIGH_PCT) {
+        bc.pressure = 1;
+        kick = 1;
+    }
+    spinlock_unlock(&bc.lock);
+
+    if (kick && bc.flusher) complete(&bc.flush_kick);
+}
+
+int bwrite(buf_t *b) {
+    spinlock_lock(&bc.lock);
+    int was_dirty = b->flags & B_DIRTY;
+    if (was_dirty) {
+        b->flags &= ~B_DIRTY;
+        bc.ndirty--;
+    }
+    spinlock_unlock(&bc.lock);
+
+    int ret = blockdev_write(b->dev, b->lba, 1, b->data);
+
+    spinlock_lock(&bc.lock);
+    if (ret == 0) {
+        b->flags |= B_VALID;
+    } else if (was_dirty && !(b->flags & B_DIRTY)) {
+        b->flags |= B_DIRTY;
+        bc.ndirty++;
+    }
+    spinlock_unlock(&bc.lock);
+    return ret;
+}
+
+/* Ordena por (device, LBA): shellsort, sem memória extra */
+static int bcache_before(const buf_t *a, const buf_t *b) {
+    if (a->dev != b->dev) return (uintptr_t)a->dev < (uintptr_t)b->dev;
+    return a->lba < b->lba;
+}
+
+static void bcache_sort(buf_t **v, uint32_t n) {
+    static const uint32_t gaps[] = { 701, 301, 132, 57, 23, 10, 4, 1 };
+    for (uint32_t g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++) {
+        uint32_t gap = gaps[g];
+        for (uint32_t i = gap; i < n; i++) {
+            buf_t *x = v[i];
+            uint32_t j = i;
+            while (j >= gap && bcache_before(x, v[j - gap])) {
+                v[j] = v[j - gap];
+                j -= gap;
+            }
+            v[j] = x;
+        }
+    }
+}
+
+int bcache_writeback(blockdev_t *dev, uint64_t cutoff) {
+    if (!bc.bufs) return 0;
+
+    /* Serializado: quando volta, nada que sujou antes está em B_WB */
+    mutex_lock(&bc.wb_lock);
+
+    buf_t **list = bc.wb_list;
+    uint32_t n = 0;
+    spinlock_lock(&bc.lock);
+    for (uint32_t i = 0; i < bc.nbufs; i++) {
+        buf_t *b = &bc.bufs[i];
+        if (!(b->flags & B_DIRTY) || (b->flags & B_WB)) continue;
+        if (dev && b->dev != dev) continue;
+        if (b->dirty_since > cutoff) continue;
+        b->flags = (b->flags & ~B_DIRTY) | B_WB;
+        b->refcount++;
+        bc.ndirty--;
+        list[n++] = b;
+    }
+    if (bc.ndirty * 100 < bc.max_buffers * BCACHE_DIRTY_HIGH_PCT) bc.pressure = 0;
+    spinlock_unlock(&bc.lock);
+
+    if (!n) {
+        mutex_unlock(&bc.wb_lock);
+        return 0;
+    }
+    bcache_sort(list, n);
+
+    bcache_batch_t batch = { .pending = 1 };
+    completion_init(&batch.done);
+
+    /* LBAs seguidos do mesmo device saem num bio; a fila plugada junta o resto */
+    bcache_io_t *io = NULL;
+    blockdev_t *plugged = NULL;
+    for (uint32_t i = 0; i < n; i++) {
+        buf_t *b = list[i];
+        if (b->dev != plugged) {
+            if (io) bcache_io_submit(plugged, io);
+            io = NULL;
+            if (plugged) blockdev_unplug(plugged);
+            plugged = b->dev;
+            blockdev_plug(plugged);
+        }
+        if (io && io->bio.lba + io->count != b->lba) {
+            bcache_io_submit(plugged, io);
+            io = NULL;
+        }
+
+        io = bcache_io_add(plugged, io, b, BIO_WRITE, &batch);
+        if (!io) {
+            /* Sem memória: continua sujo para a próxima rodada */
+            spinlock_lock(&bc.lock);
+            b->flags &= ~B_WB;
+            if (!(b->flags & B_DIRTY)) {
+                b->flags |= B_DIRTY;
+                bc.ndirty++;
+            }
+            b->refcount--;
+            batch.error = -1;
+            spinlock_unlock(&bc.lock);
+        }
+    }
+    if (io) bcache_io_submit(plugged, io);
+    if (plugged) blockdev_unplug(plugged);
+
+    spinlock_lock(&bc.lock);
+    int last = --batch.pending == 0;
+    spinlock_unlock(&bc.lock);
+    if (!last) wait_for_completion(&batch.done);
+
+    mutex_unlock(&bc.wb_lock);
+    if (batch.error) klog(KLOG_ERROR, "[BCACHE] Write-back of %u sectors failed", n);
+    return batch.error;
+}
+
+int bcache_sync(blockdev_t *dev) {
+    int ret = bcache_writeback(dev, UINT64_MAX);
+    if (blockdev_flush(dev) != 0) ret = -1;
+    return ret;
+}
+
+/* Thread bflush: grava o que envelheceu, ou tudo sob pressão */
+static void bcache_flusher(void *arg) {
+    (void)arg;
+    for (;;) {
+        wait_for_completion_timeout(&bc.flush_kick, BCACHE_FLUSH_INTERVAL_MS);
+        completion_reinit(&bc.flush_kick);
+
+        if (bc.pressure) {
+            bcache_writeback(NULL, UINT64_MAX);
+            continue;
+        }
+        uint64_t now = sched_ticks();
+        uint64_t age = bcache_ms_to_ticks(BCACHE_DIRTY_EXPIRE_MS);
+        if (bc.ndirty && now >= age) bcache_writeback(NULL, now - age);
+    }
+}
+
+void brelse(buf_t *b) {
+    spinlock_lock(&bc.lock);
+    if (b->refcount) b->refcount--;
+    spinlock_unlock(&bc.lock);
+}
+
+void buf_lock(buf_t *b) {
+    mutex_lock(&b->lock);
+    /* Leitura em voo sobrescreveria o que vai ser escrito. B_LOCKED vai
+     * junto com a checagem, sob bc.lock: nenhuma começa depois dela. */
+    for (;;) {
+        spinlock_lock(&bc.lock);
+        if (!(b->flags & B_IO)) {
+            b->flags |= B_LOCKED;
+            spinlock_unlock(&bc.lock);
+            return;
+        }
+        spinlock_unlock(&bc.lock);
+        wait_event(&bc.io_wq, !(b->flags & B_IO));
+    }
+}
+
+void buf_unlock(buf_t *b) {
+    spinlock_lock(&bc.lock);
+    b->flags &= ~B_LOCKED;
+    spinlock_unlock(&bc.lock);
+    /* Leitor de um buffer que o escritor não validou volta a poder ler */
+    wake_up_all(&bc.io_wq);
+    mutex_unlock(&b->lock);
+}
+
+void bcache_invalidate(blockdev_t *dev) {
+    spinlock_lock(&bc.lock);
+    for (uint32_t i = 0; i < bc.nbufs; i++) {
+        buf_t *b = &bc.bufs[i];
+        if (b->dev == dev && !b->refcount && !(b->flags & (B_IO | B_DIRTY | B_WB))) {
+            bcache_unhash(b);
+            b->flags = 0;
+        }
+    }
+    spinlock_unlock(&bc.lock);
+}
+
+/* ===================== ESTATÍSTICAS ===================== */
+
+void bcache_get_stats(bcache_stats_t *out) {
+    spinlock_lock(&bc.lock);
+    *out = bc.stats;
+    out->dirty = bc.ndirty;
+    spinlock_unlock(&bc.lock);
+}
+
+void bcache_dump(void) {
+    bcache_stats_t s;
+    bcache_get_stats(&s);
+    uint64_t total = s.hits + s.misses;
+    klog(KLOG_INFO, "[BCACHE] %u hits, %u misses (%u%% hit), %u prefetched, %u evictions, %u/%u buffers",
+         (uint32_t)s.hits, (uint32_t)s.misses,
+         total ? (uint32_t)(s.hits * 100 / total) : 0, (uint32_t)s.prefetched,
+         (uint32_t)s.evictions, s.buffers, s.max_buffers);
+    klog(KLOG_INFO, "[BCACHE] %u writes absorbed into %u sectors written back, %u dirty",
+         (uint32_t)s.dirtied, (uint32_t)s.written, s.dirty);
+}
@@ -0,0 +1,104 @@
+// bcache.h - Cache de blocos unificado, chaveado por (device, LBA)
+//
+// Um buf_t guarda um setor de um blockdev. bread() devolve o buffer com
+// referência tomada (lido do disco só no miss); brelse() solta. Buffers sem
+// referência ficam no hash e são reaproveitados por CLOCK quando o
+// orçamento de memória (páginas do PMM) acaba.
+//
+// Escritas são write-back: bdirty() só marca o buffer, e escritas seguidas
+// no mesmo setor custam um I/O. Os sujos vão ao disco ordenados por
+// (device, LBA) em bios contíguos: pela thread "bflush" quando envelhecem
+// ou passam da marca d'água, em bcache_sync() (vfs_sync/vfs_sync_all) e
+// quando o CLOCK não acha buffer limpo para reaproveitar.
+#pragma once
+#include <stdint.h>
+#include "blockdev.h"
+#include "waitqueue.h"
+
+#define BCACHE_BLOCK_SIZE   512
+#define BCACHE_HASH_SIZE    1024          /* Potência de 2 */
+
+/* Orçamento padrão: 1 MiB (2048 setores); make CPPFLAGS=-DBCACHE_PAGES=n */
+#ifndef BCACHE_PAGES
+#define BCACHE_PAGES        256
+#endif
+
+#define BCACHE_BIO_BUFS     64            /* Setores por bio (read-ahead/write-back) */
+
+#define BCACHE_FLUSH_INTERVAL_MS  1000      /* Período da thread bflush */
+#define BCACHE_DIRTY_EXPIRE_MS    3000      /* Idade que força a escrita */
+#define BCACHE_DIRTY_HIGH_PCT     50        /* % de sujos que acorda bflush */
+
+#define B_VALID     0x01                  /* data[] tem o conteúdo do disco */
+#define B_IO        0x02                  /* Leitura em curso */
+#define B_DIRTY     0x04                  /* data[] mais novo que o disco */
+#define B_WB        0x08                  /* Escrita (write-back) em curso */
+#define B_LOCKED    0x10                  /* Sob buf_lock: nenhuma leitura começa */
+
+typedef struct buf {
+    blockdev_t *dev;                      /* NULL = buffer livre */
+    uint64_t lba;
+    uint8_t *data;                        /* BCACHE_BLOCK_SIZE bytes */
+    volatile uint32_t flags;
+    uint32_t refcount;
+    uint8_t referenced;                   /* Bit do CLOCK */
+    uint64_t dirty_since;                 /* sched_ticks de quando sujou */
+    mutex_t lock;                         /* Read-modify-write do conteúdo */
+    struct buf *hash_next;
+} buf_t;
+
+typedef struct bcache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t prefetched;                  /* Setores pedidos por read-ahead */
+    uint64_t dirtied;                     /* Chamadas a bdirty */
+    uint64_t written;                     /* Setores gravados por write-back */
+    uint32_t dirty;                       /* Sujos agora */
+    uint32_t buffers;                     /* Buffers com memória */
+    uint32_t max_buffers;
+} bcache_stats_t;
+
+/* Reserva as estruturas para até 'pages' páginas de dados (alocadas sob
+ * demanda); 0 = BCACHE_PAGES */
+int bcache_init(uint32_t pages);
+
+/* Buffer do setor com o conteúdo lido; NULL em erro de I/O ou sem buffer livre */
+buf_t *bread(blockdev_t *dev, uint64_t lba);
+
+/* Buffer do setor sem ler o disco (quem chama vai sobrescrever tudo) */
+buf_t *bget(blockdev_t *dev, uint64_t lba);
+
+/* Pede em segundo plano os setores de [lba, lba+count) que não estão no
+ * cache; não espera. Devolve quantos setores foram pedidos. */
+int bcache_prefetch(blockdev_t *dev, uint64_t lba, uint32_t count);
+
+/* Marca o buffer (já modificado, sob buf_lock) como válido e sujo; o
+ * disco é atualizado depois, pelo write-back */
+void bdirty(buf_t *b);
+
+/* Grava o buffer no disco agora (síncrono) e o marca válido e limpo */
+int bwrite(buf_t *b);
+
+/* Grava os sujos de 'dev' (NULL = todos) que sujaram até 'cutoff'
+ * (sched_ticks; UINT64_MAX = todos), ordenados, e espera. 0 ou -1. */
+int bcache_writeback(blockdev_t *dev, uint64_t cutoff);
+
+/* Write-back de tudo de 'dev' + FLUSH do cache do device */
+int bcache_sync(blockdev_t *dev);
+
+/* Solta a referência de bread/bget */
+void brelse(buf_t *b);
+
+/* Exclusão para modificar data[]; espera leitura em curso terminar, e
+ * bread/read-ahead não leem o disco por cima enquanto estiver preso */
+void buf_lock(buf_t *b);
+void buf_unlock(buf_t *b);
+
+/* Descarta os buffers limpos sem referência do device (troca de mídia) */
+void bcache_invalidate(blockdev_t *dev);
+
+void bcache_get_stats(bcache_stats_t *out);
+
+/* Loga hits, misses, taxa de acerto, write-back, evictions e ocupação */
+void bcache_dump(void);
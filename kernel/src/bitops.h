@@ -0,0 +1,10 @@
+// bitops.h - Operações de bit sem libgcc (sem __builtin_popcount)
+#pragma once
+#include <stdint.h>
+
+/* Bits ligados (ex.: slots em voo num bitmap) */
+static inline uint32_t bit_count(uint64_t bits) {
+    uint32_t n = 0;
+    for (; bits; bits &= bits - 1) n++;
+    return n;
+}
@@ -0,0 +1,461 @@
+// blkqueue.c - Fila de pedidos: merge de bios vizinhos, C-SCAN com deadline
+#include "blkqueue.h"
+#include "sched.h"
+#include "blktrace.h"
+#include "string.h"
+#include "bitops.h"
+
+extern void klog(int level, const char *fmt, ...);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+#define BLK_SECTOR_SIZE 512
+
+static uint64_t blk_ms_to_ticks(uint32_t ms) {
+    uint64_t t = (uint64_t)ms * SCHED_HZ / 1000;
+    return t ? t : 1;
+}
+
+void blk_queue_init(request_queue_t *q, uint32_t max_sectors,
+                    void (*kick)(request_queue_t *q), void *driver_data) {
+    *q = (request_queue_t){ .lock = SPINLOCK_INIT, .free_wq = WAIT_QUEUE_INIT };
+    for (int i = 0; i < BLK_NR_REQUESTS; i++) {
+        q->pool[i].next = q->free;
+        q->free = &q->pool[i];
+    }
+    q->max_sectors = max_sectors;
+    q->kick = kick;
+    q->driver_data = driver_data;
+}
+
+/* ===================== LISTAS ===================== */
+
+static void blk_fifo_remove(request_queue_t *q, request_t *rq) {
+    request_t *prev = NULL;
+    for (request_t *r = q->fifo_head; r; prev = r, r = r->fifo_next) {
+        if (r != rq) continue;
+        if (prev) prev->fifo_next = r->fifo_next;
+        else q->fifo_head = r->fifo_next;
+        if (q->fifo_tail == r) q->fifo_tail = prev;
+        r->fifo_next = NULL;
+        return;
+    }
+}
+
+static void blk_sorted_remove(request_queue_t *q, request_t *rq) {
+    request_t **pp = &q->sorted;
+    while (*pp && *pp != rq) pp = &(*pp)->next;
+    if (*pp) *pp = rq->next;
+    rq->next = NULL;
+}
+
+static void blk_sorted_insert(request_queue_t *q, request_t *rq) {
+    request_t **pp = &q->sorted;
+    while (*pp && (*pp)->lba < rq->lba) pp = &(*pp)->next;
+    rq->next = *pp;
+    *pp = rq;
+}
+
+static void blk_free_request(request_queue_t *q, request_t *rq) {
+    rq->next = q->free;
+    q->free = rq;
+}
+
+/* ===================== MERGE ===================== */
+
+/* Pedido ainda pode receber bios: mesma operação e depois do último FLUSH */
+static int blk_mergeable(request_queue_t *q, request_t *rq, int op) {
+    return rq->op == op && rq->seq > q->barrier_seq;
+}
+
+/* Junta 'b' (logo depois de 'a' na lista por LBA) em 'a' se encostam */
+static void blk_try_absorb(request_queue_t *q, request_t *a, request_t *b) {
+    if (!a || !b || a->next != b) return;
+    if (!blk_mergeable(q, a, b->op) || !blk_mergeable(q, b, a->op)) return;
+    if (a->lba + a->sectors != b->lba) return;
+    if (a->segs + b->segs > BLK_MAX_REQ_SEGS || a->sectors + b->sectors > q->max_sectors) return;
+
+    a->bio_tail->next = b->bio_head;
+    a->bio_tail = b->bio_tail;
+    a->sectors += b->sectors;
+    a->segs += b->segs;
+    if (b->deadline < a->deadline) a->deadline = b->deadline;
+    a->next = b->next;
+
+    blk_fifo_remove(q, b);
+    blk_free_request(q, b);
+    q->queued--;
+    q->stats.merges++;
+}
+
+/* Encosta o bio no fim ou no começo de um pedido pendente; lock preso */
+static int blk_try_merge(request_queue_t *q, bio_t *bio, uint32_t n) {
+    request_t *prev = NULL;
+    for (request_t *rq = q->sorted; rq; prev = rq, rq = rq->next) {
+        if (!blk_mergeable(q, rq, bio->op)) continue;
+        if (rq->segs + bio->seg_count > BLK_MAX_REQ_SEGS ||
+            rq->sectors + n > q->max_sectors) continue;
+
+        if (rq->lba + rq->sectors == bio->lba) {
+            rq->bio_tail->next = bio;
+            rq->bio_tail = bio;
+            rq->sectors += n;
+            rq->segs += bio->seg_count;
+            blk_try_absorb(q, rq, rq->next);
+            return 1;
+        }
+        if (bio->lba + n == rq->lba) {
+            bio->next = rq->bio_head;
+            rq->bio_head = bio;
+            rq->lba = bio->lba;
+            rq->sectors += n;
+            rq->segs += bio->seg_count;
+            blk_try_absorb(q, prev, rq);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* ===================== ENTRADA ===================== */
+
+void blk_queue_bio(request_queue_t *q, bio_t *bio) {
+    uint32_t n = bio_sectors(bio);
+    bio->next = NULL;
+
+    for (;;) {
+        uint64_t flags = spinlock_lock_irqsave(&q->lock);
+
+        if (bio->op != BIO_FLUSH && blk_try_merge(q, bio, n)) {
+            q->stats.bios++;
+            q->stats.merges++;
+            spinlock_unlock_irqrestore(&q->lock, flags);
+            break;
+        }
+
+        request_t *rq = q->free;
+        if (rq) {
+            q->free = rq->next;
+            *rq = (request_t){
+                .op = bio->op, .lba = bio->lba, .sectors = n,
+                .segs = bio->seg_count, .bio_head = bio, .bio_tail = bio,
+                .seq = ++q->seq,
+            };
+            rq->deadline = sched_ticks() + blk_ms_to_ticks(
+                bio->op == BIO_READ ? BLK_READ_EXPIRE_MS : BLK_WRITE_EXPIRE_MS);
+
+            if (bio->op == BIO_FLUSH) q->barrier_seq = rq->seq;
+            else blk_sorted_insert(q, rq);
+
+            if (q->fifo_tail) q->fifo_tail->fifo_next = rq;
+            else q->fifo_head = rq;
+            q->fifo_tail = rq;
+            q->queued++;
+            q->stats.bios++;
+            spinlock_unlock_irqrestore(&q->lock, flags);
+            break;
+        }
+
+        /* Pool vazio: solta o plug (senão nada sai) e espera o driver
+         * devolver um pedido */
+        spinlock_unlock_irqrestore(&q->lock, flags);
+        blk_flush_plug(q);
+        if (q->kick) q->kick(q);
+        wait_event(&q->free_wq, q->free != NULL);
+    }
+
+    if (!q->plugged && q->kick) q->kick(q);
+}
+
+/* ===================== PLUG POR THREAD ===================== */
+
+/* Antes do scheduler só existe o fluxo do kmain */
+static thread_plug_t boot_plugs[THREAD_MAX_PLUGS];
+static uint32_t boot_nr_plugs;
+
+static thread_plug_t *blk_thread_plugs(uint32_t **nr) {
+    if (!sched_active()) {
+        *nr = &boot_nr_plugs;
+        return boot_plugs;
+    }
+    thread_t *t = thread_current();
+    *nr = &t->nr_plugs;
+    return t->plugs;
+}
+
+static void blk_plug_release(request_queue_t *q) {
+    uint64_t flags = spinlock_lock_irqsave(&q->lock);
+    if (q->plugged > 0) q->plugged--;
+    int run = !q->plugged && q->fifo_head;
+    spinlock_unlock_irqrestore(&q->lock, flags);
+
+    if (run && q->kick) q->kick(q);
+}
+
+/* Tira a entrada i da thread (a última ocupa o lugar) */
+static void blk_plug_drop(thread_plug_t *plugs, uint32_t *nr, uint32_t i) {
+    request_queue_t *q = plugs[i].q;
+    plugs[i] = plugs[--*nr];
+    blk_plug_release(q);
+}
+
+void blk_plug(request_queue_t *q) {
+    uint32_t *nr;
+    thread_plug_t *plugs = blk_thread_plugs(&nr);
+
+    for (uint32_t i = 0; i < *nr; i++) {
+        if (plugs[i].q == q) {
+            plugs[i].depth++;
+            return;
+        }
+    }
+    /* Sem entrada livre a rajada só não é juntada; o unplug vira no-op */
+    if (*nr == THREAD_MAX_PLUGS) return;
+
+    plugs[(*nr)++] = (thread_plug_t){ .q = q, .depth = 1 };
+    uint64_t flags = spinlock_lock_irqsave(&q->lock);
+    q->plugged++;
+    spinlock_unlock_irqrestore(&q->lock, flags);
+}
+
+void blk_unplug(request_queue_t *q) {
+    uint32_t *nr;
+    thread_plug_t *plugs = blk_thread_plugs(&nr);
+
+    for (uint32_t i = 0; i < *nr; i++) {
+        if (plugs[i].q != q) continue;
+        if (--plugs[i].depth == 0) blk_plug_drop(plugs, nr, i);
+        return;
+    }
+}
+
+void blk_flush_plug(request_queue_t *q) {
+    uint32_t *nr;
+    thread_plug_t *plugs = blk_thread_plugs(&nr);
+
+    for (uint32_t i = 0; i < *nr; i++) {
+        if (plugs[i].q == q) {
+            blk_plug_drop(plugs, nr, i);
+            return;
+        }
+    }
+}
+
+void blk_flush_thread_plugs(void) {
+    uint32_t *nr;
+    thread_plug_t *plugs = blk_thread_plugs(&nr);
+
+    while (*nr) blk_plug_drop(plugs, nr, *nr - 1);
+}
+
+/* ===================== DESPACHO ===================== */
+
+/* FLUSH só sai sozinho: na frente da fila e sem nada em voo */
+static int blk_can_fetch(request_queue_t *q) {
+    if (q->plugged || !q->fifo_head) return 0;
+    return q->fifo_head->op != BIO_FLUSH || q->in_flight == 0;
+}
+
+int blk_queue_pending(request_queue_t *q) {
+    return blk_can_fetch(q);
+}
+
+request_t *blk_fetch_request(request_queue_t *q) {
+    uint64_t flags = spinlock_lock_irqsave(&q->lock);
+    if (!blk_can_fetch(q)) {
+        spinlock_unlock_irqrestore(&q->lock, flags);
+        return NULL;
+    }
+
+    request_t *oldest = q->fifo_head;
+    request_t *rq = NULL;
+
+    if (oldest->op == BIO_FLUSH) {
+        rq = oldest;
+    } else if (sched_ticks() >= oldest->deadline) {
+        /* Prazo estourado: atende por ordem de chegada */
+        rq = oldest;
+    } else {
+        /* Só passa na frente o que chegou antes do primeiro FLUSH */
+        uint64_t limit = UINT64_MAX;
+        for (request_t *r = oldest; r; r = r->fifo_next) {
+            if (r->op == BIO_FLUSH) { limit = r->seq; break; }
+        }
+        /* C-SCAN: o próximo a partir da cabeça; no fim, volta ao menor LBA */
+        request_t *first = NULL;
+        for (request_t *r = q->sorted; r; r = r->next) {
+            if (r->seq >= limit) continue;
+            if (!first) first = r;
+            if (r->lba >= q->head_pos) { rq = r; break; }
+        }
+        if (!rq) rq = first;
+    }
+
+    if (rq->op != BIO_FLUSH) blk_sorted_remove(q, rq);
+    blk_fifo_remove(q, rq);
+    q->queued--;
+    q->in_flight++;
+    q->head_pos = rq->lba + rq->sectors;
+    q->stats.requests++;
+    q->stats.sectors += rq->sectors;
+
+    spinlock_unlock_irqrestore(&q->lock, flags);
+    blktrace_record(BLKTRACE_ISSUE, rq->bio_head->dev, rq->op, rq->lba, rq->sectors, 0,
+                    __builtin_return_address(0));
+    return rq;
+}
+
+void blk_end_request(request_queue_t *q, request_t *rq, int status) {
+    bio_t *bio = rq->bio_head;
+
+    uint64_t flags = spinlock_lock_irqsave(&q->lock);
+    blk_free_request(q, rq);
+    q->in_flight--;
+    spinlock_unlock_irqrestore(&q->lock, flags);
+    wake_up_one(&q->free_wq);
+
+    while (bio) {
+        bio_t *next = bio->next;
+        bio->next = NULL;
+        bio_endio(bio, status);
+        bio = next;
+    }
+}
+
+/* ===================== CURSOR ===================== */
+
+void blk_cursor_init(blk_cursor_t *c, bio_t *bio) {
+    c->bio = bio;
+    c->seg = 0;
+    c->off = 0;
+}
+
+void *blk_cursor_next(blk_cursor_t *c, uint32_t max, uint32_t *n) {
+    bio_seg_t *s = &c->bio->segs[c->seg];
+    uint32_t left = s->sectors - c->off;
+    uint32_t k = left < max ? left : max;
+    void *p = (uint8_t *)s->buf + (size_t)c->off * BLK_SECTOR_SIZE;
+
+    c->off += k;
+    if (c->off == s->sectors) {
+        c->off = 0;
+        if (++c->seg == c->bio->seg_count) {
+            c->bio = c->bio->next;
+            c->seg = 0;
+        }
+    }
+    *n = k;
+    return p;
+}
+
+void blk_bounce_copy(request_t *rq, void *bounce, int to_bounce) {
+    blk_cursor_t cur;
+    blk_cursor_init(&cur, rq->bio_head);
+    uint8_t *b = bounce;
+    uint32_t left = rq->sectors;
+    while (left) {
+        uint32_t k;
+        void *ptr = blk_cursor_next(&cur, left, &k);
+        if (to_bounce) memcpy(b, ptr, (size_t)k * BLK_SECTOR_SIZE);
+        else memcpy(ptr, b, (size_t)k * BLK_SECTOR_SIZE);
+        b += (size_t)k * BLK_SECTOR_SIZE;
+        left -= k;
+    }
+}
+
+/* ===================== DRIVERS COM SLOTS ===================== */
+
+void blk_slots_init(blk_slots_t *s, const blk_slot_ops_t *ops,
+                    request_queue_t *q, void *driver, uint32_t depth) {
+    *s = (blk_slots_t){ .ops = ops, .queue = q, .driver = driver, .depth = depth };
+}
+
+static void blk_slots_end(blk_slots_t *s, request_t *rq, void *ctx, int status) {
+    if (s->ops->end) s->ops->end(s, rq, ctx, status);
+    else blk_end_request(s->queue, rq, status);
+}
+
+void blk_slots_fill(blk_slots_t *s) {
+    uint32_t mask = s->depth >= 32 ? 0xFFFFFFFFu : (1u << s->depth) - 1;
+    for (;;) {
+        uint32_t free = ~s->busy & mask;
+        if (!free) break;
+
+        request_t *rq = s->held;
+        void *ctx = s->held_ctx;
+        if (!rq) {
+            ctx = NULL;
+            rq = s->ops->fetch ? s->ops->fetch(s, &ctx) : blk_fetch_request(s->queue);
+        }
+        if (!rq) break;
+        s->held = NULL;
+        s->held_ctx = NULL;
+
+        int r = s->ops->start(s, __builtin_ctz(free), rq, ctx);
+        if (r == 0) {
+            s->held = rq;
+            s->held_ctx = ctx;
+            break;
+        }
+        if (r != 1) blk_slots_end(s, rq, ctx, r < 0 ? -1 : 0);
+    }
+}
+
+void blk_slots_get(blk_slots_t *s, int slot) {
+    s->busy |= 1u << slot;
+    uint32_t inflight = bit_count(s->busy);
+    if (inflight > s->max_inflight) s->max_inflight = inflight;
+}
+
+void blk_slots_put(blk_slots_t *s, int slot) {
+    s->busy &= ~(1u << slot);
+}
+
+int blk_slots_busy(blk_slots_t *s) {
+    return s->busy || s->held || (s->queue && blk_queue_pending(s->queue));
+}
+
+void blk_poller_init(blk_poller_t *p, const blk_poll_ops_t *ops, void *arg) {
+    p->ops = ops;
+    p->arg = arg;
+    p->worker = NULL;
+    wait_queue_init(&p->wq);
+}
+
+static void blk_poller_thread(void *arg) {
+    blk_poller_t *p = (blk_poller_t *)arg;
+    for (;;) {
+        wait_event(&p->wq, p->ops->busy(p->arg));
+        p->ops->service(p->arg);
+        if (p->ops->inflight(p->arg)) wait_poll_relax();
+    }
+}
+
+void blk_poller_start(blk_poller_t *p, const char *name) {
+    if (sched_active()) p->worker = thread_create(name, blk_poller_thread, p);
+}
+
+void blk_poller_kick(blk_poller_t *p) {
+    if (p->worker) {
+        wake_up_one(&p->wq);
+        return;
+    }
+    /* Boot (sem thread): despacha e espera aqui mesmo */
+    while (p->ops->busy(p->arg)) {
+        p->ops->service(p->arg);
+        if (p->ops->inflight(p->arg)) cpu_relax();
+    }
+}
+
+/* ===================== ESTATÍSTICAS ===================== */
+
+void blk_queue_dump(const char *name, request_queue_t *q) {
+    blk_stats_t s = q->stats;
+    klog(KLOG_INFO, "[BLK] %s: %u bios -> %u requests, %u merged (%u%%), avg %u sectors/request",
+         name, (uint32_t)s.bios, (uint32_t)s.requests, (uint32_t)s.merges,
+         s.bios ? (uint32_t)(s.merges * 100 / s.bios) : 0,
+         s.requests ? (uint32_t)(s.sectors / s.requests) : 0);
+}
@@ -0,0 +1,173 @@
+// blkqueue.h - Fila de pedidos por dispositivo: merge, elevador e plug
+//
+// submit_bio() num blockdev com fila não vai direto ao driver: o bio entra
+// na request_queue, onde é juntado a um pedido vizinho (mesma operação, LBA
+// contíguo) ou vira um pedido novo. O driver é avisado por kick() e tira
+// pedidos com blk_fetch_request(), que segue C-SCAN por LBA com prazo
+// (deadline) para não deixar ninguém esperando demais. Um FLUSH é barreira:
+// nada enfileirado depois dele passa na frente, e nada é juntado a pedidos
+// anteriores a ele.
+//
+// Enquanto a fila está "plugada" o driver não recebe nada: uma rajada de
+// bios se acumula e sai já juntada no unplug. O plug é da thread: a fila
+// conta quantas threads a seguram, e a thread que vai dormir solta os seus
+// antes (blk_flush_thread_plugs), senão esperaria pelo próprio bio preso.
+#pragma once
+#include <stdint.h>
+#include "blockdev.h"
+#include "spinlock.h"
+#include "waitqueue.h"
+
+#define BLK_NR_REQUESTS      64   /* Pedidos por fila (pool fixo) */
+#define BLK_MAX_REQ_SEGS     128  /* Segmentos somados num pedido juntado */
+#define BLK_READ_EXPIRE_MS   50   /* Prazo do deadline para leituras */
+#define BLK_WRITE_EXPIRE_MS  500
+
+typedef struct request {
+    int op;                       /* BIO_READ / BIO_WRITE / BIO_FLUSH */
+    uint64_t lba;
+    uint32_t sectors;
+    uint32_t segs;
+    bio_t *bio_head;              /* bios em ordem de LBA (bio->next) */
+    bio_t *bio_tail;
+    uint64_t seq;                 /* Ordem de chegada */
+    uint64_t deadline;            /* Em sched_ticks */
+    struct request *next;         /* Lista por LBA / lista livre */
+    struct request *fifo_next;    /* Ordem de chegada */
+} request_t;
+
+/* Cursor sobre os segmentos de uma cadeia de bios (driver) */
+typedef struct blk_cursor {
+    bio_t *bio;
+    uint32_t seg;
+    uint32_t off;                 /* Setores já consumidos do segmento */
+} blk_cursor_t;
+
+typedef struct blk_stats {
+    uint64_t bios;                /* Bios recebidos */
+    uint64_t merges;              /* Bios (ou pedidos) absorvidos por outro */
+    uint64_t requests;            /* Pedidos entregues ao driver */
+    uint64_t sectors;             /* Setores nesses pedidos */
+} blk_stats_t;
+
+typedef struct request_queue {
+    spinlock_t lock;
+    request_t pool[BLK_NR_REQUESTS];
+    request_t *free;
+    request_t *sorted;            /* Leituras/escritas por LBA */
+    request_t *fifo_head;         /* Todos, por chegada (inclui FLUSH) */
+    request_t *fifo_tail;
+    uint32_t queued;
+    uint32_t in_flight;           /* Entregues ao driver, não completados */
+    uint64_t seq;
+    uint64_t barrier_seq;         /* seq do último FLUSH enfileirado */
+    uint64_t head_pos;            /* LBA onde o último pedido terminou */
+    int plugged;                  /* Threads segurando plug nesta fila */
+    uint32_t max_sectors;         /* Limite de um pedido juntado */
+    wait_queue_t free_wq;         /* Espera por pedido livre */
+    void (*kick)(struct request_queue *q);
+    void *driver_data;
+    blk_stats_t stats;
+} request_queue_t;
+
+/* Prepara a fila; kick() avisa o driver que há pedidos (pode rodar inline) */
+void blk_queue_init(request_queue_t *q, uint32_t max_sectors,
+                    void (*kick)(request_queue_t *q), void *driver_data);
+
+/* Entrada pelo submit_bio (junta ou cria pedido; pode dormir sem pedido livre) */
+void blk_queue_bio(request_queue_t *q, bio_t *bio);
+
+/* Segura/libera o despacho pela thread atual (aninhável); o último unplug
+ * da última thread chama kick() */
+void blk_plug(request_queue_t *q);
+void blk_unplug(request_queue_t *q);
+
+/* Solta de vez o plug da thread atual em q (unplugs pendentes viram no-op) */
+void blk_flush_plug(request_queue_t *q);
+
+/* Solta todos os plugs da thread atual; o scheduler chama antes de dormir */
+void blk_flush_thread_plugs(void);
+
+/* 1 se há pedido que o driver pode tirar agora */
+int blk_queue_pending(request_queue_t *q);
+
+/* Próximo pedido pelo elevador, ou NULL (vazia ou plugada) */
+request_t *blk_fetch_request(request_queue_t *q);
+
+/* Completa todos os bios do pedido e o devolve ao pool */
+void blk_end_request(request_queue_t *q, request_t *rq, int status);
+
+void blk_cursor_init(blk_cursor_t *c, bio_t *bio);
+
+/* Próximo trecho contíguo de até 'max' setores; avança o cursor */
+void *blk_cursor_next(blk_cursor_t *c, uint32_t max, uint32_t *n);
+
+/* Copia os dados do pedido para o bounce buffer contíguo (to_bounce = 1,
+ * antes de uma escrita) ou de volta para os bios (0, depois de uma leitura) */
+void blk_bounce_copy(request_t *rq, void *bounce, int to_bounce);
+
+/* ===================== DRIVERS COM SLOTS ===================== */
+
+/* Até 32 comandos em voo (bit por slot) e um pedido retido quando o
+ * device não tem recurso para ele agora (bounce, descritores, CID) */
+struct blk_slots;
+
+typedef struct blk_slot_ops {
+    /* Monta rq no slot. 1 = saiu; 0 = esperar (fica retido); -1 = erro;
+     * 2 = concluído sem ir ao device (ex.: FLUSH sem cache volátil) */
+    int (*start)(struct blk_slots *s, int slot, request_t *rq, void *ctx);
+    /* Próximo pedido e seu contexto; NULL = blk_fetch_request(s->queue) */
+    request_t *(*fetch)(struct blk_slots *s, void **ctx);
+    /* Pedido que termina sem slot; NULL = blk_end_request(s->queue) */
+    void (*end)(struct blk_slots *s, request_t *rq, void *ctx, int status);
+} blk_slot_ops_t;
+
+typedef struct blk_slots {
+    const blk_slot_ops_t *ops;
+    request_queue_t *queue;
+    void *driver;
+    uint32_t busy;                /* Bit por slot em voo */
+    uint32_t depth;               /* Slots usáveis (1..32) */
+    request_t *held;              /* Tirado da fila, esperando recurso */
+    void *held_ctx;
+    uint32_t max_inflight;
+} blk_slots_t;
+
+void blk_slots_init(blk_slots_t *s, const blk_slot_ops_t *ops,
+                    request_queue_t *q, void *driver, uint32_t depth);
+
+/* Enche os slots livres: o retido primeiro, depois a fila */
+void blk_slots_fill(blk_slots_t *s);
+
+/* Slot entrou / saiu de voo */
+void blk_slots_get(blk_slots_t *s, int slot);
+void blk_slots_put(blk_slots_t *s, int slot);
+
+/* 1 se há slot em voo, pedido retido ou pedido na fila */
+int blk_slots_busy(blk_slots_t *s);
+
+/* Laço de polling do driver: thread própria quando há scheduler, senão
+ * roda inline no kick até tudo terminar (boot) */
+typedef struct blk_poll_ops {
+    void (*service)(void *arg);   /* Recolhe o que terminou e reabastece */
+    int (*busy)(void *arg);       /* Algo em voo, retido ou na fila */
+    int (*inflight)(void *arg);   /* Algo em voo no device */
+} blk_poll_ops_t;
+
+typedef struct blk_poller {
+    const blk_poll_ops_t *ops;
+    void *arg;
+    thread_t *worker;
+    wait_queue_t wq;
+} blk_poller_t;
+
+void blk_poller_init(blk_poller_t *p, const blk_poll_ops_t *ops, void *arg);
+
+/* Cria a thread 'name' (só com scheduler; sem ela o kick roda inline) */
+void blk_poller_start(blk_poller_t *p, const char *name);
+
+/* Há trabalho: acorda a thread, ou despacha e espera aqui mesmo */
+void blk_poller_kick(blk_poller_t *p);
+
+/* Loga bios, pedidos, taxa de merge e tamanho médio do pedido */
+void blk_queue_dump(const char *name, request_queue_t *q);
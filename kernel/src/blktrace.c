@@ -0,0 +1,237 @@
+// blktrace.c - Anéis de eventos de I/O por CPU e dump pela serial
+#include <stdint.h>
+#include <stddef.h>
+#include "blktrace.h"
+#include "blockdev.h"
+#include "cpu.h"
+#include "lapic.h"
+#include "percpu.h"
+#include "pmm.h"
+#include "sched.h"
+#include "serial.h"
+#include "smp.h"
+#include "string.h"
+
+extern void klog(int level, const char *fmt, ...);
+extern int klog_console_claim(void);
+extern void klog_console_release(void);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+_Static_assert(sizeof(blktrace_event_t) == 32, "blktrace record is 32 bytes on the wire");
+
+#define BLKTRACE_RING_PAGES \
+    ((BLKTRACE_RING_EVENTS * sizeof(blktrace_event_t) + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE)
+
+/* Só o dono escreve (interrupções desligadas); o dump lê sem lock e pode
+ * pegar um registro sendo sobrescrito, o que num trace é aceitável */
+typedef struct blktrace_ring {
+    blktrace_event_t *ev;
+    uint64_t head;                    /* Eventos já gravados (não só os no anel) */
+} blktrace_ring_t;
+
+static blktrace_ring_t rings[SMP_MAX_CPUS];
+static uint32_t nrings;
+static volatile int enabled = 1;
+
+int blktrace_init(void) {
+    uint32_t n = smp_cpu_count();
+    if (n > SMP_MAX_CPUS) n = SMP_MAX_CPUS;
+
+    for (uint32_t i = 0; i < n; i++) {
+        rings[i].ev = pmalloc(BLKTRACE_RING_PAGES);
+        if (!rings[i].ev) {
+            klog(KLOG_ERROR, "[BLKTRACE] No memory for CPU %u ring", i);
+            return -1;
+        }
+        memset(rings[i].ev, 0, BLKTRACE_RING_PAGES * PMM_PAGE_SIZE);
+        rings[i].head = 0;
+    }
+    __atomic_store_n(&nrings, n, __ATOMIC_RELEASE);
+    klog(KLOG_INFO, "[BLKTRACE] %u events x %u CPU(s), %u KiB", BLKTRACE_RING_EVENTS, n,
+         (uint32_t)(n * BLKTRACE_RING_PAGES * 4));
+    return 0;
+}
+
+void blktrace_enable(int on) {
+    enabled = on;
+}
+
+void blktrace_clear(void) {
+    for (uint32_t i = 0; i < nrings; i++) __atomic_store_n(&rings[i].head, 0, __ATOMIC_RELAXED);
+}
+
+void blktrace_record(int action, blockdev_t *dev, int op, uint64_t lba, uint32_t sectors,
+                     int status, void *caller) {
+    if (!enabled) return;
+    uint32_t nr = __atomic_load_n(&nrings, __ATOMIC_ACQUIRE);
+    if (!nr) return;
+
+    uint64_t flags = irq_save();
+    uint32_t cpu = sched_active() ? smp_current_id() : 0;
+    if (cpu < nr) {
+        blktrace_ring_t *r = &rings[cpu];
+        blktrace_event_t *e = &r->ev[r->head & (BLKTRACE_RING_EVENTS - 1)];
+        e->tsc = rdtsc();
+        e->lba = lba;
+        e->caller = (uint64_t)caller;
+        e->sectors = sectors;
+        e->action = (uint8_t)action;
+        e->op = (uint8_t)op;
+        e->dev = dev ? (uint8_t)dev->id : 0xFF;
+        e->cpu_flags = (uint8_t)(cpu & 0x7F) | (status ? BLKTRACE_FLAG_ERROR : 0);
+        r->head++;
+    }
+    irq_restore(flags);
+}
+
+/* ===================== DUMP ===================== */
+
+static void bt_put_u64(uint64_t v, int base) {
+    char buf[24];
+    int n = 0;
+    do {
+        uint32_t d = (uint32_t)(v % base);
+        buf[n++] = (char)(d < 10 ? '0' + d : 'a' + d - 10);
+        v /= base;
+    } while (v);
+    while (n) serial_write_char(buf[--n]);
+}
+
+/* Cabeçalho comum: TSC por ms e a tabela de nomes dos devices */
+static void bt_dump_header(void) {
+    serial_write("BLKTRACE TSC ");
+    bt_put_u64(tsc_ticks_per_ms(), 10);
+    serial_write("\n");
+    for (int i = 0; i < blockdev_count(); i++) {
+        serial_write("BLKTRACE DEV ");
+        bt_put_u64((uint64_t)i, 10);
+        serial_write(" ");
+        serial_write(blockdev_get(i)->name);
+        serial_write("\n");
+    }
+}
+
+/* Intercala os anéis por TSC: 'pos[c]' é o próximo evento do CPU c */
+typedef struct bt_cursor {
+    uint64_t pos[SMP_MAX_CPUS];
+    uint64_t end[SMP_MAX_CPUS];
+} bt_cursor_t;
+
+static uint64_t bt_cursor_init(bt_cursor_t *c) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < nrings; i++) {
+        uint64_t head = __atomic_load_n(&rings[i].head, __ATOMIC_ACQUIRE);
+        c->end[i] = head;
+        c->pos[i] = head > BLKTRACE_RING_EVENTS ? head - BLKTRACE_RING_EVENTS : 0;
+        total += c->end[i] - c->pos[i];
+    }
+    return total;
+}
+
+static const blktrace_event_t *bt_cursor_next(bt_cursor_t *c) {
+    const blktrace_event_t *best = NULL;
+    uint32_t who = 0;
+    for (uint32_t i = 0; i < nrings; i++) {
+        if (c->pos[i] == c->end[i]) continue;
+        const blktrace_event_t *e = &rings[i].ev[c->pos[i] & (BLKTRACE_RING_EVENTS - 1)];
+        if (!best || e->tsc < best->tsc) {
+            best = e;
+            who = i;
+        }
+    }
+    if (best) c->pos[who]++;
+    return best;
+}
+
+static const char *bt_dev_name(uint8_t id) {
+    blockdev_t *d = id == 0xFF ? NULL : blockdev_get(id);
+    return d ? d->name : "-";
+}
+
+/* Copia os eventos, já intercalados, para páginas próprias. Gravar
+ * enquanto lê bagunça a ordem, então o trace fica pausado só durante a
+ * cópia; a saída lenta pela serial trabalha sobre a cópia. */
+static blktrace_event_t *bt_snapshot(uint64_t *count, size_t *pages) {
+    static bt_cursor_t cur;
+    int was = enabled;
+    enabled = 0;
+
+    uint64_t total = bt_cursor_init(&cur);
+    *pages = (total * sizeof(blktrace_event_t) + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE;
+    if (!*pages) *pages = 1;
+    blktrace_event_t *ev = pmalloc(*pages);
+    uint64_t n = 0;
+    const blktrace_event_t *e;
+    while (ev && n < total && (e = bt_cursor_next(&cur)) != NULL) ev[n++] = *e;
+
+    enabled = was;
+    *count = n;
+    return ev;
+}
+
+/* Um dump por vez, com o console só para ele: klog de outros CPUs é
+ * descartado (e contado) em vez de cair no meio dos registros */
+static void bt_dump(int binary) {
+    static const char ops[] = "RWF";
+
+    if (klog_console_claim() < 0) {
+        klog(KLOG_WARN, "[BLKTRACE] Another dump is in progress");
+        return;
+    }
+    uint64_t n;
+    size_t pages;
+    blktrace_event_t *ev = bt_snapshot(&n, &pages);
+    if (!ev) {
+        klog_console_release();
+        klog(KLOG_ERROR, "[BLKTRACE] No memory for the dump snapshot");
+        return;
+    }
+
+    bt_dump_header();
+    if (binary) {
+        serial_write("BLKTRACE BIN ");
+        bt_put_u64(n, 10);
+        serial_write("\n");
+        /* Bytes crus: serial_write converteria \n em \r\n */
+        const uint8_t *p = (const uint8_t *)ev;
+        for (size_t i = 0; i < n * sizeof(*ev); i++) serial_write_char((char)p[i]);
+        serial_write("\n");
+    } else {
+        for (uint64_t i = 0; i < n; i++) {
+            const blktrace_event_t *e = &ev[i];
+            serial_write("BT ");
+            bt_put_u64(e->cpu_flags & 0x7F, 10);
+            serial_write_char(' ');
+            bt_put_u64(e->tsc, 10);
+            serial_write_char(' ');
+            serial_write_char((char)e->action);
+            serial_write_char(' ');
+            serial_write(bt_dev_name(e->dev));
+            serial_write_char(' ');
+            serial_write_char(e->op <= BIO_FLUSH ? ops[e->op] : '?');
+            serial_write_char(' ');
+            bt_put_u64(e->lba, 10);
+            serial_write_char(' ');
+            bt_put_u64(e->sectors, 10);
+            serial_write((e->cpu_flags & BLKTRACE_FLAG_ERROR) ? " -1 0x" : " 0 0x");
+            bt_put_u64(e->caller, 16);
+            serial_write("\n");
+        }
+    }
+    serial_write("BLKTRACE END\n");
+
+    klog_console_release();
+    pfree(ev, pages);
+}
+
+void blktrace_dump_text(void) {
+    bt_dump(0);
+}
+
+void blktrace_dump_binary(void) {
+    bt_dump(1);
+}
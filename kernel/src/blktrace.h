@@ -0,0 +1,56 @@
+// blktrace.h - Trace de I/O de bloco em anéis por CPU
+//
+// Sempre compilado: cada evento é um registro de 32 bytes gravado no anel
+// do CPU atual com as interrupções desligadas por alguns ciclos (sem lock
+// global). O anel sobrescreve os mais antigos. Eventos:
+//   Q  bio entrou no submit_bio (LBA já do disco)
+//   I  pedido (bios juntados) entregue ao driver
+//   C  bio completado (status no registro)
+//   H  bread achou o bloco no cache (ou esperando o read-ahead)
+//   M  bread não achou: vai virar um Q
+// 'caller' é o endereço de retorno de quem chamou a entrada rastreada
+// (submit_bio, blk_fetch_request ou bread). O dump sai pela serial em texto
+// ou binário (registros crus); scripts/blktrace.py resume os dois.
+#pragma once
+#include <stdint.h>
+#include "blockdev.h"
+
+#define BLKTRACE_RING_EVENTS 2048     /* Por CPU; potência de 2 */
+
+#define BLKTRACE_QUEUE    'Q'
+#define BLKTRACE_ISSUE    'I'
+#define BLKTRACE_COMPLETE 'C'
+#define BLKTRACE_HIT      'H'
+#define BLKTRACE_MISS     'M'
+
+#define BLKTRACE_FLAG_ERROR 0x80      /* Em cpu_flags: completado com erro */
+
+/* Formato do dump binário (little-endian, como na memória) */
+typedef struct blktrace_event {
+    uint64_t tsc;
+    uint64_t lba;
+    uint64_t caller;
+    uint32_t sectors;
+    uint8_t action;                   /* BLKTRACE_QUEUE... */
+    uint8_t op;                       /* BIO_READ / BIO_WRITE / BIO_FLUSH */
+    uint8_t dev;                      /* blockdev_t.id */
+    uint8_t cpu_flags;                /* CPU (bits 0-6) | BLKTRACE_FLAG_ERROR */
+} __attribute__((packed)) blktrace_event_t;
+
+/* Aloca os anéis (depois do smp_init); antes disso nada é gravado */
+int blktrace_init(void);
+
+/* Liga/desliga a gravação (começa ligada) e esvazia os anéis */
+void blktrace_enable(int on);
+void blktrace_clear(void);
+
+/* Grava um evento; 'dev' pode ser NULL (dev 0xFF) */
+void blktrace_record(int action, blockdev_t *dev, int op, uint64_t lba, uint32_t sectors,
+                     int status, void *caller);
+
+/* Dump pela serial, eventos de todos os CPUs em ordem de TSC:
+ * texto:   "BT <cpu> <tsc> <ação> <dev> <R|W|F> <lba> <setores> <status> <caller>"
+ * binário: "BLKTRACE BIN <n>\n" + n registros + "\nBLKTRACE END\n"
+ * Os dois começam com "BLKTRACE TSC <ticks/ms>" e "BLKTRACE DEV <id> <nome>". */
+void blktrace_dump_text(void);
+void blktrace_dump_binary(void);
@@ -0,0 +1,422 @@
+// blockdev.c - Submissão e completion de bios, wrappers síncronos
+#include "blockdev.h"
+#include "blkqueue.h"
+#include "waitqueue.h"
+#include "cpu.h"
+#include "lapic.h"
+#include "pmm.h"
+#include "part.h"
+#include "blktrace.h"
+#include "string.h"
+
+extern void klog(int level, const char *fmt, ...);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+static blockdev_t *registry[BLOCKDEV_MAX];
+static int nregistered;
+static blockdev_t *root_dev;
+
+static void iostat_start(blockdev_t *dev, uint64_t now);
+static void iostat_done(blockdev_t *dev, const bio_t *bio, uint64_t now);
+static void iostat_cancel(blockdev_t *dev, uint64_t now);
+
+/* ===================== BIO ===================== */
+
+void bio_init(bio_t *bio, int op, uint64_t lba, bio_end_fn end_io, void *private) {
+    *bio = (bio_t){ .op = op, .lba = lba, .end_io = end_io, .private = private };
+}
+
+int bio_add_seg(bio_t *bio, void *buf, uint32_t sectors) {
+    if (bio->seg_count >= BIO_MAX_SEGS || sectors == 0) return -1;
+    bio->segs[bio->seg_count].buf = buf;
+    bio->segs[bio->seg_count].sectors = sectors;
+    bio->seg_count++;
+    return 0;
+}
+
+uint32_t bio_sectors(const bio_t *bio) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < bio->seg_count; i++) n += bio->segs[i].sectors;
+    return n;
+}
+
+int submit_bio(blockdev_t *dev, bio_t *bio) {
+    if (!dev || (!dev->submit && !dev->queue && !dev->parent) || !bio) return -1;
+
+    if (bio->op == BIO_READ || bio->op == BIO_WRITE) {
+        uint32_t n = bio_sectors(bio);
+        if (n == 0) return -1;
+        if (dev->sectors && (bio->lba >= dev->sectors || n > dev->sectors - bio->lba)) {
+            return -1;
+        }
+    } else if (bio->op != BIO_FLUSH) {
+        return -1;
+    }
+
+    /* Partição: mesmo bio, LBA do disco (desfeito se o driver recusar) */
+    uint64_t orig_lba = bio->lba;
+    blockdev_t *orig_dev = bio->dev;
+    blockdev_t *orig_part = bio->part;
+    blockdev_t *part = dev->parent ? dev : NULL;
+    while (dev->parent) {
+        bio->lba += dev->start;
+        dev = dev->parent;
+    }
+
+    bio->dev = dev;
+    bio->part = part;
+    bio->status = 0;
+    bio->next = NULL;
+
+    /* Conta antes de entregar: o driver pode completar aqui mesmo */
+    bio->start_tsc = rdtsc();
+    if (part) iostat_start(part, bio->start_tsc);
+    iostat_start(dev, bio->start_tsc);
+
+    void *caller = __builtin_return_address(0);
+    uint32_t n = bio_sectors(bio);
+    blktrace_record(BLKTRACE_QUEUE, dev, bio->op, bio->lba, n, 0, caller);
+
+    if (dev->queue) {
+        blk_queue_bio(dev->queue, bio);
+        return 0;
+    }
+    /* Sem fila o bio vai direto: entregue ao driver agora */
+    blktrace_record(BLKTRACE_ISSUE, dev, bio->op, bio->lba, n, 0, caller);
+    if (dev->submit(dev, bio) < 0) {
+        uint64_t now = rdtsc();
+        if (part) iostat_cancel(part, now);
+        iostat_cancel(dev, now);
+        bio->start_tsc = 0;
+        bio->lba = orig_lba;
+        bio->dev = orig_dev;
+        bio->part = orig_part;
+        return -1;
+    }
+    return 0;
+}
+
+void bio_endio(bio_t *bio, int status) {
+    bio->status = status;
+    if (bio->start_tsc) {
+        blktrace_record(BLKTRACE_COMPLETE, bio->dev, bio->op, bio->lba, bio_sectors(bio),
+                        status, __builtin_return_address(0));
+        uint64_t now = rdtsc();
+        if (bio->part) iostat_done(bio->part, bio, now);
+        iostat_done(bio->dev, bio, now);
+        bio->start_tsc = 0;
+    }
+    if (bio->end_io) bio->end_io(bio);
+}
+
+/* ===================== ESPERA SÍNCRONA ===================== */
+
+/* Disco que atende o device (ele mesmo, se não é partição) */
+static blockdev_t *blockdev_whole(blockdev_t *dev) {
+    while (dev && dev->parent) dev = dev->parent;
+    return dev;
+}
+
+static void bio_wait_end(bio_t *bio) {
+    complete((completion_t *)bio->private);
+}
+
+int submit_bio_wait(blockdev_t *dev, bio_t *bio) {
+    completion_t done;
+    completion_init(&done);
+
+    bio->end_io = bio_wait_end;
+    bio->private = &done;
+    if (submit_bio(dev, bio) < 0) return -1;
+
+    /* Dormir com a fila plugada travaria o próprio pedido */
+    blockdev_t *whole = blockdev_whole(dev);
+    if (whole->queue) blk_flush_plug(whole->queue);
+    wait_for_completion(&done);
+    return bio->status;
+}
+
+static int blockdev_rw(blockdev_t *dev, int op, uint64_t lba, uint32_t count, void *buf) {
+    bio_t bio;
+    bio_init(&bio, op, lba, NULL, NULL);
+    if (bio_add_seg(&bio, buf, count) < 0) return -1;
+    return submit_bio_wait(dev, &bio);
+}
+
+int blockdev_read(blockdev_t *dev, uint64_t lba, uint32_t count, void *buf) {
+    return blockdev_rw(dev, BIO_READ, lba, count, buf);
+}
+
+int blockdev_write(blockdev_t *dev, uint64_t lba, uint32_t count, const void *buf) {
+    return blockdev_rw(dev, BIO_WRITE, lba, count, (void *)buf);
+}
+
+int blockdev_flush(blockdev_t *dev) {
+    bio_t bio;
+    bio_init(&bio, BIO_FLUSH, 0, NULL, NULL);
+    return submit_bio_wait(dev, &bio);
+}
+
+void blockdev_plug(blockdev_t *dev) {
+    dev = blockdev_whole(dev);
+    if (dev && dev->queue) blk_plug(dev->queue);
+}
+
+void blockdev_unplug(blockdev_t *dev) {
+    dev = blockdev_whole(dev);
+    if (dev && dev->queue) blk_unplug(dev->queue);
+}
+
+void blockdev_dump_stats(blockdev_t *dev) {
+    dev = blockdev_whole(dev);
+    if (dev && dev->queue) blk_queue_dump(dev->name, dev->queue);
+}
+
+/* ===================== REGISTRO ===================== */
+
+/* Registro só muda no boot (drivers e varredura de partições); depois é
+ * só leitura */
+int blockdev_register(blockdev_t *dev) {
+    if (!dev || !dev->name || nregistered >= BLOCKDEV_MAX) return -1;
+    if (blockdev_find(dev->name)) {
+        klog(KLOG_WARN, "[BLK] Duplicate device name %s", dev->name);
+        return -1;
+    }
+    dev->iostat.since_tsc = dev->iostat.last_tsc = rdtsc();
+    dev->id = nregistered;
+    registry[nregistered++] = dev;
+    return 0;
+}
+
+int blockdev_add_disk(blockdev_t *dev) {
+    if (blockdev_register(dev) < 0) return -1;
+    klog(KLOG_INFO, "[BLK] %s: %u MiB", dev->name, (uint32_t)(dev->sectors / 2048));
+    dev->partitions = part_scan(dev);
+    return 0;
+}
+
+int blockdev_count(void) {
+    return nregistered;
+}
+
+blockdev_t *blockdev_get(int idx) {
+    if (idx < 0 || idx >= nregistered) return NULL;
+    return registry[idx];
+}
+
+blockdev_t *blockdev_find(const char *name) {
+    for (int i = 0; i < nregistered; i++) {
+        if (strcmp(registry[i]->name, name) == 0) return registry[i];
+    }
+    return NULL;
+}
+
+blockdev_t *blockdev_root(void) {
+    return root_dev;
+}
+
+void blockdev_set_root(blockdev_t *dev) {
+    root_dev = dev;
+}
+
+void blockdev_list(void) {
+    for (int i = 0; i < nregistered; i++) {
+        blockdev_t *d = registry[i];
+        if (d->parent) {
+            klog(KLOG_INFO, "[BLK]   %s: %u MiB at LBA %u of %s%s", d->name,
+                 (uint32_t)(d->sectors / 2048), (uint32_t)d->start, d->parent->name,
+                 d == root_dev ? " (root)" : "");
+        } else {
+            klog(KLOG_INFO, "[BLK] %s: %u MiB, %d partition(s)%s", d->name,
+                 (uint32_t)(d->sectors / 2048), d->partitions, d == root_dev ? " (root)" : "");
+        }
+    }
+}
+
+/* ===================== IOSTAT ===================== */
+
+/* Acumula o tempo desde a última mudança de profundidade; lock preso */
+static void iostat_advance(blk_iostat_t *s, uint64_t now) {
+    if (s->inflight && now > s->last_tsc) {
+        uint64_t dt = now - s->last_tsc;
+        s->busy_tsc += dt;
+        s->depth_tsc += dt * s->inflight;
+    }
+    s->last_tsc = now;
+}
+
+static uint64_t iostat_tsc_to_us(uint64_t tsc) {
+    uint64_t per_ms = tsc_ticks_per_ms();
+    return per_ms ? tsc * 1000 / per_ms : 0;
+}
+
+/* Balde do histograma: floor(log2(us)), saturado no último */
+static int iostat_bucket(uint64_t tsc) {
+    uint64_t us = iostat_tsc_to_us(tsc);
+    int b = 0;
+    while ((us >>= 1) && b < IOSTAT_HIST_BUCKETS - 1) b++;
+    return b;
+}
+
+static void iostat_start(blockdev_t *dev, uint64_t now) {
+    blk_iostat_t *s = &dev->iostat;
+    uint64_t flags = spinlock_lock_irqsave(&s->lock);
+    iostat_advance(s, now);
+    if (++s->inflight > s->max_inflight) s->max_inflight = s->inflight;
+    spinlock_unlock_irqrestore(&s->lock, flags);
+}
+
+static void iostat_cancel(blockdev_t *dev, uint64_t now) {
+    blk_iostat_t *s = &dev->iostat;
+    uint64_t flags = spinlock_lock_irqsave(&s->lock);
+    iostat_advance(s, now);
+    if (s->inflight) s->inflight--;
+    spinlock_unlock_irqrestore(&s->lock, flags);
+}
+
+static void iostat_done(blockdev_t *dev, const bio_t *bio, uint64_t now) {
+    blk_iostat_t *s = &dev->iostat;
+    uint64_t dt = now - bio->start_tsc;
+    int bucket = iostat_bucket(dt);
+
+    uint64_t flags = spinlock_lock_irqsave(&s->lock);
+    iostat_advance(s, now);
+    if (s->inflight) s->inflight--;
+    if (bio->status) s->errors++;
+    if (bio->op == BIO_FLUSH) {
+        s->flushes++;
+    } else {
+        int w = bio->op == BIO_WRITE;
+        s->ios[w]++;
+        s->sectors[w] += bio_sectors(bio);
+        s->service_tsc[w] += dt;
+        if (dt > s->max_tsc[w]) s->max_tsc[w] = dt;
+        s->hist[w][bucket]++;
+    }
+    spinlock_unlock_irqrestore(&s->lock, flags);
+}
+
+void blockdev_account_timeout(blockdev_t *dev) {
+    if (!dev) return;
+    uint64_t flags = spinlock_lock_irqsave(&dev->iostat.lock);
+    dev->iostat.timeouts++;
+    spinlock_unlock_irqrestore(&dev->iostat.lock, flags);
+}
+
+/* Só os baldes com contagem: "<limite inferior em us>us:<n>" */
+static void iostat_dump_hist(const char *name, const char *dir, const blk_iostat_t *s, int w) {
+    char line[IOSTAT_HIST_BUCKETS * 20];
+    char *p = line;
+
+    for (int b = 0; b < IOSTAT_HIST_BUCKETS; b++) {
+        if (!s->hist[w][b]) continue;
+        char num[24];
+        uint64_t v[2] = { 1ull << b, s->hist[w][b] };
+        for (int k = 0; k < 2; k++) {
+            int n = 0;
+            do { num[n++] = (char)('0' + v[k] % 10); v[k] /= 10; } while (v[k]);
+            while (n) *p++ = num[--n];
+            if (k == 0) { *p++ = 'u'; *p++ = 's'; *p++ = ':'; }
+        }
+        *p++ = ' ';
+    }
+    *p = '\0';
+
+    klog(KLOG_INFO, "[IOSTAT] %s %s: avg %u us, max %u us | %s", name, dir,
+         (uint32_t)iostat_tsc_to_us(s->service_tsc[w] / s->ios[w]),
+         (uint32_t)iostat_tsc_to_us(s->max_tsc[w]), line);
+}
+
+void blockdev_iostat_dump(blockdev_t *dev) {
+    blk_iostat_t s;
+    uint64_t now = rdtsc();
+
+    uint64_t flags = spinlock_lock_irqsave(&dev->iostat.lock);
+    iostat_advance(&dev->iostat, now);
+    s = dev->iostat;
+    spinlock_unlock_irqrestore(&dev->iostat.lock, flags);
+
+    uint64_t window = now - s.since_tsc;
+    uint32_t util = window ? (uint32_t)(s.busy_tsc * 100 / window) : 0;
+    uint32_t aqu = window ? (uint32_t)(s.depth_tsc * 100 / window) : 0;   /* Centésimos */
+    /* Merges acontecem na fila, que é do disco */
+    uint32_t merges = (!dev->parent && dev->queue) ? (uint32_t)dev->queue->stats.merges : 0;
+
+    klog(KLOG_INFO, "[IOSTAT] %s: %u reads %u KiB, %u writes %u KiB, %u flushes, %u merges",
+         dev->name, (uint32_t)s.ios[0], (uint32_t)(s.sectors[0] / 2),
+         (uint32_t)s.ios[1], (uint32_t)(s.sectors[1] / 2), (uint32_t)s.flushes, merges);
+    klog(KLOG_INFO, "[IOSTAT] %s: depth %u now, %u max, avg %u.%u%u, util %u%%, %u errors, %u timeouts",
+         dev->name, s.inflight, s.max_inflight, aqu / 100, aqu / 10 % 10, aqu % 10, util,
+         (uint32_t)s.errors, (uint32_t)s.timeouts);
+    if (s.ios[0]) iostat_dump_hist(dev->name, "read", &s, 0);
+    if (s.ios[1]) iostat_dump_hist(dev->name, "write", &s, 1);
+}
+
+void blockdev_iostat_dump_all(void) {
+    for (int i = 0; i < nregistered; i++) blockdev_iostat_dump(registry[i]);
+}
+
+void blockdev_iostat_reset_all(void) {
+    uint64_t now = rdtsc();
+    for (int i = 0; i < nregistered; i++) {
+        blk_iostat_t *s = &registry[i]->iostat;
+        uint64_t flags = spinlock_lock_irqsave(&s->lock);
+        uint32_t inflight = s->inflight;
+        spinlock_t lock = s->lock;
+        *s = (blk_iostat_t){ .lock = lock, .inflight = inflight, .max_inflight = inflight,
+                             .last_tsc = now, .since_tsc = now };
+        spinlock_unlock_irqrestore(&s->lock, flags);
+    }
+}
+
+/* ===================== BENCHMARK ===================== */
+
+#define BLK_BENCH_CHUNK  128            /* Setores por bio (64 KiB) */
+#define BLK_BENCH_DEPTH  8              /* Bios em voo */
+
+static void blockdev_bench_end(bio_t *bio) {
+    complete((completion_t *)bio->private);
+}
+
+void blockdev_benchmark(blockdev_t *dev, uint32_t sectors) {
+    static bio_t bios[BLK_BENCH_DEPTH];
+    static completion_t done[BLK_BENCH_DEPTH];
+    const uint32_t pages = BLK_BENCH_DEPTH * BLK_BENCH_CHUNK * 512 / PMM_PAGE_SIZE;
+
+    if (!dev) return;
+    if (dev->sectors && sectors > dev->sectors) sectors = (uint32_t)dev->sectors;
+    uint8_t *buf = pmalloc(pages);
+    if (!buf) return;
+
+    int errors = 0;
+    uint64_t t0 = rdtsc();
+    for (uint32_t lba = 0; lba < sectors; ) {
+        int n = 0;
+        for (; n < BLK_BENCH_DEPTH && lba < sectors; n++) {
+            uint32_t k = sectors - lba < BLK_BENCH_CHUNK ? sectors - lba : BLK_BENCH_CHUNK;
+            completion_init(&done[n]);
+            bio_init(&bios[n], BIO_READ, lba, blockdev_bench_end, &done[n]);
+            bio_add_seg(&bios[n], buf + (size_t)n * BLK_BENCH_CHUNK * 512, k);
+            if (submit_bio(dev, &bios[n]) < 0) {
+                bios[n].status = -1;
+                complete(&done[n]);
+            }
+            lba += k;
+        }
+        for (int i = 0; i < n; i++) {
+            wait_for_completion(&done[i]);
+            if (bios[i].status != 0) errors++;
+        }
+    }
+    uint64_t ms = (rdtsc() - t0) / tsc_ticks_per_ms();
+    pfree(buf, pages);
+
+    klog(errors ? KLOG_WARN : KLOG_INFO,
+         "[BENCH] %s: %u KiB sequential read in %u ms (%u KiB/s, %u x 64 KiB in flight), %d errors",
+         dev->name, sectors / 2, (uint32_t)ms, ms ? (uint32_t)((uint64_t)sectors / 2 * 1000 / ms) : 0,
+         BLK_BENCH_DEPTH, errors);
+}
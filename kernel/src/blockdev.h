@@ -1,12 +1,169 @@
+// blockdev.h - Camada de blocos: dispositivos e pedidos (bio) assíncronos
+//
+// Um bio descreve um pedido contíguo no disco (LBA de 64 bits) espalhado em
+// até BIO_MAX_SEGS buffers na memória. O driver recebe o bio por
+// dev->submit, executa quando puder e chama bio_endio(); o end_io do dono
+// roda então no contexto do driver (thread do canal ou IRQ).
+//
+// Quem só quer ler/escrever e esperar usa blockdev_read/write/flush, que
+// montam um bio de um segmento e dormem até ele completar.
+//
+// Os drivers registram cada disco com blockdev_add_disk(): ele entra no
+// registro pelo nome e suas partições viram blockdevs filhos ("ata0p1"),
+// cujos bios são remapeados para o disco em submit_bio().
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#include "spinlock.h"
+
+#define BIO_READ   0
+#define BIO_WRITE  1
+#define BIO_FLUSH  2              /* Sem dados: esvazia o cache do device */
+
+#define BIO_MAX_SEGS 16
+
+#define BLOCKDEV_MAX 32           /* Discos + partições no registro */
+
+#define IOSTAT_HIST_BUCKETS 24    /* Serviço em us: balde i = [2^i, 2^(i+1)) */
+
+struct blockdev;
+struct bio;
+struct request_queue;
+
+typedef void (*bio_end_fn)(struct bio *bio);
+
+/* Segmento de scatter-gather: 'sectors' setores a partir de 'buf' */
+typedef struct bio_seg {
+    void *buf;
+    uint32_t sectors;
+} bio_seg_t;
+
+typedef struct bio {
+    struct blockdev *dev;
+    int op;                       /* BIO_READ / BIO_WRITE / BIO_FLUSH */
+    uint64_t lba;                 /* Primeiro setor (contíguo no disco) */
+    uint32_t seg_count;
+    bio_seg_t segs[BIO_MAX_SEGS];
+    int status;                   /* 0 ou -1, válido dentro do end_io */
+    bio_end_fn end_io;
+    void *private;                /* Do dono do bio (end_io) */
+    uint64_t start_tsc;           /* submit_bio (iostat); 0 = não contado */
+    struct blockdev *part;        /* Partição por onde entrou, ou NULL */
+    struct bio *next;             /* Fila interna do driver */
+} bio_t;
+
+/* Contabilidade estilo iostat, por device (partição e disco contam o
+ * mesmo bio). Índice [0] leitura, [1] escrita; tempo de serviço do
+ * submit_bio até o bio_endio, medido pelo TSC. */
+typedef struct blk_iostat {
+    spinlock_t lock;
+    uint64_t ios[2];              /* Bios completados */
+    uint64_t sectors[2];
+    uint64_t flushes;
+    uint64_t errors;              /* Completados com status != 0 */
+    uint64_t timeouts;            /* Esperas do driver que estouraram o prazo */
+    uint64_t service_tsc[2];      /* Soma dos tempos de serviço */
+    uint64_t max_tsc[2];
+    uint32_t hist[2][IOSTAT_HIST_BUCKETS];
+    uint32_t inflight;            /* Profundidade atual */
+    uint32_t max_inflight;
+    uint64_t busy_tsc;            /* Tempo com algo em voo (%util) */
+    uint64_t depth_tsc;           /* Integral de inflight no tempo (aqu-sz) */
+    uint64_t last_tsc;            /* Última mudança de inflight */
+    uint64_t since_tsc;           /* Início da janela (registro ou reset) */
+} blk_iostat_t;
 
 typedef struct blockdev {
-    int (*read)(uint32_t lba, uint32_t count, void *buf);
-    int (*write)(uint32_t lba, uint32_t count, const void *buf);
-    int (*flush)(void);
+    const char *name;
     uint32_t sector_size;
+    uint64_t sectors;             /* Capacidade (0 = desconhecida) */
+    void *priv;                   /* Estado do driver (drive, porta...) */
+
+    /* Aceita o bio e o completa depois com bio_endio(). 0 = aceito;
+     * -1 = recusado, e nesse caso end_io não é chamado. */
+    int (*submit)(struct blockdev *dev, bio_t *bio);
+
+    /* Com fila, os bios passam por ela (merge/elevador) e submit é ignorado */
+    struct request_queue *queue;
+
+    /* Partição: 'sectors' setores a partir de 'start' no disco pai */
+    struct blockdev *parent;
+    uint64_t start;
+    int partitions;               /* Disco: quantas partições tem */
+    int id;                       /* Posição no registro (blktrace) */
+
+    blk_iostat_t iostat;
 } blockdev_t;
 
-extern blockdev_t *g_root_blockdev;
+/* ===================== BIO ===================== */
+
+/* Zera o bio e define operação, LBA e callback */
+void bio_init(bio_t *bio, int op, uint64_t lba, bio_end_fn end_io, void *private);
+
+/* Acrescenta um segmento; -1 se já tem BIO_MAX_SEGS */
+int bio_add_seg(bio_t *bio, void *buf, uint32_t sectors);
+
+/* Total de setores do bio */
+uint32_t bio_sectors(const bio_t *bio);
+
+/* Valida o intervalo e entrega à fila do device ou ao driver; em -1 o bio
+ * volta como veio (LBA e device da partição) */
+int submit_bio(blockdev_t *dev, bio_t *bio);
+
+/* Chamado pelo driver quando o bio termina */
+void bio_endio(bio_t *bio, int status);
+
+/* submit_bio + espera; devolve o status do bio */
+int submit_bio_wait(blockdev_t *dev, bio_t *bio);
+
+/* ===================== API SÍNCRONA ===================== */
+
+int blockdev_read(blockdev_t *dev, uint64_t lba, uint32_t count, void *buf);
+int blockdev_write(blockdev_t *dev, uint64_t lba, uint32_t count, const void *buf);
+int blockdev_flush(blockdev_t *dev);
+
+/* Segura o despacho da fila do device durante uma rajada de bios da thread
+ * atual (solto sozinho se ela dormir antes do unplug) */
+void blockdev_plug(blockdev_t *dev);
+void blockdev_unplug(blockdev_t *dev);
+
+/* Estatísticas da fila do device (merge ratio, tamanho médio); numa
+ * partição, as do disco */
+void blockdev_dump_stats(blockdev_t *dev);
+
+/* Lê 'sectors' setores do começo do device em bios de 64 KiB, vários em
+ * voo, e loga a vazão (para comparar drivers no mesmo disco) */
+void blockdev_benchmark(blockdev_t *dev, uint32_t sectors);
+
+/* ===================== REGISTRO ===================== */
+
+/* Põe o device no registro (nome único); 0 ou -1 */
+int blockdev_register(blockdev_t *dev);
+
+/* Registra um disco inteiro e cada partição dele; 0 ou -1 */
+int blockdev_add_disk(blockdev_t *dev);
+
+int blockdev_count(void);
+
+/* Device 'idx' na ordem de registro (disco, depois as partições dele) */
+blockdev_t *blockdev_get(int idx);
+blockdev_t *blockdev_find(const char *name);
+
+/* Disco/partição do volume raiz (kmain escolhe no boot) */
+blockdev_t *blockdev_root(void);
+void blockdev_set_root(blockdev_t *dev);
+
+/* Loga o registro: nome, tamanho, pai e offset */
+void blockdev_list(void);
+
+/* ===================== IOSTAT ===================== */
+
+/* Driver: uma espera pelo device estourou o prazo (vira contador) */
+void blockdev_account_timeout(blockdev_t *dev);
+
+/* Loga contadores, profundidade, %util e histograma de serviço */
+void blockdev_iostat_dump(blockdev_t *dev);
+void blockdev_iostat_dump_all(void);
+
+/* Zera os contadores de todos (começo de um benchmark) */
+void blockdev_iostat_reset_all(void);
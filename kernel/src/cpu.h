@@ -0,0 +1,50 @@
+// cpu.h - Helpers de baixo nível x86_64 (MSRs, TSC, flags de interrupção)
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/* MSRs usados pelo kernel */
+#define MSR_IA32_APIC_BASE   0x1B
+#define MSR_IA32_FS_BASE     0xC0000100
+#define MSR_IA32_GS_BASE     0xC0000101
+#define MSR_IA32_KERNEL_GS   0xC0000102
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+    asm volatile("wrmsr" : : "c"(msr), "a"((uint32_t)val), "d"((uint32_t)(val >> 32)));
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Dica para o CPU dentro de spin loops */
+static inline void cpu_relax(void) {
+    asm volatile("pause" ::: "memory");
+}
+
+/* Salva RFLAGS e desabilita interrupções; devolve as flags anteriores */
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+    asm volatile("pushfq; popq %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags) {
+    if (flags & 0x200) {
+        asm volatile("sti" ::: "memory");
+    }
+}
+
+static inline bool irq_enabled(void) {
+    uint64_t flags;
+    asm volatile("pushfq; popq %0" : "=r"(flags));
+    return (flags & 0x200) != 0;
+}
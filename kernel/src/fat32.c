@@ -2,7 +2,7 @@
 #include "fat32.h"
 #include "string.h"
 #include "kmalloc.h"
-#include "spinlock.h"
+#include "bcache.h"
 
 extern void klog(int level, const char *fmt, ...);
 
@@ -26,22 +26,9 @@ extern void klog(int level, const char *fmt, ...);
 static const char DOT_NAME[11]      = ".         ";
 static const char DOTDOT_NAME[11]   = "..        ";
 
-/* ===================== ESTRUTURAS LOCAIS ===================== */
-typedef struct {
-    fat32_fs_t *fs;
-    uint8_t sector_buf[SECTOR_SIZE];
-    spinlock_t lock;
-} fat32_cache_t;
-
 /* ===================== VARIÁVEIS GLOBAIS ===================== */
 static fat32_file_t open_files[MAX_OPEN_FILES];
-static fat32_cache_t cache;
-
-/* ===================== FUNÇÕES AUXILIARES ===================== */
-static inline void spinlock_init(spinlock_t *lock) {
-    lock->lock = 0;
-    lock->cpu_id = 0;
-}
+static int fat32_ra_enabled = 1;
 
 static int validate_fs(fat32_fs_t *fs) {
     if (!fs || !fs->dev) return -1;
@@ -52,19 +39,40 @@ static int validate_fs(fat32_fs_t *fs) {
     return 0;
 }
 
-/* ===================== CACHE THREAD-SAFE ===================== */
+/* ===================== CACHE (BCACHE) ===================== */
+/* Setores passam pelo cache de blocos: FAT e diretórios quentes ficam na RAM.
+ * Escritas só sujam o buffer; o disco é atualizado pelo write-back. */
 static int cache_read_sector(fat32_fs_t *fs, uint32_t sector, uint8_t *buf) {
-    spinlock_lock(&cache.lock);
-    int ret = fs->dev->read(sector, 1, buf);
-    spinlock_unlock(&cache.lock);
-    return ret;
+    buf_t *b = bread(fs->dev, sector);
+    if (!b) return -1;
+    memcpy(buf, b->data, SECTOR_SIZE);
+    brelse(b);
+    return 0;
+}
+
+/* Copia 'len' bytes para o setor no cache a partir de 'off' e o marca sujo.
+ * Setor inteiro não é lido antes; parcial ilegível começa zerado. */
+static int cache_update_sector(fat32_fs_t *fs, uint32_t sector, uint32_t off,
+                               const void *src, uint32_t len) {
+    buf_t *b = (len == SECTOR_SIZE) ? NULL : bread(fs->dev, sector);
+    int fresh = !b;
+    if (!b) b = bget(fs->dev, sector);
+    if (!b) return -1;
+    buf_lock(b);
+    if (fresh && len != SECTOR_SIZE) memset(b->data, 0, SECTOR_SIZE);
+    memcpy(b->data + off, src, len);
+    bdirty(b);
+    buf_unlock(b);
+    brelse(b);
+    return 0;
 }
 
 static int cache_write_sector(fat32_fs_t *fs, uint32_t sector, uint8_t *buf) {
-    spinlock_lock(&cache.lock);
-    int ret = fs->dev->write(sector, 1, buf);
-    spinlock_unlock(&cache.lock);
-    return ret;
+    return cache_update_sector(fs, sector, 0, buf, SECTOR_SIZE);
+}
+
+int fat32_read_sector(fat32_fs_t *fs, uint32_t sector, uint8_t *buf) {
+    return cache_read_sector(fs, sector, buf);
 }
 
 /* ===================== FAT OPERATIONS ===================== */
@@ -87,16 +95,20 @@ static int write_fat_entry(fat32_fs_t *fs, uint32_t cluster, uint32_t value) {
     uint32_t fat_sector = fs->fat_start + (fat_offset / SECTOR_SIZE);
     uint32_t entry_offset = fat_offset % SECTOR_SIZE;
     
-    uint8_t sector[SECTOR_SIZE];
-    if (cache_read_sector(fs, fat_sector, sector) != 0) {
+    /* Altera a entrada direto no buffer do cache */
+    buf_t *b = bread(fs->dev, fat_sector);
+    if (!b) {
         return -1;
     }
     
-    uint32_t *entry = (uint32_t*)(sector + entry_offset);
+    buf_lock(b);
+    uint32_t *entry = (uint32_t*)(b->data + entry_offset);
     uint32_t old = *entry;
     *entry = (value & 0x0FFFFFFF) | (old & 0xF0000000);
-    
-    return cache_write_sector(fs, fat_sector, sector);
+    bdirty(b);
+    buf_unlock(b);
+    brelse(b);
+    return 0;
 }
 
 uint32_t fat32_next_cluster(fat32_fs_t *fs, uint32_t cluster) {
@@ -337,14 +349,14 @@ int fat32_resolve(fat32_fs_t *fs, const char *path,
 
 /* ===================== PUBLIC API ===================== */
 fat32_fs_t *fat32_mount(blockdev_t *dev) {
-    if (!dev || !dev->read) {
+    if (!dev) {
         return NULL;
     }
     
     uint8_t sector[512];
     uint32_t fat32_lba = 0;
     /* 1. PRIMEIRO: Tenta ler como disco FAT32 bruto (setor 0) */
-    if (dev->read(0, 1, sector) != 0) {
+    if (blockdev_read(dev, 0, 1, sector) != 0) {
         klog(KLOG_ERROR, "[FAT32] Failed to read sector 0");
         return NULL;
     }
@@ -403,7 +415,7 @@ fat32_fs_t *fat32_mount(blockdev_t *dev) {
                     klog(KLOG_INFO, "[FAT32] Found FAT32 partition at LBA %u", fat32_lba);
                     
                     /* Lê boot sector da partição */
-                    if (dev->read(fat32_lba, 1, sector) != 0) {
+                    if (blockdev_read(dev, fat32_lba, 1, sector) != 0) {
                         klog(KLOG_ERROR, "[FAT32] Failed to read partition boot sector");
                         return NULL;
                     }
@@ -568,6 +580,71 @@ fat32_file_t *fat32_open(fat32_fs_t *fs, const char *path, const char *mode) {
     return file;
 }
 
+/* ===================== READ-AHEAD ===================== */
+
+void fat32_set_readahead(int on) {
+    fat32_ra_enabled = on;
+}
+
+static uint32_t fat32_ra_clusters(fat32_fs_t *fs, uint32_t bytes) {
+    uint32_t n = bytes / fs->bytes_per_cluster;
+    return n ? n : 1;
+}
+
+/* Leitura não continua de onde a anterior parou: encolhe a janela */
+static void fat32_ra_seek(fat32_file_t *file) {
+    file->ra_window /= 2;
+    file->ra_end = 0;
+}
+
+/* Entrou no cluster 'cluster' (índice file_pos / bytes_per_cluster) numa
+ * leitura sequencial: mantém 'ra_window' clusters pedidos à frente. Dentro
+ * da janela já pedida é acerto, e a janela dobra quando metade foi
+ * consumida; fora dela (começo ou depois de seek) recomeça do mínimo. */
+static void fat32_readahead(fat32_file_t *file, uint32_t cluster) {
+    fat32_fs_t *fs = file->fs;
+    uint32_t idx = file->file_pos / fs->bytes_per_cluster;
+    uint32_t last = (file->file_size - 1) / fs->bytes_per_cluster;
+    uint32_t min = fat32_ra_clusters(fs, FAT32_RA_MIN_BYTES);
+    uint32_t max = fat32_ra_clusters(fs, FAT32_RA_MAX_BYTES);
+    uint32_t next_idx, next;
+
+    if (file->ra_end > idx) {
+        if (file->ra_end - idx > file->ra_window / 2) return;
+        file->ra_window = file->ra_window * 2 < max ? file->ra_window * 2 : max;
+        next_idx = file->ra_end;
+        next = fat32_next_cluster(fs, file->ra_end_cluster);
+    } else {
+        if (file->ra_window < min) file->ra_window = min;
+        next_idx = idx;
+        next = cluster;
+    }
+
+    uint32_t end = idx + 1 + file->ra_window;
+    if (end > last + 1) end = last + 1;
+
+    /* Clusters vizinhos no disco viram um pedido só */
+    uint32_t spc = fs->bpb.sectors_per_cluster;
+    uint32_t run_lba = 0, run_len = 0;
+
+    blockdev_plug(fs->dev);
+    while (next_idx < end && next >= 2 && next < FAT32_EOC_MIN) {
+        uint32_t lba = fs->data_start + (next - 2) * spc;
+        if (run_len && run_lba + run_len == lba) {
+            run_len += spc;
+        } else {
+            if (run_len) bcache_prefetch(fs->dev, run_lba, run_len);
+            run_lba = lba;
+            run_len = spc;
+        }
+        file->ra_end_cluster = next;
+        file->ra_end = ++next_idx;
+        if (next_idx < end) next = fat32_next_cluster(fs, next);
+    }
+    if (run_len) bcache_prefetch(fs->dev, run_lba, run_len);
+    blockdev_unplug(fs->dev);
+}
+
 int fat32_read(fat32_file_t *file, void *buffer, int size) {
     if (!file || !file->used || file->mode != 0) {  /* 0 = READ */
         return -1;
@@ -582,6 +659,9 @@ int fat32_read(fat32_file_t *file, void *buffer, int size) {
     
     uint8_t *dst = (uint8_t*)buffer;
     int bytes_read = 0;
+    int ra = fat32_ra_enabled;
+
+    if (ra && file->file_pos != file->ra_next_pos) fat32_ra_seek(file);
     
     while (size > 0) {
         uint32_t cluster_offset = file->curr_offset / file->fs->bytes_per_cluster;
@@ -599,8 +679,13 @@ int fat32_read(fat32_file_t *file, void *buffer, int size) {
                          (target_cluster - 2) * file->fs->bpb.sectors_per_cluster + 
                          sector_in_cluster;
         
-        uint8_t sector_buf[SECTOR_SIZE];
-        if (cache_read_sector(file->fs, sector, sector_buf) != 0) {
+        if (ra && (bytes_read == 0 || file->curr_offset == 0)) {
+            fat32_readahead(file, target_cluster);
+        }
+
+        /* Copia direto do buffer do cache */
+        buf_t *b = bread(file->fs->dev, sector);
+        if (!b) {
             break;
         }
         
@@ -608,7 +693,8 @@ int fat32_read(fat32_file_t *file, void *buffer, int size) {
         uint32_t bytes_in_sector = SECTOR_SIZE - offset_in_sector;
         uint32_t to_copy = (size < bytes_in_sector) ? size : bytes_in_sector;
         
-        memcpy(dst, sector_buf + offset_in_sector, to_copy);
+        memcpy(dst, b->data + offset_in_sector, to_copy);
+        brelse(b);
         
         dst += to_copy;
         bytes_read += to_copy;
@@ -627,6 +713,7 @@ int fat32_read(fat32_file_t *file, void *buffer, int size) {
     }
     
 done:
+    file->ra_next_pos = file->file_pos;
     return bytes_read;
 }
 
@@ -657,17 +744,10 @@ int fat32_write(fat32_file_t *file, const void *buffer, int size) {
                          (file->curr_cluster - 2) * file->fs->bpb.sectors_per_cluster + 
                          sector_in_cluster;
         
-        uint8_t sector_buf[SECTOR_SIZE];
-        if (cache_read_sector(file->fs, sector, sector_buf) != 0) {
-            memset(sector_buf, 0, SECTOR_SIZE);
-        }
-        
         uint32_t bytes_in_sector = SECTOR_SIZE - offset_in_sector;
         uint32_t to_copy = (size < bytes_in_sector) ? size : bytes_in_sector;
         
-        memcpy(sector_buf + offset_in_sector, src, to_copy);
-        
-        if (cache_write_sector(file->fs, sector, sector_buf) != 0) {
+        if (cache_update_sector(file->fs, sector, offset_in_sector, src, to_copy) != 0) {
             break;
         }
         
@@ -98,16 +98,30 @@ typedef struct fat32_file {
     uint32_t curr_offset;   /* Mantém seu nome original */
     uint32_t file_size;     /* MANTENHA file_size (não size) */
     uint32_t file_pos;      /* MANTENHA file_pos (não position) */
+
+    /* Read-ahead (só leitura) */
+    uint32_t ra_next_pos;   /* Onde a última leitura parou */
+    uint32_t ra_window;     /* Clusters pedidos à frente do atual */
+    uint32_t ra_end;        /* Índice (no arquivo) do 1º cluster ainda não pedido */
+    uint32_t ra_end_cluster;/* Cluster de índice ra_end - 1 */
 } fat32_file_t;
 
+/* Janela do read-ahead, em bytes (convertida para clusters) */
+#define FAT32_RA_MIN_BYTES   (16 * 1024)
+#define FAT32_RA_MAX_BYTES   (256 * 1024)
+
 /* Adicione protótipos para funções que faltam: */
 int fat32_resolve(fat32_fs_t *fs, const char *path, uint32_t *parent, char name[11]);
 int fat32_find(fat32_fs_t *fs, uint32_t dir_cluster, const char name[11], 
                struct fat32_dirent *result, uint32_t *sector, uint8_t *entry);
 uint32_t fat32_next_cluster(fat32_fs_t *fs, uint32_t cluster);
+/* Lê um setor pelo cache de blocos (bcache) */
+int fat32_read_sector(fat32_fs_t *fs, uint32_t sector, uint8_t *buf);
 fat32_fs_t *fat32_mount(blockdev_t *dev);
 fat32_file_t* fat32_open(fat32_fs_t *fs, const char *path, const char *mode);
 int fat32_read(fat32_file_t *fp, void *buf, int sz);
+/* Liga/desliga o read-ahead de leituras sequenciais (padrão: ligado) */
+void fat32_set_readahead(int on);
 int fat32_write(fat32_file_t *fp, const void *buf, int sz);
 void fat32_close(fat32_file_t *fp);
 int fat32_mkdir(fat32_fs_t *fs, const char *path);
@@ -43,7 +43,7 @@ static void fat32_list_dir_flat(fat32_fs_t *fs, uint32_t dir_cluster,
         
         for (uint32_t sec = 0; sec < fs->bpb.sectors_per_cluster; sec++) {
             uint8_t sector[512];
-            if (fs->dev->read(first_sector + sec, 1, sector) != 0) {
+            if (fat32_read_sector(fs, first_sector + sec, sector) != 0) {
                 return;
             }
             
@@ -115,7 +115,7 @@ static void fat32_list_dir_recursive(fat32_fs_t *fs, uint32_t dir_cluster,
         
         for (uint32_t sec = 0; sec < fs->bpb.sectors_per_cluster; sec++) {
             uint8_t sector[512];
-            if (fs->dev->read(first_sector + sec, 1, sector) != 0) {
+            if (fat32_read_sector(fs, first_sector + sec, sector) != 0) {
                 return;
             }
             
@@ -8,6 +8,7 @@
 #include "string.h"
 #include "kmalloc.h"
 #include "fat32.h"
+#include "bcache.h"
 
 extern void klog(int level, const char *fmt, ...);
 
@@ -176,11 +177,8 @@ static int fat32_vfs_sync(void *handle) {
     fat32_vfs_handle_t *h = (fat32_vfs_handle_t *)handle;
     if (!h->fat_file || !h->fat_file->fs) return VFS_ERR_GENERIC;
     
-    if (h->fat_file->fs->dev->flush) {
-        return h->fat_file->fs->dev->flush();
-    }
-    
-    return VFS_OK;
+    /* Sujos do cache + cache do disco */
+    return bcache_sync(h->fat_file->fs->dev) == 0 ? VFS_OK : VFS_ERR_GENERIC;
 }
 
 /* ===================== DIRETÓRIOS ===================== */
@@ -340,11 +338,7 @@ static int fat32_vfs_sync_fs(struct vfs_mount *mnt) {
     fat32_vfs_context_t *ctx = (fat32_vfs_context_t *)mnt->private_data;
     if (!ctx || !ctx->fatfs) return VFS_ERR_GENERIC;
     
-    if (ctx->fatfs->dev->flush) {
-        return ctx->fatfs->dev->flush();
-    }
-    
-    return VFS_OK;
+    return bcache_sync(ctx->fatfs->dev) == 0 ? VFS_OK : VFS_ERR_GENERIC;
 }
 
 static int fat32_vfs_statfs(struct vfs_mount *mnt, uint64_t *total, uint64_t *free) {
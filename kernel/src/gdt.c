@@ -17,6 +17,8 @@ struct gdt_ptr {
 struct gdt_entry gdt[3];
 struct gdt_ptr gp;
 
+void gdt_load(void);
+
 static void gdt_set_gate(int num, uint64_t base, uint32_t limit, 
                          uint8_t access, uint8_t gran) {
     gdt[num].base_low = (base & 0xFFFF);
@@ -44,6 +46,11 @@ void gdt_init(void) {
        granularity: G=1, L=0, D/B=0 -> 0xA0 (L is ignored for data) */
     gdt_set_gate(2, 0, 0, 0x92, 0xA0);
     
+    gdt_load();
+}
+
+/* Carrega a GDT no CPU atual (BSP via gdt_init, APs direto do smp.c) */
+void gdt_load(void) {
     /* Carrega GDT */
     asm volatile("lgdt %0" : : "m"(gp));
     
@@ -1,9 +1,15 @@
 #include "idt.h"
 #include <stdint.h>
 #include <string.h>  // para memset
+#include "lapic.h"
 
 // Declarações dos handlers externos
 extern void keyboard_handler(void);  // do seu interrupts.asm
+extern void ipi_wakeup_handler(void);
+extern void lapic_spurious_handler(void);
+extern void lapic_timer_handler(void);
+extern void ata_primary_handler(void);
+extern void ata_secondary_handler(void);
 
 // Handlers de exceção genéricos (precisa criar em exceptions.asm)
 extern void exception_handler_0(void);
@@ -97,20 +103,29 @@ void idt_init(void) {
         idt_set_gate(i, exception_handlers[i]);
     }
     
-    // 2. Configura IRQs (32-47) - por enquanto só o teclado
+    // 2. Configura IRQs (32-47) - teclado e IDE
     // IRQ0 (Timer) - se não tiver handler, mantenha zerado por enquanto
     // IRQ1 (Teclado)
     idt_set_gate(32 + 1, (uint64_t)keyboard_handler);  // IRQ1 = vetor 33
+    // IRQ14/IRQ15 (canais IDE)
+    idt_set_gate(32 + 14, (uint64_t)ata_primary_handler);
+    idt_set_gate(32 + 15, (uint64_t)ata_secondary_handler);
     
-    // 3. Para as outras entradas (incluindo spurious interrupts)
-    // pode deixar zeradas por enquanto
+    // 3. Vetores do LAPIC (SMP)
+    idt_set_gate(LAPIC_TIMER_VECTOR, (uint64_t)lapic_timer_handler);
+    idt_set_gate(IPI_WAKEUP_VECTOR, (uint64_t)ipi_wakeup_handler);
+    idt_set_gate(LAPIC_SPURIOUS_VECTOR, (uint64_t)lapic_spurious_handler);
     
     // Configura o ponteiro da IDT
     idtp.limit = sizeof(idt) - 1;
     idtp.base = (uint64_t)&idt;
     
-    // Carrega a IDT
-    asm volatile("lidt %0" : : "m"(idtp));
+    idt_load();
     
     // NOTA: NÃO habilita interrupts aqui! Só depois no kmain.
 }
+
+// Carrega a IDT no CPU atual (os APs compartilham a mesma tabela)
+void idt_load(void) {
+    asm volatile("lidt %0" : : "m"(idtp));
+}
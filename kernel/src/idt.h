@@ -17,4 +17,5 @@ struct idt_ptr {
 } __attribute__((packed));
 
 void idt_init(void);
+void idt_load(void);
 void idt_set_gate(uint8_t num, uint64_t handler);  // Adicione também
@@ -57,3 +57,99 @@ keyboard_handler:
     pop rbp
 
     iretq
+
+; ---------------------------------------------------------------------------
+; Stubs do LAPIC (SMP)
+; ---------------------------------------------------------------------------
+
+extern lapic_eoi
+
+%macro PUSH_REGS 0
+    push rbp
+    push r15
+    push r14
+    push r13
+    push r12
+    push r11
+    push r10
+    push r9
+    push r8
+    push rdi
+    push rsi
+    push rdx
+    push rcx
+    push rbx
+    push rax
+%endmacro
+
+%macro POP_REGS 0
+    pop rax
+    pop rbx
+    pop rcx
+    pop rdx
+    pop rsi
+    pop rdi
+    pop r8
+    pop r9
+    pop r10
+    pop r11
+    pop r12
+    pop r13
+    pop r14
+    pop r15
+    pop rbp
+%endmacro
+
+global ipi_wakeup_handler
+global lapic_spurious_handler
+global lapic_timer_handler
+
+extern sched_timer_irq
+
+; IPI de wakeup: só tira o CPU do hlt; o loop ocioso checa a caixa de correio
+ipi_wakeup_handler:
+    PUSH_REGS
+    ; frame (40) + 15 regs (120) => pilha já alinhada em 16
+    call lapic_eoi
+    POP_REGS
+    iretq
+
+; Spurious do LAPIC: não precisa de EOI
+lapic_spurious_handler:
+    iretq
+
+; Timer do LAPIC: sched_timer_irq faz o EOI e pode trocar de thread.
+; A troca acontece aqui dentro, com o frame de interrupção na stack da
+; thread; ela volta por este mesmo iretq quando for escalada de novo.
+lapic_timer_handler:
+    PUSH_REGS
+    call sched_timer_irq
+    POP_REGS
+    iretq
+
+; ---------------------------------------------------------------------------
+; IRQ14/IRQ15: canais IDE primário e secundário
+; ---------------------------------------------------------------------------
+
+global ata_primary_handler
+global ata_secondary_handler
+
+extern ata_irq_handler
+
+ata_primary_handler:
+    PUSH_REGS
+    xor edi, edi            ; canal 0
+    call ata_irq_handler
+    mov edi, 14
+    call pic_send_eoi
+    POP_REGS
+    iretq
+
+ata_secondary_handler:
+    PUSH_REGS
+    mov edi, 1              ; canal 1
+    call ata_irq_handler
+    mov edi, 15
+    call pic_send_eoi
+    POP_REGS
+    iretq
@@ -0,0 +1,91 @@
+// kcmd.c - Linha de comando mínima na COM1 (iostat, blktrace...)
+#include <stdint.h>
+#include <stddef.h>
+#include "kcmd.h"
+#include "serial.h"
+#include "sched.h"
+#include "string.h"
+
+extern void klog(int level, const char *fmt, ...);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+typedef struct kcmd {
+    const char *name;
+    const char *help;
+    kcmd_fn fn;
+} kcmd_t;
+
+static kcmd_t cmds[KCMD_MAX];
+static int ncmds;
+
+int kcmd_register(const char *name, const char *help, kcmd_fn fn) {
+    if (!name || !fn || ncmds >= KCMD_MAX) return -1;
+    cmds[ncmds++] = (kcmd_t){ .name = name, .help = help, .fn = fn };
+    return 0;
+}
+
+static void kcmd_help(const char *args) {
+    (void)args;
+    for (int i = 0; i < ncmds; i++) {
+        klog(KLOG_INFO, "[KCMD] %s - %s", cmds[i].name, cmds[i].help ? cmds[i].help : "");
+    }
+}
+
+/* Separa "nome args" e despacha */
+static void kcmd_run(char *line) {
+    while (*line == ' ') line++;
+    if (!*line) return;
+
+    char *args = line;
+    while (*args && *args != ' ') args++;
+    if (*args) *args++ = '\0';
+    while (*args == ' ') args++;
+
+    for (int i = 0; i < ncmds; i++) {
+        if (strcmp(cmds[i].name, line) == 0) {
+            cmds[i].fn(args);
+            return;
+        }
+    }
+    klog(KLOG_WARN, "[KCMD] Unknown command '%s' (try 'help')", line);
+}
+
+static void kcmd_thread(void *arg) {
+    (void)arg;
+    char line[KCMD_LINE_MAX];
+    uint32_t len = 0;
+
+    for (;;) {
+        int c = serial_read_char();
+        if (c < 0) {
+            thread_sleep(KCMD_POLL_MS);
+            continue;
+        }
+
+        if (c == '\r' || c == '\n') {
+            serial_write("\n");
+            line[len] = '\0';
+            len = 0;
+            kcmd_run(line);
+        } else if (c == 0x08 || c == 0x7F) {
+            if (len) {
+                len--;
+                serial_write("\b \b");
+            }
+        } else if (c >= 0x20 && c < 0x7F && len < KCMD_LINE_MAX - 1) {
+            line[len++] = (char)c;
+            serial_write_char((char)c);
+        }
+    }
+}
+
+void kcmd_init(void) {
+    kcmd_register("help", "list commands", kcmd_help);
+    if (!sched_active()) return;
+    thread_create("kcmd", kcmd_thread, NULL);
+    klog(KLOG_INFO, "[KCMD] Serial commands ready (type 'help')");
+}
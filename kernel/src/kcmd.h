@@ -0,0 +1,18 @@
+// kcmd.h - Comandos do kernel pela serial
+//
+// A thread "kcmd" lê linhas da COM1 por polling e chama o comando cujo
+// nome é a primeira palavra da linha; o resto da linha vai como argumento
+// (sem espaços na frente). A saída dos comandos é pelo klog.
+#pragma once
+
+#define KCMD_MAX      16
+#define KCMD_LINE_MAX 80
+#define KCMD_POLL_MS  20          /* Intervalo de leitura da serial ociosa */
+
+typedef void (*kcmd_fn)(const char *args);
+
+/* Registra 'name' (string estática); 0 ou -1 se a tabela está cheia */
+int kcmd_register(const char *name, const char *help, kcmd_fn fn);
+
+/* Sobe a thread que atende a serial (precisa do scheduler) */
+void kcmd_init(void);
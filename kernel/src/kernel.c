@@ -8,8 +8,22 @@
 #include "pmm.h"
 #include "kmalloc.h"
 #include "ata_pio.h"
+#include "ahci.h"
+#include "virtio_blk.h"
+#include "nvme.h"
+#include "ramdisk.h"
+#include "pci.h"
 #include "fat32.h"
+#include "part.h"
+#include "kcmd.h"
+#include "blktrace.h"
+#include "bcache.h"
 #include "vfs.h"
+#include "smp.h"
+#include "sched.h"
+#include "workqueue.h"
+#include "cpu.h"
+#include "lapic.h"
 
 /* Protótipos de função */
 extern void fb_init(struct limine_framebuffer *fb);
@@ -38,14 +52,6 @@ static volatile struct limine_framebuffer_request framebuffer_request = {
     .revision = 0
 };
 
-/* Definição do dispositivo de bloco (ATA Wrapper) */
-static blockdev_t ata_drive = {
-    .read = ata_pio_read,
-    .write = ata_pio_write,
-    .flush = ata_pio_flush,
-    .sector_size = 512
-};
-
 /* Delay simples */
 static void microdelay(uint32_t ms) {
     for (volatile uint32_t i = 0; i < ms * 10000; i++) {
@@ -53,6 +59,114 @@ static void microdelay(uint32_t ms) {
     }
 }
 
+/* Trabalho adiado: listagem recursiva do disco */
+static void ls_work(void *arg) {
+    fat32_ls_recursive((fat32_fs_t *)arg);
+}
+
+/* "iostat": contadores e histogramas de todos os blockdevs; "iostat reset"
+ * zera a janela */
+static void cmd_iostat(const char *args) {
+    if (strcmp(args, "reset") == 0) {
+        blockdev_iostat_reset_all();
+        klog(KLOG_INFO, "[IOSTAT] Counters reset");
+        return;
+    }
+    blockdev_iostat_dump_all();
+}
+
+/* "blktrace": dump em texto; "bin" registros crus; "clear", "on", "off" */
+static void cmd_blktrace(const char *args) {
+    if (strcmp(args, "bin") == 0) blktrace_dump_binary();
+    else if (strcmp(args, "clear") == 0) blktrace_clear();
+    else if (strcmp(args, "on") == 0) blktrace_enable(1);
+    else if (strcmp(args, "off") == 0) blktrace_enable(0);
+    else blktrace_dump_text();
+}
+
+/* "workqueue": profundidade e contadores dos deques por CPU */
+static void cmd_workqueue(const char *args) {
+    (void)args;
+    workqueue_dump();
+}
+
+/* Rótulo GPT do volume raiz (sgdisk -c / PTABLE=gpt no disk.sh) */
+#ifndef ROOT_PART_LABEL
+#define ROOT_PART_LABEL "XLDROOT"
+#endif
+
+/* Monta os FAT32 do registro de blockdevs. A raiz (montada em /mnt por
+ * kmain) é a partição GPT com rótulo ROOT_PART_LABEL, senão a primeira
+ * "basic data" ou ESP, senão o primeiro FAT32 na ordem de registro (RAM
+ * disk, IDE, SATA, virtio, NVMe; cada disco seguido das partições). Os outros ficam
+ * em /vol/<nome>. Disco com partições não é montado inteiro, e partição
+ * de tipo que não é FAT nem é lida. */
+static fat32_fs_t *mount_volumes(void) {
+    static const part_guid_t basic = PART_GUID_BASIC_DATA;
+    static const part_guid_t esp = PART_GUID_ESP;
+    fat32_fs_t *root = NULL;
+
+    blockdev_t *want = part_find_by_label(ROOT_PART_LABEL);
+    if (!want) want = part_find_by_type(&basic);
+    if (!want) want = part_find_by_type(&esp);
+    if (want && (root = fat32_mount(want)) != NULL) {
+        blockdev_set_root(want);
+        klog(KLOG_INFO, "  [OK] Root volume: %s (GPT \"%s\")", want->name, part_label(want));
+    }
+
+    for (int i = 0; i < blockdev_count(); i++) {
+        blockdev_t *dev = blockdev_get(i);
+        if (dev->partitions || dev == blockdev_root() || !part_maybe_fat(dev)) continue;
+
+        fat32_fs_t *fs = fat32_mount(dev);
+        if (!fs) continue;
+        if (!root) {
+            root = fs;
+            blockdev_set_root(dev);
+            klog(KLOG_INFO, "  [OK] Root volume: %s", dev->name);
+            continue;
+        }
+
+        char path[48] = "/mnt/vol/";
+        strcat(path, dev->name);
+        if (vfs_mount(path, vfs_get_fat32_ops(), vfs_create_fat32_context(fs)) == 0) {
+            klog(KLOG_INFO, "  [OK] %s mounted at /vol/%s", dev->name, dev->name);
+        }
+    }
+    return root;
+}
+
+#ifdef RA_BENCHMARK
+/* Lê 'path' inteiro por vfs_read em blocos de 64 KiB, com cache frio */
+static void stream_benchmark(const char *path, int readahead) {
+    static uint8_t chunk[64 * 1024];
+    vfs_file_t *f;
+
+    bcache_invalidate(blockdev_root());
+    fat32_set_readahead(readahead);
+    if (vfs_open(path, VFS_READ, &f) != 0) {
+        klog(KLOG_ERROR, "[BENCH] Cannot open %s", path);
+        return;
+    }
+
+    bcache_stats_t before, after;
+    bcache_get_stats(&before);
+    uint64_t total = 0;
+    uint64_t t0 = rdtsc();
+    int n;
+    while ((n = vfs_read(f, chunk, sizeof(chunk))) > 0) total += (uint64_t)n;
+    uint64_t ms = (rdtsc() - t0) / tsc_ticks_per_ms();
+    bcache_get_stats(&after);
+    vfs_close(f);
+
+    klog(KLOG_INFO, "[BENCH] read-ahead %s: %u KiB in %u ms (%u KiB/s), %u misses, %u prefetched",
+         readahead ? "on " : "off", (uint32_t)(total / 1024), (uint32_t)ms,
+         ms ? (uint32_t)(total / 1024 * 1000 / ms) : 0,
+         (uint32_t)(after.misses - before.misses),
+         (uint32_t)(after.prefetched - before.prefetched));
+}
+#endif
+
 /* Pânico */
 void panic(const char *msg) {
     klog(KLOG_ERROR, "KERNEL PANIC: %s", msg);
@@ -67,6 +181,9 @@ void kmain(void) {
     /* Desabilita interrupções durante o setup inicial */
     asm volatile("cli");
 
+    /* Referência para medir o tempo de boot até o disco */
+    uint64_t boot_tsc = rdtsc();
+
     /* ===== FASE 1: Inicialização Gráfica ===== */
     if (framebuffer_request.response == NULL || 
         framebuffer_request.response->framebuffer_count < 1) {
@@ -112,6 +229,12 @@ void kmain(void) {
     idt_init();
     klog(KLOG_INFO, "  [OK] IDT Loaded");
 
+    smp_init();
+    klog(KLOG_INFO, "  [OK] SMP: %d CPU(s) online", (int)smp_cpu_count());
+
+    pci_init();
+    klog(KLOG_INFO, "  [OK] PCI Bus Scanned");
+
     ps2_init();
     klog(KLOG_INFO, "  [OK] PS/2 Controller");
     
@@ -120,16 +243,56 @@ void kmain(void) {
     asm volatile("sti");
     klog(KLOG_INFO, "  [OK] Interrupts Enabled");
 
+    sched_init();
+    klog(KLOG_INFO, "  [OK] Scheduler Started");
+
+    workqueue_init();
+    klog(KLOG_INFO, "  [OK] Deferred Work Queues");
+
     /* ===== FASE 4: Armazenamento e VFS ===== */
     klog(KLOG_INFO, "Initializing Storage & Filesystem...");
 
+    if (bcache_init(BCACHE_PAGES) != 0) {
+        klog(KLOG_ERROR, "  [FAIL] Block cache");
+    }
+    /* Antes dos drivers: o trace pega a varredura de partições e o mount */
+    blktrace_init();
+
+    /* RAM disk primeiro: com módulo, o volume dele vira a raiz */
+    if (ramdisk_init() == 0) {
+        klog(KLOG_INFO, "  [OK] RAM disk: %u MiB",
+             (uint32_t)(ramdisk_blockdev()->sectors / 2048));
+    }
+
     if (ata_pio_init() == 0) {
-        klog(KLOG_INFO, "  [OK] ATA PIO Drive 0");
+        klog(KLOG_INFO, "  [OK] ATA PIO Drive 0 (%u ms after kmain)",
+             (uint32_t)((rdtsc() - boot_tsc) / tsc_ticks_per_ms()));
+#ifdef ATA_BENCHMARK
+        /* make CPPFLAGS=-DATA_BENCHMARK: polling vs IRQ vs DMA em 8 MiB */
+        ata_pio_benchmark(16384);
+#endif
     } else {
         klog(KLOG_ERROR, "  [FAIL] ATA PIO Init");
     }
 
-    fat32_fs_t *fs = fat32_mount(&ata_drive);
+    if (ahci_init() == 0) {
+        klog(KLOG_INFO, "  [OK] AHCI: %d SATA disk(s)", ahci_disk_count());
+    }
+    if (virtio_blk_init() == 0) {
+        klog(KLOG_INFO, "  [OK] virtio-blk: %d disk(s)", virtio_blk_count());
+    }
+    if (nvme_init() == 0) {
+        klog(KLOG_INFO, "  [OK] NVMe: %d namespace(s)", nvme_ns_count());
+    }
+#ifdef BLK_BENCHMARK
+    /* make CPPFLAGS=-DBLK_BENCHMARK com DISK_BUS=both: o mesmo disk.img
+     * pelo IDE e pelo virtio, 8 MiB cada */
+    blockdev_benchmark(ata_pio_get_blockdev(), 16384);
+    blockdev_benchmark(virtio_blk_blockdev(0), 16384);
+#endif
+
+    blockdev_list();
+    fat32_fs_t *fs = mount_volumes();
     
     if (fs) {
         klog(KLOG_INFO, "  [OK] FAT32 Detected & Parsed");
@@ -139,7 +302,8 @@ void kmain(void) {
 
         if (vfs_mount("/mnt", fat_ops, fs_ctx) == 0) {
             klog(KLOG_INFO, "  [OK] VFS mounted at '/mnt'");
-            fat32_ls_recursive(fs);
+            /* Listagem sai do caminho de boot: roda num kworker */
+            queue_work(ls_work, fs);
             /* DEBUG: Verifica se o mount está correto */
             extern void vfs_dump_mounts(void);
             vfs_dump_mounts();
@@ -184,7 +348,19 @@ void kmain(void) {
                 klog(KLOG_WARN, "Make sure the file exists on disk!");
             }
             
+#ifdef RA_BENCHMARK
+            /* make CPPFLAGS=-DRA_BENCHMARK: arquivo de STREAM_MB do disk.sh */
+            stream_benchmark("/root/stream.bin", 0);
+            stream_benchmark("/root/stream.bin", 1);
+            fat32_set_readahead(1);
+#endif
             klog(KLOG_WARN, "--- TEST COMPLETE ---");
+            blockdev_dump_stats(blockdev_root());
+            blockdev_iostat_dump_all();
+            ahci_dump_stats();
+            virtio_blk_dump_stats();
+            nvme_dump_stats();
+            bcache_dump();
 
         } else {
             klog(KLOG_ERROR, "Failed to mount VFS");
@@ -193,11 +369,15 @@ void kmain(void) {
         klog(KLOG_ERROR, "FAT32 Mount Failed (Check disk image)");
     }
 
+    kcmd_register("iostat", "per-device I/O counters and latency ('iostat reset')", cmd_iostat);
+    kcmd_register("blktrace", "dump the block I/O trace (bin|clear|on|off)", cmd_blktrace);
+    kcmd_register("workqueue", "per-CPU work deque depth, run and steal counters", cmd_workqueue);
+    kcmd_init();
+
     klog(KLOG_INFO, "");
     klog(KLOG_INFO, "System ready. Press any key to test PS/2...");
 
-    /* ===== FASE 6: Loop Infinito ===== */
-    while (1) {
-        asm volatile("hlt");
-    }
+    /* ===== FASE 6: Fim da thread boot ===== */
+    /* Daqui em diante os CPUs ficam com as threads idle/de trabalho */
+    thread_exit();
 }
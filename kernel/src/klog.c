@@ -2,6 +2,7 @@
 #include <stddef.h>
 #include <stdarg.h>
 #include "serial.h"
+#include "spinlock.h"
 
 #define FONT_WIDTH 8
 #define FONT_HEIGHT 16
@@ -11,8 +12,45 @@ extern void graphics_set_cursor(uint32_t x, uint32_t y);
 extern uint32_t graphics_get_cursor_x(void);
 extern uint32_t graphics_get_cursor_y(void);
 
+void klog(int level, const char *fmt, ...);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
 static uint32_t log_y = 0;
 
+/* Serializa linhas entre CPUs/threads (irqsave: o PS/2 imprime de IRQ) */
+static spinlock_t klog_lock = SPINLOCK_INIT;
+
+/* Console tomado por uma saída crua na serial (dump do blktrace): klog e
+ * printk são descartados enquanto isso, em vez de esperar com IRQs
+ * desligadas pelo dump inteiro; o release conta quantos se perderam */
+static int console_claimed = 0;
+static uint32_t console_dropped = 0;
+
+/* 0, ou -1 se já tomado */
+int klog_console_claim(void) {
+    uint64_t flags = spinlock_lock_irqsave(&klog_lock);
+    int busy = console_claimed;
+    if (!busy) {
+        console_claimed = 1;
+        console_dropped = 0;
+    }
+    spinlock_unlock_irqrestore(&klog_lock, flags);
+    return busy ? -1 : 0;
+}
+
+void klog_console_release(void) {
+    uint64_t flags = spinlock_lock_irqsave(&klog_lock);
+    console_claimed = 0;
+    uint32_t dropped = console_dropped;
+    spinlock_unlock_irqrestore(&klog_lock, flags);
+
+    if (dropped) klog(KLOG_WARN, "[KLOG] %u messages dropped during a console dump", dropped);
+}
+
 void klog_init(void) {
     log_y = 0;
     graphics_set_cursor(0, 0);
@@ -52,6 +90,13 @@ static void kputnum(uint64_t num, int base) {
 void printk(const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
+    uint64_t flags = spinlock_lock_irqsave(&klog_lock);
+    if (console_claimed) {
+        console_dropped++;
+        spinlock_unlock_irqrestore(&klog_lock, flags);
+        va_end(args);
+        return;
+    }
     
     while (*fmt) {
         if (*fmt == '%') {
@@ -97,6 +142,7 @@ void printk(const char *fmt, ...) {
         fmt++;
     }
     
+    spinlock_unlock_irqrestore(&klog_lock, flags);
     va_end(args);
 }
 
@@ -110,6 +156,12 @@ void klog(int level, const char *fmt, ...) {
         default: prefix = "[LOG] "; break;
     }
     
+    uint64_t flags = spinlock_lock_irqsave(&klog_lock);
+    if (console_claimed) {
+        console_dropped++;
+        spinlock_unlock_irqrestore(&klog_lock, flags);
+        return;
+    }
     kputs(prefix);
     
     va_list args;
@@ -157,5 +209,6 @@ void klog(int level, const char *fmt, ...) {
     }
     
     kputchar('\n');
+    spinlock_unlock_irqrestore(&klog_lock, flags);
     va_end(args);
 }
@@ -0,0 +1,102 @@
+// lapic.c - Local APIC (xAPIC)
+//
+// O MMIO do LAPIC fica em 0xFEE00000 (abaixo de 4GiB), que o Limine deixa
+// mapeado em identidade. Por isso acessamos o endereço físico direto, assim
+// como o pmm.c faz.
+
+#include "lapic.h"
+#include "cpu.h"
+#include "pic.h"
+
+/* PIT: canal 2 com gate controlado pela porta 0x61 */
+#define PIT_FREQ          1193182
+#define PIT_CH2_DATA      0x42
+#define PIT_CMD           0x43
+#define PIT_GATE_PORT     0x61
+#define CALIBRATE_MS      10
+
+static volatile uint32_t *lapic_base = 0;
+static uint32_t timer_ticks_per_ms = 0;
+static uint64_t tsc_per_ms = 0;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic_base[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t val) {
+    lapic_base[reg / 4] = val;
+}
+
+void lapic_init(void) {
+    if (!lapic_base) {
+        uint64_t base = rdmsr(MSR_IA32_APIC_BASE) & 0xFFFFF000ULL;
+        lapic_base = (volatile uint32_t *)base;
+    }
+
+    /* Aceita todas as prioridades e habilita por software (SVR) */
+    lapic_write(LAPIC_REG_TPR, 0);
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+}
+
+uint32_t lapic_id(void) {
+    return lapic_read(LAPIC_REG_ID) >> 24;
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_REG_EOI, 0);
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector) {
+    while (lapic_read(LAPIC_REG_ICR_LOW) & LAPIC_ICR_PENDING) {
+        cpu_relax();
+    }
+    lapic_write(LAPIC_REG_ICR_HIGH, apic_id << 24);
+    /* Fixed delivery, destino físico, edge */
+    lapic_write(LAPIC_REG_ICR_LOW, vector);
+}
+
+void lapic_timer_calibrate(void) {
+    if (timer_ticks_per_ms) return;
+
+    /* PIT canal 2, modo 0 (one-shot), contagem para CALIBRATE_MS */
+    uint16_t count = (uint16_t)(PIT_FREQ * CALIBRATE_MS / 1000);
+    uint8_t gate = inb(PIT_GATE_PORT) & ~0x02;   /* speaker desligado */
+    outb(PIT_GATE_PORT, gate & ~0x01);
+    outb(PIT_CMD, 0xB0);
+    outb(PIT_CH2_DATA, count & 0xFF);
+    outb(PIT_CH2_DATA, count >> 8);
+
+    lapic_write(LAPIC_REG_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_REG_LVT_TIMER, 0x10000);           /* mascarado */
+    lapic_write(LAPIC_REG_TIMER_INIT, 0xFFFFFFFF);
+
+    /* Sobe o gate: o PIT começa a contar; o TSC é medido na mesma janela */
+    uint64_t tsc0 = rdtsc();
+    outb(PIT_GATE_PORT, gate | 0x01);
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+        cpu_relax();
+    }
+
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_REG_TIMER_CUR);
+    uint64_t tsc_elapsed = rdtsc() - tsc0;
+    lapic_write(LAPIC_REG_TIMER_INIT, 0);
+
+    tsc_per_ms = tsc_elapsed / CALIBRATE_MS;
+    if (tsc_per_ms == 0) tsc_per_ms = 1;
+
+    timer_ticks_per_ms = elapsed / CALIBRATE_MS;
+    if (timer_ticks_per_ms == 0) timer_ticks_per_ms = 1;
+}
+
+void lapic_timer_start(uint32_t hz) {
+    if (!timer_ticks_per_ms) lapic_timer_calibrate();
+
+    lapic_write(LAPIC_REG_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_REG_TIMER_INIT, timer_ticks_per_ms * 1000 / hz);
+}
+
+uint64_t tsc_ticks_per_ms(void) {
+    if (!tsc_per_ms) lapic_timer_calibrate();
+    return tsc_per_ms;
+}
@@ -0,0 +1,46 @@
+// lapic.h - Local APIC (modo xAPIC via MMIO)
+#pragma once
+#include <stdint.h>
+
+/* Registradores (offsets do MMIO do LAPIC) */
+#define LAPIC_REG_ID         0x020
+#define LAPIC_REG_TPR        0x080
+#define LAPIC_REG_EOI        0x0B0
+#define LAPIC_REG_SVR        0x0F0
+#define LAPIC_REG_ICR_LOW    0x300
+#define LAPIC_REG_ICR_HIGH   0x310
+#define LAPIC_REG_LVT_TIMER  0x320
+#define LAPIC_REG_TIMER_INIT 0x380
+#define LAPIC_REG_TIMER_CUR  0x390
+#define LAPIC_REG_TIMER_DIV  0x3E0
+
+#define LAPIC_SVR_ENABLE     0x100
+#define LAPIC_ICR_PENDING    0x1000
+#define LAPIC_TIMER_PERIODIC 0x20000
+#define LAPIC_TIMER_DIV_16   0x3
+
+/* Vetores reservados para o LAPIC */
+#define LAPIC_TIMER_VECTOR     0x40
+#define IPI_WAKEUP_VECTOR      0xF0
+#define LAPIC_SPURIOUS_VECTOR  0xFF
+
+/* Habilita o LAPIC do CPU atual */
+void lapic_init(void);
+
+/* ID do LAPIC do CPU atual */
+uint32_t lapic_id(void);
+
+/* Fim de interrupção */
+void lapic_eoi(void);
+
+/* Envia IPI fixa para um LAPIC ID */
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+
+/* Calibra o timer do LAPIC contra o PIT (uma vez, no BSP) */
+void lapic_timer_calibrate(void);
+
+/* Dispara o timer periódico do CPU atual em 'hz' interrupções/s */
+void lapic_timer_start(uint32_t hz);
+
+/* Ciclos de TSC por ms (calibrado junto com o timer, contra o PIT) */
+uint64_t tsc_ticks_per_ms(void);
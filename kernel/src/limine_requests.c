@@ -6,3 +6,29 @@ volatile struct limine_memmap_request memmap_request
     .id = LIMINE_MEMMAP_REQUEST_ID,
     .revision = 0
 };
+
+/* MP (SMP) request - o Limine sobe os APs e espera um goto_address de cada um */
+volatile struct LIMINE_MP(request) mp_request
+    __attribute__((section(".limine.request"), used)) = {
+#if LIMINE_API_REVISION >= 1
+    .id = LIMINE_MP_REQUEST_ID,
+#else
+    .id = LIMINE_SMP_REQUEST_ID,
+#endif
+    .revision = 0,
+    .flags = 0
+};
+
+/* RSDP (ACPI) - tabelas como a MCFG do PCIe (acpi.c) */
+volatile struct limine_rsdp_request rsdp_request
+    __attribute__((section(".limine.request"), used)) = {
+    .id = LIMINE_RSDP_REQUEST_ID,
+    .revision = 0
+};
+
+/* Módulos (limine.conf module_path) - imagem do RAM disk (ramdisk.c) */
+volatile struct limine_module_request module_request
+    __attribute__((section(".limine.request"), used)) = {
+    .id = LIMINE_MODULE_REQUEST_ID,
+    .revision = 0
+};
@@ -0,0 +1,720 @@
+/*
+nvme.c - Driver NVMe com um par de filas de I/O por CPU
+
+O controlador é assumido pelo driver PCI "nvme" (classe 01h/08h, prog-if
+02h) e acessado pelo BAR0 de 64 bits (pci_map_bar). A
+inicialização segue a especificação: desliga (CC.EN=0), monta a fila
+admin (AQA/ASQ/ACQ), liga com páginas de 4 KiB e entradas de 64/16 bytes,
+Identify Controller, Set Features (Number of Queues) pedindo uma fila por
+CPU, cria os pares CQ/SQ de I/O e faz Identify de cada namespace.
+
+Os pares de filas são do controlador, compartilhados pelos namespaces:
+
+  - o kick da request_queue roda no contexto de quem submeteu e despacha
+    no par do CPU atual (lock do par, sem disputa entre CPUs), com um
+    doorbell só por lote;
+  - a thread "nvme0" lê as CQs de todos os pares por polling (fase do
+    CQE), conclui os pedidos fora do lock e reabastece o par.
+
+Dados por PRP direto dos segmentos dos bios: PRP1 com offset, as páginas
+seguintes em PRP2 ou, acima de duas, numa lista do comando (512 bytes,
+nunca cruza página). Segmentos que não encaixam em páginas (ou buffer
+fora da identidade) passam pelo bounce do par, um pedido por vez.
+
+Sem roteamento de IRQ as interrupções ficam mascaradas (INTMS) e as CQs
+são criadas sem IEN. Comando que não volta não é abortado: o controlador
+(real ou do QEMU) não perde comandos e não há reset do controlador.
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include "nvme.h"
+#include "blockdev.h"
+#include "blkqueue.h"
+#include "waitqueue.h"
+#include "spinlock.h"
+#include "sched.h"
+#include "smp.h"
+#include "cpu.h"
+#include "lapic.h"
+#include "pci.h"
+#include "pmm.h"
+#include "kmalloc.h"
+#include "string.h"
+
+extern void klog(int level, const char *fmt, ...);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+#define PCI_SUBCLASS_NVM        0x08
+#define PCI_PROG_IF_NVME        0x02
+
+/* ===================== REGISTRADORES ===================== */
+
+#define NVME_REG_CAP            0x00        /* 64 bits */
+#define NVME_REG_VS             0x08
+#define NVME_REG_INTMS          0x0C
+#define NVME_REG_CC             0x14
+#define NVME_REG_CSTS           0x1C
+#define NVME_REG_AQA            0x24
+#define NVME_REG_ASQ            0x28        /* 64 bits */
+#define NVME_REG_ACQ            0x30        /* 64 bits */
+#define NVME_REG_DOORBELL       0x1000
+
+#define CAP_MQES(c)             ((uint32_t)((c) & 0xFFFF))
+#define CAP_TO(c)               ((uint32_t)(((c) >> 24) & 0xFF))    /* x 500 ms */
+#define CAP_DSTRD(c)            ((uint32_t)(((c) >> 32) & 0xF))
+#define CAP_MPSMIN(c)           ((uint32_t)(((c) >> 48) & 0xF))
+
+#define CC_EN                   (1u << 0)
+#define CC_IOSQES               (6u << 16)  /* SQE de 64 bytes */
+#define CC_IOCQES               (4u << 20)  /* CQE de 16 bytes */
+
+#define CSTS_RDY                (1u << 0)
+#define CSTS_CFS                (1u << 1)
+
+/* Opcodes admin */
+#define NVME_ADMIN_CREATE_SQ    0x01
+#define NVME_ADMIN_CREATE_CQ    0x05
+#define NVME_ADMIN_IDENTIFY     0x06
+#define NVME_ADMIN_SET_FEATURES 0x09
+
+#define NVME_CNS_NAMESPACE      0x00
+#define NVME_CNS_CONTROLLER     0x01
+#define NVME_FEAT_NUM_QUEUES    0x07
+
+/* Opcodes de I/O */
+#define NVME_CMD_FLUSH          0x00
+#define NVME_CMD_WRITE          0x01
+#define NVME_CMD_READ           0x02
+
+#define NVME_QUEUE_PC           (1u << 0)   /* Fisicamente contígua */
+
+typedef struct nvme_sqe {
+    uint32_t cdw0;                          /* Opcode | CID << 16 */
+    uint32_t nsid;
+    uint32_t cdw2;
+    uint32_t cdw3;
+    uint64_t mptr;
+    uint64_t prp1;
+    uint64_t prp2;
+    uint32_t cdw10;
+    uint32_t cdw11;
+    uint32_t cdw12;
+    uint32_t cdw13;
+    uint32_t cdw14;
+    uint32_t cdw15;
+} __attribute__((packed)) nvme_sqe_t;
+
+typedef struct nvme_cqe {
+    uint32_t result;
+    uint32_t reserved;
+    uint16_t sq_head;
+    uint16_t sq_id;
+    uint16_t cid;
+    uint16_t status;                        /* Bit 0 = fase */
+} __attribute__((packed)) nvme_cqe_t;
+
+/* ===================== ESTADO ===================== */
+
+#define NVME_PAGE_SIZE          4096
+#define NVME_ADMIN_ENTRIES      16
+#define NVME_IO_DEPTH           32          /* Comandos em voo por par */
+#define NVME_DONE_MAX           (NVME_IO_DEPTH * 2) /* Concluídos por passada */
+#define NVME_MAX_SECTORS        512         /* 256 KiB por pedido juntado */
+#define NVME_PRP_ENTRIES        64          /* Páginas além de PRP1: 512 bytes */
+#define NVME_PRP_PAGES          (NVME_IO_DEPTH * NVME_PRP_ENTRIES * 8 / NVME_PAGE_SIZE)
+#define NVME_BOUNCE_PAGES       (NVME_MAX_SECTORS * 512 / NVME_PAGE_SIZE)
+#define NVME_ADMIN_TIMEOUT_MS   2000
+
+struct nvme_ns;
+
+typedef struct nvme_qp {
+    uint16_t qid;
+    uint16_t entries;                       /* Tamanho da SQ e da CQ */
+    nvme_sqe_t *sq;
+    volatile nvme_cqe_t *cq;
+    volatile uint32_t *sq_db;
+    volatile uint32_t *cq_db;
+    uint16_t sq_tail;
+    uint16_t cq_head;
+    uint16_t phase;
+    spinlock_t lock;
+
+    /* Comandos em voo, por CID; o retido espera CID ou bounce */
+    blk_slots_t slots;
+    request_t *rq[NVME_IO_DEPTH];
+    struct nvme_ns *rq_ns[NVME_IO_DEPTH];
+    uint64_t *prp;                          /* NVME_PRP_ENTRIES por CID */
+    struct nvme_done *done;                 /* Lote da passada atual (sob lock) */
+    uint8_t *bounce;
+    int bounce_cid;                         /* -1 = livre */
+
+    /* Estatísticas */
+    uint64_t commands;
+    uint64_t doorbells;
+    uint64_t bounced;
+    uint64_t errors;
+} nvme_qp_t;
+
+/* Pedidos concluídos sob o lock do par; terminam depois, fora dele */
+typedef struct nvme_done {
+    request_t *rq[NVME_DONE_MAX];
+    int status[NVME_DONE_MAX];
+    struct nvme_ns *ns[NVME_DONE_MAX];
+    int n;
+} nvme_done_t;
+
+typedef struct nvme_ns {
+    uint32_t nsid;
+    uint64_t sectors;
+    blockdev_t bdev;
+    request_queue_t queue;
+    char name[12];
+} nvme_ns_t;
+
+static struct {
+    volatile uint8_t *regs;
+    uint64_t cap;
+    uint32_t dstrd;                         /* Passo entre doorbells (bytes) */
+    int vwc;                                /* Cache volátil: FLUSH faz algo */
+    uint32_t max_sectors;
+
+    nvme_qp_t admin;
+    nvme_qp_t *qps[SMP_MAX_CPUS];
+    uint32_t nqp;
+
+    nvme_ns_t *ns[NVME_MAX_NS];
+    int nns;
+
+    blk_poller_t poller;
+} ctrl;
+
+/* ===================== ACESSO E TEMPO ===================== */
+
+static inline uint32_t nvme_read(uint32_t off) {
+    return *(volatile uint32_t *)(ctrl.regs + off);
+}
+
+static inline void nvme_write(uint32_t off, uint32_t val) {
+    *(volatile uint32_t *)(ctrl.regs + off) = val;
+}
+
+static inline uint64_t nvme_read64(uint32_t off) {
+    return *(volatile uint64_t *)(ctrl.regs + off);
+}
+
+static inline void nvme_write64(uint32_t off, uint64_t val) {
+    *(volatile uint64_t *)(ctrl.regs + off) = val;
+}
+
+static uint64_t nvme_deadline(uint32_t ms) {
+    return rdtsc() + (uint64_t)ms * tsc_ticks_per_ms();
+}
+
+/* Espera (CSTS & mask) == val; 0 ou -1 no timeout ou falha fatal */
+static int nvme_wait_csts(uint32_t mask, uint32_t val, uint32_t ms) {
+    uint64_t deadline = nvme_deadline(ms);
+    for (;;) {
+        uint32_t csts = nvme_read(NVME_REG_CSTS);
+        if ((csts & mask) == val) return 0;
+        if ((csts & CSTS_CFS) || rdtsc() >= deadline) return -1;
+        cpu_relax();
+    }
+}
+
+/* ===================== FILAS ===================== */
+
+/* Aloca SQ e CQ de 'entries' entradas e acha os doorbells do par 'qid' */
+static int nvme_qp_alloc(nvme_qp_t *q, uint16_t qid, uint16_t entries) {
+    q->qid = qid;
+    q->entries = entries;
+    q->phase = 1;
+    q->lock = (spinlock_t)SPINLOCK_INIT;
+    q->bounce_cid = -1;
+
+    uint32_t sq_pages = (entries * sizeof(nvme_sqe_t) + NVME_PAGE_SIZE - 1) / NVME_PAGE_SIZE;
+    uint32_t cq_pages = (entries * sizeof(nvme_cqe_t) + NVME_PAGE_SIZE - 1) / NVME_PAGE_SIZE;
+    q->sq = pmalloc(sq_pages);
+    q->cq = pmalloc(cq_pages);
+    if (!q->sq || !q->cq) return -1;
+    memset(q->sq, 0, sq_pages * NVME_PAGE_SIZE);
+    memset((void *)q->cq, 0, cq_pages * NVME_PAGE_SIZE);
+
+    q->sq_db = (volatile uint32_t *)(ctrl.regs + NVME_REG_DOORBELL + (2 * qid) * ctrl.dstrd);
+    q->cq_db = (volatile uint32_t *)(ctrl.regs + NVME_REG_DOORBELL + (2 * qid + 1) * ctrl.dstrd);
+    return 0;
+}
+
+/* Copia o comando para a SQ (sem tocar o doorbell) */
+static void nvme_sq_push(nvme_qp_t *q, const nvme_sqe_t *cmd) {
+    q->sq[q->sq_tail] = *cmd;
+    if (++q->sq_tail == q->entries) q->sq_tail = 0;
+}
+
+static void nvme_sq_ring(nvme_qp_t *q) {
+    __sync_synchronize();                   /* SQEs antes do doorbell */
+    *q->sq_db = q->sq_tail;
+    q->doorbells++;
+}
+
+/* Próximo CQE se a fase bate; NULL se a CQ está vazia */
+static volatile nvme_cqe_t *nvme_cq_peek(nvme_qp_t *q) {
+    volatile nvme_cqe_t *e = &q->cq[q->cq_head];
+    if ((e->status & 1) != q->phase) return NULL;
+    __sync_synchronize();                   /* Fase antes do resto do CQE */
+    return e;
+}
+
+static void nvme_cq_pop(nvme_qp_t *q) {
+    if (++q->cq_head == q->entries) {
+        q->cq_head = 0;
+        q->phase ^= 1;
+    }
+}
+
+/* ===================== ADMIN ===================== */
+
+/* Comando admin síncrono (só na inicialização); status NVMe ou -1 */
+static int nvme_admin(nvme_sqe_t *cmd, uint32_t *result) {
+    nvme_qp_t *q = &ctrl.admin;
+
+    cmd->cdw0 = (cmd->cdw0 & 0xFFFF) | ((uint32_t)q->sq_tail << 16);
+    nvme_sq_push(q, cmd);
+    nvme_sq_ring(q);
+
+    uint64_t deadline = nvme_deadline(NVME_ADMIN_TIMEOUT_MS);
+    volatile nvme_cqe_t *e;
+    while (!(e = nvme_cq_peek(q))) {
+        if (rdtsc() >= deadline) return -1;
+        cpu_relax();
+    }
+    uint16_t status = e->status >> 1;
+    if (result) *result = e->result;
+    nvme_cq_pop(q);
+    *q->cq_db = q->cq_head;
+    return status;
+}
+
+static int nvme_identify(uint32_t cns, uint32_t nsid, void *buf) {
+    nvme_sqe_t cmd = {
+        .cdw0 = NVME_ADMIN_IDENTIFY, .nsid = nsid,
+        .prp1 = pmm_virt_to_phys(buf), .cdw10 = cns,
+    };
+    return nvme_admin(&cmd, NULL) == 0 ? 0 : -1;
+}
+
+/* Cria CQ e SQ de I/O do par (CQ primeiro: a SQ aponta para ela) */
+static int nvme_create_qp(nvme_qp_t *q) {
+    nvme_sqe_t cq = {
+        .cdw0 = NVME_ADMIN_CREATE_CQ, .prp1 = pmm_virt_to_phys((void *)q->cq),
+        .cdw10 = ((uint32_t)(q->entries - 1) << 16) | q->qid,
+        .cdw11 = NVME_QUEUE_PC,             /* Sem IEN: polling */
+    };
+    if (nvme_admin(&cq, NULL) != 0) return -1;
+
+    nvme_sqe_t sq = {
+        .cdw0 = NVME_ADMIN_CREATE_SQ, .prp1 = pmm_virt_to_phys(q->sq),
+        .cdw10 = ((uint32_t)(q->entries - 1) << 16) | q->qid,
+        .cdw11 = ((uint32_t)q->qid << 16) | NVME_QUEUE_PC,
+    };
+    return nvme_admin(&sq, NULL) == 0 ? 0 : -1;
+}
+
+/* ===================== PRP ===================== */
+
+static int nvme_direct_ok(const void *buf, uint32_t bytes) {
+    uint64_t v = (uint64_t)buf;
+    return v + bytes <= 0x100000000ULL;
+}
+
+/* Monta PRP1/PRP2 dos segmentos do pedido; -1 se algum não encaixa em
+ * páginas (só o primeiro pode começar no meio, só o último acabar) */
+static int nvme_build_prp(nvme_qp_t *q, int cid, request_t *rq, nvme_sqe_t *cmd) {
+    uint64_t *list = q->prp + (size_t)cid * NVME_PRP_ENTRIES;
+    blk_cursor_t cur;
+    blk_cursor_init(&cur, rq->bio_head);
+    uint32_t left = rq->sectors;
+    uint64_t expect = 0;
+    int n = 0;
+
+    while (left) {
+        uint32_t k;
+        void *p = blk_cursor_next(&cur, left, &k);
+        left -= k;
+        if (!nvme_direct_ok(p, k * 512)) return -1;
+
+        uint64_t phys = pmm_virt_to_phys(p);
+        uint64_t end = phys + (uint64_t)k * 512;
+        uint64_t page;
+        if (expect == 0) {
+            cmd->prp1 = phys;
+            page = (phys & ~(uint64_t)(NVME_PAGE_SIZE - 1)) + NVME_PAGE_SIZE;
+        } else {
+            if (phys != expect &&
+                ((expect & (NVME_PAGE_SIZE - 1)) || (phys & (NVME_PAGE_SIZE - 1)))) return -1;
+            page = (phys + NVME_PAGE_SIZE - 1) & ~(uint64_t)(NVME_PAGE_SIZE - 1);
+        }
+        for (; page < end; page += NVME_PAGE_SIZE) {
+            if (n >= NVME_PRP_ENTRIES) return -1;
+            list[n++] = page;
+        }
+        expect = end;
+    }
+
+    if (n == 0) cmd->prp2 = 0;
+    else if (n == 1) cmd->prp2 = list[0];
+    else cmd->prp2 = pmm_virt_to_phys(list);
+    return 0;
+}
+
+/* ===================== SUBMISSÃO ===================== */
+
+/* Põe o pedido na SQ com o CID 'cid'. 1 = saiu; 0 = esperar bounce
+ * (ou lote de concluídos cheio); -1 = erro; 2 = já concluído (FLUSH sem
+ * cache volátil) */
+static int nvme_start_request(blk_slots_t *s, int cid, request_t *rq, void *ctx) {
+    nvme_qp_t *q = (nvme_qp_t *)s->driver;
+    nvme_ns_t *ns = (nvme_ns_t *)ctx;
+    nvme_sqe_t cmd = { .nsid = ns->nsid };
+
+    if (q->done->n == NVME_DONE_MAX) return 0;
+    if (rq->op == BIO_FLUSH) {
+        if (!ctrl.vwc) return 2;
+        cmd.cdw0 = NVME_CMD_FLUSH;
+    } else {
+        int write = rq->op == BIO_WRITE;
+        if (nvme_build_prp(q, cid, rq, &cmd) < 0) {
+            if (!q->bounce || rq->sectors > NVME_MAX_SECTORS) return -1;
+            if (q->bounce_cid >= 0) return 0;
+
+            /* Bounce alinhado em página: PRP1 + o resto em sequência */
+            uint64_t *list = q->prp + (size_t)cid * NVME_PRP_ENTRIES;
+            uint64_t phys = pmm_virt_to_phys(q->bounce);
+            uint32_t pages = (rq->sectors * 512 + NVME_PAGE_SIZE - 1) / NVME_PAGE_SIZE;
+            for (uint32_t i = 1; i < pages; i++) list[i - 1] = phys + (uint64_t)i * NVME_PAGE_SIZE;
+            cmd.prp1 = phys;
+            cmd.prp2 = pages == 1 ? 0 : pages == 2 ? list[0] : pmm_virt_to_phys(list);
+
+            if (write) blk_bounce_copy(rq, q->bounce, 1);
+            q->bounce_cid = cid;
+            q->bounced++;
+        }
+        cmd.cdw0 = write ? NVME_CMD_WRITE : NVME_CMD_READ;
+        cmd.cdw10 = (uint32_t)rq->lba;
+        cmd.cdw11 = (uint32_t)(rq->lba >> 32);
+        cmd.cdw12 = rq->sectors - 1;
+    }
+    cmd.cdw0 |= (uint32_t)cid << 16;
+
+    q->rq[cid] = rq;
+    q->rq_ns[cid] = ns;
+    blk_slots_get(&q->slots, cid);
+    nvme_sq_push(q, &cmd);
+    q->commands++;
+    return 1;
+}
+
+/* Próximo pedido para o par: o primeiro namespace com fila */
+static request_t *nvme_next_request(blk_slots_t *s, void **ctx) {
+    (void)s;
+    for (int i = 0; i < ctrl.nns; i++) {
+        request_t *rq = blk_fetch_request(&ctrl.ns[i]->queue);
+        if (rq) {
+            *ctx = ctrl.ns[i];
+            return rq;
+        }
+    }
+    return NULL;
+}
+
+static void nvme_done_add(nvme_done_t *d, request_t *rq, nvme_ns_t *ns, int status) {
+    d->rq[d->n] = rq;
+    d->status[d->n] = status;
+    d->ns[d->n] = ns;
+    d->n++;
+}
+
+/* Erro ou FLUSH vazio na submissão: vai para o lote, fora do lock */
+static void nvme_end_early(blk_slots_t *s, request_t *rq, void *ctx, int status) {
+    nvme_done_add(((nvme_qp_t *)s->driver)->done, rq, (nvme_ns_t *)ctx, status);
+}
+
+static const blk_slot_ops_t nvme_slot_ops = {
+    .start = nvme_start_request, .fetch = nvme_next_request, .end = nvme_end_early,
+};
+
+/* ===================== CONCLUSÃO ===================== */
+
+/* Recolhe os CQEs do par; os pedidos vão no lote para fora do lock */
+static void nvme_reap(nvme_qp_t *q) {
+    volatile nvme_cqe_t *e;
+    int reaped = 0;
+
+    while ((e = nvme_cq_peek(q))) {
+        uint16_t cid = e->cid;
+        int st = (e->status >> 1) ? -1 : 0;
+        nvme_cq_pop(q);
+        reaped = 1;
+        if (cid >= NVME_IO_DEPTH || !(q->slots.busy & (1u << cid))) continue;
+
+        request_t *rq = q->rq[cid];
+        if (q->bounce_cid == cid) {
+            if (st == 0 && rq->op == BIO_READ) blk_bounce_copy(rq, q->bounce, 0);
+            q->bounce_cid = -1;
+        }
+        if (st) q->errors++;
+        blk_slots_put(&q->slots, cid);
+        q->rq[cid] = NULL;
+        nvme_done_add(q->done, rq, q->rq_ns[cid], st);
+    }
+    if (reaped) *q->cq_db = q->cq_head;
+}
+
+/* Recolhe e reabastece o par 'q'; um doorbell no fim */
+static void nvme_service_qp(nvme_qp_t *q) {
+    nvme_done_t done;
+    done.n = 0;
+
+    uint64_t flags = spinlock_lock_irqsave(&q->lock);
+    q->done = &done;
+    nvme_reap(q);
+    uint16_t tail = q->sq_tail;
+    blk_slots_fill(&q->slots);
+    if (q->sq_tail != tail) nvme_sq_ring(q);
+    q->done = NULL;
+    spinlock_unlock_irqrestore(&q->lock, flags);
+
+    for (int i = 0; i < done.n; i++) blk_end_request(&done.ns[i]->queue, done.rq[i], done.status[i]);
+}
+
+static int nvme_busy(void *arg) {
+    (void)arg;
+    for (uint32_t i = 0; i < ctrl.nqp; i++) {
+        if (blk_slots_busy(&ctrl.qps[i]->slots)) return 1;
+    }
+    for (int i = 0; i < ctrl.nns; i++) {
+        if (blk_queue_pending(&ctrl.ns[i]->queue)) return 1;
+    }
+    return 0;
+}
+
+static int nvme_inflight(void *arg) {
+    (void)arg;
+    for (uint32_t i = 0; i < ctrl.nqp; i++) {
+        if (ctrl.qps[i]->slots.busy) return 1;
+    }
+    return 0;
+}
+
+static void nvme_poll_all(void *arg) {
+    (void)arg;
+    for (uint32_t i = 0; i < ctrl.nqp; i++) nvme_service_qp(ctrl.qps[i]);
+}
+
+static const blk_poll_ops_t nvme_poll_ops = {
+    .service = nvme_poll_all, .busy = nvme_busy, .inflight = nvme_inflight,
+};
+
+/* Par do CPU atual */
+static nvme_qp_t *nvme_this_qp(void) {
+    uint32_t cpu = sched_active() ? smp_current_id() : 0;
+    return ctrl.qps[cpu % ctrl.nqp];
+}
+
+static void nvme_queue_kick(request_queue_t *rq_queue) {
+    (void)rq_queue;
+
+    /* Com a thread, submete já no par deste CPU; ela só recolhe */
+    if (ctrl.poller.worker) nvme_service_qp(nvme_this_qp());
+    blk_poller_kick(&ctrl.poller);
+}
+
+/* ===================== INICIALIZAÇÃO ===================== */
+
+static int nvme_enable(void) {
+    uint32_t timeout = CAP_TO(ctrl.cap) * 500;
+    if (!timeout) timeout = 500;
+
+    nvme_write(NVME_REG_CC, nvme_read(NVME_REG_CC) & ~CC_EN);
+    if (nvme_wait_csts(CSTS_RDY, 0, timeout) < 0) return -1;
+
+    if (nvme_qp_alloc(&ctrl.admin, 0, NVME_ADMIN_ENTRIES) < 0) return -1;
+    nvme_write(NVME_REG_AQA, ((uint32_t)(NVME_ADMIN_ENTRIES - 1) << 16) | (NVME_ADMIN_ENTRIES - 1));
+    nvme_write64(NVME_REG_ASQ, pmm_virt_to_phys(ctrl.admin.sq));
+    nvme_write64(NVME_REG_ACQ, pmm_virt_to_phys((void *)ctrl.admin.cq));
+
+    nvme_write(NVME_REG_INTMS, 0xFFFFFFFF);                 /* Polling */
+    nvme_write(NVME_REG_CC, CC_EN | CC_IOSQES | CC_IOCQES); /* NVM, MPS = 4 KiB */
+    return nvme_wait_csts(CSTS_RDY, CSTS_RDY, timeout);
+}
+
+/* Pede um par por CPU; devolve quantos o controlador concedeu */
+static uint32_t nvme_set_queue_count(uint32_t want) {
+    uint32_t result = 0;
+    nvme_sqe_t cmd = {
+        .cdw0 = NVME_ADMIN_SET_FEATURES, .cdw10 = NVME_FEAT_NUM_QUEUES,
+        .cdw11 = ((want - 1) << 16) | (want - 1),
+    };
+    if (nvme_admin(&cmd, &result) != 0) return 1;
+    uint32_t nsq = (result & 0xFFFF) + 1;
+    uint32_t ncq = (result >> 16) + 1;
+    uint32_t n = nsq < ncq ? nsq : ncq;
+    return n < want ? n : want;
+}
+
+static int nvme_setup_io_queues(void) {
+    uint32_t want = sched_active() ? smp_cpu_count() : 1;
+    if (want < 1) want = 1;
+    if (want > SMP_MAX_CPUS) want = SMP_MAX_CPUS;
+    want = nvme_set_queue_count(want);
+
+    uint32_t entries = NVME_IO_DEPTH + 1;
+    if (entries > CAP_MQES(ctrl.cap) + 1) entries = CAP_MQES(ctrl.cap) + 1;
+
+    for (uint32_t i = 0; i < want; i++) {
+        nvme_qp_t *q = kmalloc(sizeof(*q));
+        if (!q) break;
+        memset(q, 0, sizeof(*q));
+        q->prp = pmalloc(NVME_PRP_PAGES);
+        if (!q->prp || nvme_qp_alloc(q, (uint16_t)(i + 1), (uint16_t)entries) < 0 ||
+            nvme_create_qp(q) < 0) {
+            klog(KLOG_WARN, "[NVME] I/O queue %u setup failed", i + 1);
+            kfree(q);
+            break;
+        }
+        blk_slots_init(&q->slots, &nvme_slot_ops, NULL, q, entries - 1);
+        q->bounce = pmalloc(NVME_BOUNCE_PAGES);
+        ctrl.qps[ctrl.nqp++] = q;
+    }
+    return ctrl.nqp ? 0 : -1;
+}
+
+static void nvme_probe_ns(uint32_t nsid, uint8_t *id) {
+    if (ctrl.nns >= NVME_MAX_NS || nvme_identify(NVME_CNS_NAMESPACE, nsid, id) < 0) return;
+
+    uint64_t nsze = *(uint64_t *)(id + 0);
+    uint32_t flbas = id[26] & 0xF;
+    uint32_t lbads = (*(uint32_t *)(id + 128 + 4 * flbas) >> 16) & 0xFF;
+    if (!nsze) return;
+    if (lbads != 9) {
+        klog(KLOG_WARN, "[NVME] Namespace %u: %u-byte LBA format not supported", nsid, 1u << lbads);
+        return;
+    }
+
+    nvme_ns_t *ns = kmalloc(sizeof(*ns));
+    if (!ns) return;
+    memset(ns, 0, sizeof(*ns));
+    ns->nsid = nsid;
+    ns->sectors = nsze;
+    memcpy(ns->name, "nvme0n", 6);
+    ns->name[6] = (char)('0' + nsid % 10);
+
+    ns->bdev.name = ns->name;
+    ns->bdev.sector_size = 512;
+    ns->bdev.sectors = nsze;
+    ns->bdev.priv = ns;
+    blk_queue_init(&ns->queue, ctrl.max_sectors, nvme_queue_kick, ns);
+    ns->bdev.queue = &ns->queue;
+    ctrl.ns[ctrl.nns++] = ns;
+
+    klog(KLOG_INFO, "[NVME] %s: %u MiB", ns->name, (uint32_t)(nsze / 2048));
+}
+
+/* Só o primeiro controlador */
+static int nvme_pci_probe(pci_dev_t *d) {
+    if (ctrl.regs) return -1;
+
+    volatile uint8_t *regs = pci_map_bar(d, 0);
+    if (!regs) {
+        klog(KLOG_WARN, "[NVME] BAR0 is not a memory BAR");
+        return -1;
+    }
+    pci_addr_t pa = d->addr;
+    pci_enable_bus_master(pa);
+    ctrl.regs = regs;
+    ctrl.cap = nvme_read64(NVME_REG_CAP);
+    ctrl.dstrd = 4u << CAP_DSTRD(ctrl.cap);
+    blk_poller_init(&ctrl.poller, &nvme_poll_ops, NULL);
+
+    if (CAP_MPSMIN(ctrl.cap) != 0) {
+        klog(KLOG_WARN, "[NVME] Controller does not support 4 KiB pages");
+        return -1;
+    }
+    if (nvme_enable() < 0) {
+        klog(KLOG_ERROR, "[NVME] Controller did not become ready (CSTS 0x%x)", nvme_read(NVME_REG_CSTS));
+        return -1;
+    }
+
+    uint8_t *id = pmalloc(1);
+    if (!id) return -1;
+    if (nvme_identify(NVME_CNS_CONTROLLER, 0, id) < 0) {
+        klog(KLOG_ERROR, "[NVME] Identify Controller failed");
+        pfree(id, 1);
+        return -1;
+    }
+    char model[41];
+    memcpy(model, id + 24, 40);
+    model[40] = 0;
+    for (int i = 39; i >= 0 && model[i] == ' '; i--) model[i] = 0;
+    uint32_t mdts = id[77];
+    uint32_t nn = *(uint32_t *)(id + 516);
+    ctrl.vwc = id[525] & 1;
+    ctrl.max_sectors = NVME_MAX_SECTORS;
+    if (mdts && mdts < 16 && ((NVME_PAGE_SIZE / 512u) << mdts) < ctrl.max_sectors) {
+        ctrl.max_sectors = (NVME_PAGE_SIZE / 512u) << mdts;
+    }
+
+    if (nvme_setup_io_queues() < 0) {
+        klog(KLOG_ERROR, "[NVME] No I/O queues");
+        pfree(id, 1);
+        return -1;
+    }
+
+    uint32_t vs = nvme_read(NVME_REG_VS);
+    klog(KLOG_INFO, "[NVME] %x:%x.%x %s, NVMe %u.%u, %u I/O queue pair(s) x %u, %u sectors max%s",
+         pa.bus, pa.dev, pa.func, model, vs >> 16, (vs >> 8) & 0xFF, ctrl.nqp,
+         ctrl.qps[0]->slots.depth, ctrl.max_sectors, ctrl.vwc ? ", write cache" : "");
+
+    for (uint32_t nsid = 1; nsid <= nn && ctrl.nns < NVME_MAX_NS; nsid++) nvme_probe_ns(nsid, id);
+    pfree(id, 1);
+
+    if (ctrl.nns) blk_poller_start(&ctrl.poller, "nvme0");
+    for (int i = 0; i < ctrl.nns; i++) blockdev_add_disk(&ctrl.ns[i]->bdev);
+    return ctrl.nns ? 0 : -1;
+}
+
+static const pci_match_t nvme_pci_ids[] = {
+    PCI_MATCH_CLASS(PCI_CLASS_STORAGE, PCI_SUBCLASS_NVM, PCI_PROG_IF_NVME),
+    { 0 },
+};
+
+static const pci_driver_t nvme_pci_driver = {
+    .name = "nvme", .ids = nvme_pci_ids, .probe = nvme_pci_probe,
+};
+
+int nvme_init(void) {
+    pci_register_driver(&nvme_pci_driver);
+    if (!ctrl.regs) klog(KLOG_INFO, "[NVME] No NVMe controller");
+    return ctrl.nns ? 0 : -1;
+}
+
+int nvme_ns_count(void) {
+    return ctrl.nns;
+}
+
+blockdev_t *nvme_blockdev(int idx) {
+    if (idx < 0 || idx >= ctrl.nns) return NULL;
+    return &ctrl.ns[idx]->bdev;
+}
+
+void nvme_dump_stats(void) {
+    for (uint32_t i = 0; i < ctrl.nqp; i++) {
+        nvme_qp_t *q = ctrl.qps[i];
+        klog(KLOG_INFO, "[NVME] queue %u: %u commands, %u doorbells, max %u in flight, %u bounced, %u errors",
+             q->qid, (uint32_t)q->commands, (uint32_t)q->doorbells, q->slots.max_inflight,
+             (uint32_t)q->bounced, (uint32_t)q->errors);
+    }
+}
@@ -0,0 +1,22 @@
+// nvme.h - Driver NVMe (PCI classe 01h/08h) com filas por CPU
+//
+// Acha o controlador pelo PCI, monta a fila admin, pede um par de filas de
+// I/O (SQ/CQ) por CPU e expõe cada namespace como blockdev ("nvme0n1"...).
+// Quem submete usa o par do próprio CPU; dados por PRP (lista quando passa
+// de duas páginas). Conclusões por polling das CQs.
+#pragma once
+#include <stdint.h>
+#include "blockdev.h"
+
+#define NVME_MAX_NS 4
+
+/* Acha o controlador e inicializa os namespaces; 0 se achou algum */
+int nvme_init(void);
+
+int nvme_ns_count(void);
+
+/* Namespace 'idx' (ordem de NSID) como blockdev; NULL se não existe */
+blockdev_t *nvme_blockdev(int idx);
+
+/* Loga comandos, doorbells e profundidade máxima por par de filas */
+void nvme_dump_stats(void);
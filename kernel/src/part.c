@@ -0,0 +1,349 @@
+// part.c - Tabelas de partição (GPT, MBR e partições lógicas)
+//
+// Setor 0 com 0x55AA e entradas coerentes (status 0x00/0x80) é MBR; um
+// boot sector FAT também termina em 0x55AA, então disco sem tabela (FAT
+// direto no setor 0) é reconhecido pelo BPB e fica sem partições. Uma
+// entrada 0xEE (MBR protetor) manda para a GPT: cabeçalho no LBA 1 (ou a
+// cópia no último LBA, se o primário não fecha o CRC32) e entradas com o
+// CRC32 do cabeçalho.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "part.h"
+#include "blockdev.h"
+#include "kmalloc.h"
+#include "string.h"
+
+extern void klog(int level, const char *fmt, ...);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+#define MBR_TABLE_OFFSET    0x1BE
+#define MBR_TYPE_GPT        0xEE
+
+#define GPT_SIGNATURE       "EFI PART"
+#define GPT_MAX_TABLE       (64 * 1024)   /* Bytes de entradas aceitos */
+
+typedef struct mbr_entry {
+    uint8_t status;               /* 0x80 = ativa */
+    uint8_t chs_first[3];
+    uint8_t type;
+    uint8_t chs_last[3];
+    uint32_t lba;
+    uint32_t count;
+} __attribute__((packed)) mbr_entry_t;
+
+typedef struct gpt_header {
+    char signature[8];
+    uint32_t revision;
+    uint32_t header_size;
+    uint32_t header_crc;          /* CRC32 de header_size bytes, com este campo 0 */
+    uint32_t reserved;
+    uint64_t my_lba;
+    uint64_t alternate_lba;
+    uint64_t first_usable;
+    uint64_t last_usable;
+    uint8_t disk_guid[16];
+    uint64_t entries_lba;
+    uint32_t num_entries;
+    uint32_t entry_size;
+    uint32_t entries_crc;
+} __attribute__((packed)) gpt_header_t;
+
+typedef struct gpt_entry {
+    part_guid_t type;             /* Zero: entrada livre */
+    part_guid_t unique;
+    uint64_t first_lba;
+    uint64_t last_lba;            /* Inclusivo */
+    uint64_t attrs;
+    uint16_t name[PART_LABEL_MAX];
+} __attribute__((packed)) gpt_entry_t;
+
+typedef struct part {
+    blockdev_t bdev;
+    char name[16];
+    uint8_t type;                 /* MBR */
+    int gpt;
+    part_guid_t type_guid;
+    char label[PART_LABEL_MAX + 1];
+} part_t;
+
+/* Todas as partições registradas, para as buscas por tipo/rótulo */
+static part_t *parts[BLOCKDEV_MAX];
+static int nparts;
+
+/* ===================== CRC32 ===================== */
+
+/* CRC-32 IEEE (refletido, 0xEDB88320), o da GPT; tabela no primeiro uso */
+static uint32_t crc32_table[256];
+
+static uint32_t crc32(const void *data, size_t len) {
+    if (!crc32_table[1]) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crc32_table[i] = c;
+        }
+    }
+    const uint8_t *p = data;
+    uint32_t c = 0xFFFFFFFFu;
+    while (len--) c = crc32_table[(c ^ *p++) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+/* ===================== REGISTRO ===================== */
+
+static int part_is_extended(uint8_t type) {
+    return type == 0x05 || type == 0x0F || type == 0x85;
+}
+
+/* "<disco>p<N>" */
+static void part_name(char *out, const char *disk, int index) {
+    size_t n = strlen(disk);
+    if (n > 10) n = 10;
+    memcpy(out, disk, n);
+    out[n++] = 'p';
+    if (index >= 100) out[n++] = (char)('0' + index / 100);
+    if (index >= 10) out[n++] = (char)('0' + index / 10 % 10);
+    out[n++] = (char)('0' + index % 10);
+    out[n] = '\0';
+}
+
+static part_t *part_add(blockdev_t *disk, int index, uint64_t start, uint64_t count, uint8_t type) {
+    if (!count || start >= disk->sectors || count > disk->sectors - start) {
+        klog(KLOG_WARN, "[PART] %s: partition %d outside the disk, ignored", disk->name, index);
+        return NULL;
+    }
+    if (nparts >= BLOCKDEV_MAX) return NULL;
+
+    part_t *p = kmalloc(sizeof(*p));
+    if (!p) return NULL;
+    memset(p, 0, sizeof(*p));
+    part_name(p->name, disk->name, index);
+    p->type = type;
+
+    p->bdev.name = p->name;
+    p->bdev.sector_size = disk->sector_size;
+    p->bdev.sectors = count;
+    p->bdev.priv = p;
+    p->bdev.parent = disk;
+    p->bdev.start = start;
+    if (blockdev_register(&p->bdev) < 0) {
+        kfree(p);
+        return NULL;
+    }
+    parts[nparts++] = p;
+    return p;
+}
+
+/* ===================== MBR ===================== */
+
+static part_t *part_add_mbr(blockdev_t *disk, int index, uint64_t start, uint64_t count,
+                           uint8_t type) {
+    part_t *p = part_add(disk, index, start, count, type);
+    if (p) {
+        klog(KLOG_INFO, "[PART] %s: type 0x%x, LBA %u, %u MiB",
+             p->name, type, (uint32_t)start, (uint32_t)(count / 2048));
+    }
+    return p;
+}
+
+/* Setor 0 é um boot sector FAT (sem tabela de partições)? */
+static int part_is_fat_boot(const uint8_t *sec) {
+    uint16_t bps = (uint16_t)(sec[11] | (sec[12] << 8));
+    if (bps != 512) return 0;
+    return memcmp(sec + 0x52, "FAT32", 5) == 0 || memcmp(sec + 0x36, "FAT", 3) == 0;
+}
+
+/* Lógicas: cada EBR tem a partição (relativa ao EBR) e o próximo EBR
+ * (relativo ao início da estendida) */
+static int part_scan_extended(blockdev_t *disk, uint64_t ext_start, uint8_t *sec) {
+    uint64_t ebr = ext_start;
+    int found = 0;
+
+    for (int i = 0; i < PART_MAX_LOGICAL; i++) {
+        if (blockdev_read(disk, ebr, 1, sec) != 0 || sec[510] != 0x55 || sec[511] != 0xAA) break;
+
+        mbr_entry_t e[2];
+        memcpy(e, sec + MBR_TABLE_OFFSET, sizeof(e));
+        if (e[0].type && e[0].count &&
+            part_add_mbr(disk, 5 + i, ebr + e[0].lba, e[0].count, e[0].type)) {
+            found++;
+        }
+        if (!part_is_extended(e[1].type) || !e[1].lba) break;
+        ebr = ext_start + e[1].lba;
+    }
+    return found;
+}
+
+/* ===================== GPT ===================== */
+
+/* Lê e valida o cabeçalho em 'lba' (assinatura, CRC32, limites) */
+static int gpt_read_header(blockdev_t *disk, uint64_t lba, uint8_t *sec, gpt_header_t *h) {
+    if (blockdev_read(disk, lba, 1, sec) != 0) return -1;
+    memcpy(h, sec, sizeof(*h));
+
+    if (memcmp(h->signature, GPT_SIGNATURE, 8) != 0) return -1;
+    if (h->header_size < sizeof(*h) || h->header_size > 512) return -1;
+    uint32_t crc = h->header_crc;
+    memset(sec + 16, 0, 4);
+    if (crc32(sec, h->header_size) != crc) return -1;
+
+    if (h->my_lba != lba) return -1;
+    if (h->first_usable > h->last_usable || h->last_usable >= disk->sectors) return -1;
+    if (h->entry_size < sizeof(gpt_entry_t) || (h->entry_size & 7)) return -1;
+    if (!h->num_entries || (uint64_t)h->num_entries * h->entry_size > GPT_MAX_TABLE) return -1;
+    return 0;
+}
+
+/* Lê o vetor de entradas e confere o CRC32; buffer de kmalloc ou NULL */
+static uint8_t *gpt_read_entries(blockdev_t *disk, const gpt_header_t *h) {
+    uint32_t bytes = h->num_entries * h->entry_size;
+    uint32_t sectors = (bytes + 511) / 512;
+    if (h->entries_lba >= disk->sectors || sectors > disk->sectors - h->entries_lba) return NULL;
+
+    uint8_t *buf = kmalloc(sectors * 512);
+    if (!buf) return NULL;
+    if (blockdev_read(disk, h->entries_lba, sectors, buf) != 0 ||
+        crc32(buf, bytes) != h->entries_crc) {
+        kfree(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+static int gpt_guid_is_zero(const part_guid_t *g) {
+    for (int i = 0; i < 16; i++) {
+        if (g->b[i]) return 0;
+    }
+    return 1;
+}
+
+/* Nome UTF-16LE para ASCII ('?' fora dele) */
+static void gpt_label(char *out, const gpt_entry_t *e) {
+    int i;
+    for (i = 0; i < PART_LABEL_MAX && e->name[i]; i++) {
+        uint16_t c = e->name[i];
+        out[i] = (c >= 0x20 && c < 0x7F) ? (char)c : '?';
+    }
+    out[i] = '\0';
+}
+
+static int part_scan_gpt(blockdev_t *disk, uint8_t *sec) {
+    gpt_header_t h;
+    uint8_t *entries = NULL;
+
+    /* Primário no LBA 1; se não fecha, a cópia no fim do disco */
+    if (gpt_read_header(disk, 1, sec, &h) == 0) entries = gpt_read_entries(disk, &h);
+    if (!entries) {
+        klog(KLOG_WARN, "[PART] %s: primary GPT invalid, trying backup", disk->name);
+        if (gpt_read_header(disk, disk->sectors - 1, sec, &h) == 0) {
+            entries = gpt_read_entries(disk, &h);
+        }
+    }
+    if (!entries) {
+        klog(KLOG_ERROR, "[PART] %s: no valid GPT", disk->name);
+        return 0;
+    }
+
+    int found = 0;
+    for (uint32_t i = 0; i < h.num_entries; i++) {
+        gpt_entry_t e;
+        memcpy(&e, entries + i * h.entry_size, sizeof(e));
+        if (gpt_guid_is_zero(&e.type)) continue;
+        if (e.first_lba < h.first_usable || e.last_lba > h.last_usable ||
+            e.first_lba > e.last_lba) {
+            klog(KLOG_WARN, "[PART] %s: GPT entry %u out of range, ignored", disk->name, i);
+            continue;
+        }
+
+        part_t *p = part_add(disk, (int)i + 1, e.first_lba, e.last_lba - e.first_lba + 1, 0);
+        if (!p) continue;
+        p->gpt = 1;
+        p->type_guid = e.type;
+        gpt_label(p->label, &e);
+        klog(KLOG_INFO, "[PART] %s: GPT \"%s\", LBA %u, %u MiB", p->name, p->label,
+             (uint32_t)e.first_lba, (uint32_t)(p->bdev.sectors / 2048));
+        found++;
+    }
+    kfree(entries);
+    return found;
+}
+
+/* ===================== VARREDURA E BUSCA ===================== */
+
+int part_scan(blockdev_t *disk) {
+    uint8_t sec[512];
+    if (!disk || disk->parent || disk->sector_size != 512) return 0;
+    if (blockdev_read(disk, 0, 1, sec) != 0) return 0;
+    if (sec[510] != 0x55 || sec[511] != 0xAA || part_is_fat_boot(sec)) return 0;
+
+    mbr_entry_t e[4];
+    memcpy(e, sec + MBR_TABLE_OFFSET, sizeof(e));
+    for (int i = 0; i < 4; i++) {
+        if (e[i].status != 0x00 && e[i].status != 0x80) return 0;
+    }
+    /* MBR protetor (ou híbrido): vale a GPT */
+    for (int i = 0; i < 4; i++) {
+        if (e[i].type == MBR_TYPE_GPT) return part_scan_gpt(disk, sec);
+    }
+
+    int found = 0;
+    for (int i = 0; i < 4; i++) {
+        if (!e[i].type || !e[i].count) continue;
+        if (part_is_extended(e[i].type)) {
+            found += part_scan_extended(disk, e[i].lba, sec);
+            continue;
+        }
+        if (part_add_mbr(disk, i + 1, e[i].lba, e[i].count, e[i].type)) found++;
+    }
+    return found;
+}
+
+uint8_t part_mbr_type(blockdev_t *dev) {
+    if (!dev || !dev->parent) return 0;
+    return ((part_t *)dev->priv)->type;
+}
+
+int part_maybe_fat(blockdev_t *dev) {
+    static const part_guid_t esp = PART_GUID_ESP;
+    static const part_guid_t basic = PART_GUID_BASIC_DATA;
+
+    if (!dev || !dev->parent) return 1;
+    part_t *p = dev->priv;
+    if (p->gpt) {
+        return memcmp(&p->type_guid, &esp, sizeof(esp)) == 0 ||
+               memcmp(&p->type_guid, &basic, sizeof(basic)) == 0;
+    }
+    /* Os mesmos tipos que fat32_mount procura no MBR */
+    switch (p->type) {
+    case 0x0B: case 0x0C: case 0x0E: case 0x1B: case 0x1C: case 0x1E:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+blockdev_t *part_find_by_type(const part_guid_t *type) {
+    for (int i = 0; i < nparts; i++) {
+        if (parts[i]->gpt && memcmp(&parts[i]->type_guid, type, sizeof(*type)) == 0) {
+            return &parts[i]->bdev;
+        }
+    }
+    return NULL;
+}
+
+blockdev_t *part_find_by_label(const char *label) {
+    for (int i = 0; i < nparts; i++) {
+        if (parts[i]->gpt && strcmp(parts[i]->label, label) == 0) return &parts[i]->bdev;
+    }
+    return NULL;
+}
+
+const char *part_label(blockdev_t *dev) {
+    if (!dev || !dev->parent) return "";
+    return ((part_t *)dev->priv)->label;
+}
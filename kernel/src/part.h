@@ -0,0 +1,42 @@
+// part.h - Tabelas de partição: cada partição vira um blockdev filho
+//
+// part_scan() lê a tabela do disco (GPT, ou MBR com as lógicas da
+// estendida) e registra cada partição como "<disco>p<N>" (GPT: N é a
+// entrada + 1; MBR: primárias 1-4, lógicas a partir de 5), com 'parent' e
+// 'start' apontando para o disco. Tipo e rótulo ficam numa tabela em
+// memória: achar o volume certo não lê o disco.
+#pragma once
+#include <stdint.h>
+#include "blockdev.h"
+
+#define PART_MAX_LOGICAL 32       /* EBRs seguidos na cadeia da estendida */
+#define PART_LABEL_MAX   36       /* Nome GPT: 36 caracteres UTF-16 */
+
+/* GUIDs como ficam no disco (três primeiros campos little-endian) */
+typedef struct part_guid {
+    uint8_t b[16];
+} part_guid_t;
+
+/* C12A7328-F81F-11D2-BA4B-00A0C93EC93B */
+#define PART_GUID_ESP { { 0x28, 0x73, 0x2A, 0xC1, 0x1F, 0xF8, 0xD2, 0x11, \
+                          0xBA, 0x4B, 0x00, 0xA0, 0xC9, 0x3E, 0xC9, 0x3B } }
+/* EBD0A0A2-B9E5-4433-87C0-68B6B72699C7 (Microsoft basic data: FAT, NTFS) */
+#define PART_GUID_BASIC_DATA { { 0xA2, 0xA0, 0xD0, 0xEB, 0xE5, 0xB9, 0x33, 0x44, \
+                                 0x87, 0xC0, 0x68, 0xB6, 0xB7, 0x26, 0x99, 0xC7 } }
+
+/* Registra as partições do disco; devolve quantas achou */
+int part_scan(blockdev_t *disk);
+
+/* Tipo MBR (0x0C = FAT32 LBA...) da partição; 0 se 'dev' não é partição MBR */
+uint8_t part_mbr_type(blockdev_t *dev);
+
+/* Pode ter FAT pelo tipo (MBR FAT, GPT ESP/basic data)? 1 também para
+ * quem não é partição, que só a leitura do BPB decide */
+int part_maybe_fat(blockdev_t *dev);
+
+/* Primeira partição GPT com o tipo / o rótulo dado; NULL se não há */
+blockdev_t *part_find_by_type(const part_guid_t *type);
+blockdev_t *part_find_by_label(const char *label);
+
+/* Rótulo GPT da partição ("" em MBR ou se não é partição) */
+const char *part_label(blockdev_t *dev);
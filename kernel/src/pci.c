@@ -0,0 +1,487 @@
+// pci.c - PCI/PCIe: espaço de configuração, varredura, BARs, MSI e drivers
+//
+// O espaço de configuração vai pelo ECAM quando a MCFG descreve o
+// barramento (4 KiB por função, acesso MMIO sem lock) e pelo par
+// 0xCF8/0xCFC no resto. A varredura parte do host bridge e desce pelas
+// pontes PCI-PCI (barramento secundário), montando a lista de pci_dev_t
+// com BARs dimensionados e capabilities já lidas.
+
+#include "pci.h"
+#include "acpi.h"
+#include "spinlock.h"
+#include "pmm.h"
+#include "kmalloc.h"
+#include "string.h"
+
+extern void klog(int level, const char *fmt, ...);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+#define PCI_MAX_ECAM       4
+
+static inline uint32_t inl(uint16_t port) { uint32_t ret; asm volatile("inl %1, %0" : "=a"(ret) : "Nd"(port)); return ret; }
+static inline void outl(uint16_t port, uint32_t val) { asm volatile("outl %0, %1" : : "a"(val), "Nd"(port)); }
+
+/* ADDRESS+DATA é um par: dois CPUs não podem intercalar */
+static spinlock_t pci_lock = SPINLOCK_INIT;
+
+/* Janelas ECAM do segmento 0 (MCFG) */
+static struct {
+    uint64_t base;
+    uint8_t bus_start;
+    uint8_t bus_end;
+} ecam[PCI_MAX_ECAM];
+static int necam;
+
+static pci_dev_t *dev_list;
+static int ndevs;
+static int pci_ready;
+
+static const pci_driver_t *drivers[PCI_MAX_DRIVERS];
+static int ndrivers;
+
+static int pci_map_mmio(uint64_t phys, uint64_t size);
+
+/* ===================== ESPAÇO DE CONFIGURAÇÃO ===================== */
+
+static uint32_t pci_address(pci_addr_t a, uint16_t off) {
+    return 0x80000000u | ((uint32_t)a.bus << 16) | ((uint32_t)a.dev << 11) |
+           ((uint32_t)a.func << 8) | (off & 0xFC);
+}
+
+static volatile uint32_t *pci_ecam(pci_addr_t a, uint16_t off) {
+    for (int i = 0; i < necam; i++) {
+        if (a.bus < ecam[i].bus_start || a.bus > ecam[i].bus_end) continue;
+        return (volatile uint32_t *)(ecam[i].base +
+            ((uint64_t)(a.bus - ecam[i].bus_start) << 20) +
+            ((uint64_t)a.dev << 15) + ((uint64_t)a.func << 12) + (off & 0xFFC));
+    }
+    return NULL;
+}
+
+uint32_t pci_read32(pci_addr_t a, uint16_t off) {
+    volatile uint32_t *e = pci_ecam(a, off);
+    if (e) return *e;
+    if (off >= 256) return 0xFFFFFFFF;          /* Estendido só por ECAM */
+
+    uint64_t flags = spinlock_lock_irqsave(&pci_lock);
+    outl(PCI_CONFIG_ADDRESS, pci_address(a, off));
+    uint32_t val = inl(PCI_CONFIG_DATA);
+    spinlock_unlock_irqrestore(&pci_lock, flags);
+    return val;
+}
+
+uint16_t pci_read16(pci_addr_t a, uint16_t off) {
+    return (uint16_t)(pci_read32(a, off) >> ((off & 2) * 8));
+}
+
+uint8_t pci_read8(pci_addr_t a, uint16_t off) {
+    return (uint8_t)(pci_read32(a, off) >> ((off & 3) * 8));
+}
+
+void pci_write32(pci_addr_t a, uint16_t off, uint32_t val) {
+    volatile uint32_t *e = pci_ecam(a, off);
+    if (e) {
+        *e = val;
+        return;
+    }
+    if (off >= 256) return;
+
+    uint64_t flags = spinlock_lock_irqsave(&pci_lock);
+    outl(PCI_CONFIG_ADDRESS, pci_address(a, off));
+    outl(PCI_CONFIG_DATA, val);
+    spinlock_unlock_irqrestore(&pci_lock, flags);
+}
+
+void pci_write16(pci_addr_t a, uint16_t off, uint16_t val) {
+    uint32_t shift = (off & 2) * 8;
+    uint32_t old = pci_read32(a, off);
+    old &= ~(0xFFFFu << shift);
+    pci_write32(a, off, old | ((uint32_t)val << shift));
+}
+
+/* ===================== ECAM (MCFG) ===================== */
+
+typedef struct acpi_mcfg_entry {
+    uint64_t base;
+    uint16_t segment;
+    uint8_t bus_start;
+    uint8_t bus_end;
+    uint32_t reserved;
+} __attribute__((packed)) acpi_mcfg_entry_t;
+
+static void pci_ecam_init(void) {
+    const acpi_sdt_header_t *mcfg = acpi_find_table("MCFG");
+    if (!mcfg) return;
+
+    /* Cabeçalho + 8 bytes reservados, depois as entradas */
+    const uint8_t *p = (const uint8_t *)mcfg + sizeof(acpi_sdt_header_t) + 8;
+    const uint8_t *end = (const uint8_t *)mcfg + mcfg->length;
+    for (; p + sizeof(acpi_mcfg_entry_t) <= end && necam < PCI_MAX_ECAM;
+         p += sizeof(acpi_mcfg_entry_t)) {
+        acpi_mcfg_entry_t e;
+        memcpy(&e, p, sizeof(e));
+        if (e.segment != 0 || e.bus_end < e.bus_start) continue;   /* Só o segmento 0 */
+
+        uint64_t size = ((uint64_t)(e.bus_end - e.bus_start) + 1) << 20;
+        if (pci_map_mmio(e.base, size) < 0) {
+            klog(KLOG_WARN, "[PCI] Cannot map ECAM at %u MiB", (uint32_t)(e.base >> 20));
+            continue;
+        }
+        ecam[necam].base = e.base;
+        ecam[necam].bus_start = e.bus_start;
+        ecam[necam].bus_end = e.bus_end;
+        necam++;
+        klog(KLOG_INFO, "[PCI] ECAM at %u MiB, buses %u-%u",
+             (uint32_t)(e.base >> 20), e.bus_start, e.bus_end);
+    }
+}
+
+/* ===================== MAPEAMENTO ===================== */
+
+#define PTE_PRESENT     0x001ULL
+#define PTE_WRITE       0x002ULL
+#define PTE_PWT         0x008ULL
+#define PTE_PCD         0x010ULL
+#define PTE_LARGE       0x080ULL
+#define PTE_ADDR        0x000FFFFFFFFFF000ULL
+#define PCI_MAP_2M      0x200000ULL
+
+static spinlock_t map_lock = SPINLOCK_INIT;
+
+/* Tabela do próximo nível na entrada 'idx' (criada se falta). 1 = ok;
+ * 0 = já coberta por página grande; -1 = sem memória ou inacessível */
+static int pci_pt_next(uint64_t *table, uint32_t idx, uint64_t **next) {
+    uint64_t e = table[idx];
+    if (e & PTE_PRESENT) {
+        if (e & PTE_LARGE) return 0;
+        if ((e & PTE_ADDR) >= 0x100000000ULL) return -1;   /* Fora da identidade */
+        *next = (uint64_t *)(e & PTE_ADDR);
+        return 1;
+    }
+    uint64_t *t = pmalloc(1);
+    if (!t) return -1;
+    memset(t, 0, PMM_PAGE_SIZE);
+    table[idx] = pmm_virt_to_phys(t) | PTE_PRESENT | PTE_WRITE;
+    *next = t;
+    return 1;
+}
+
+/* MMIO acima de 4 GiB: mapeia em identidade (virtual == físico) com
+ * páginas de 2 MiB sem cache. Abaixo disso o mapa do Limine já cobre. */
+static int pci_map_mmio(uint64_t phys, uint64_t size) {
+    if (phys + size <= 0x100000000ULL) return 0;
+    if (phys + size > (1ULL << 47)) return -1;  /* Metade baixa canônica */
+
+    uint64_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    uint64_t *pml4 = (uint64_t *)(cr3 & PTE_ADDR);
+    if ((cr3 & PTE_ADDR) >= 0x100000000ULL) return -1;
+
+    int rc = 0;
+    uint64_t flags = spinlock_lock_irqsave(&map_lock);
+    for (uint64_t va = phys & ~(PCI_MAP_2M - 1); va < phys + size; va += PCI_MAP_2M) {
+        uint64_t *pdpt, *pd;
+        int r = pci_pt_next(pml4, (va >> 39) & 511, &pdpt);
+        if (r == 0) continue;
+        if (r < 0 || (r = pci_pt_next(pdpt, (va >> 30) & 511, &pd)) < 0) { rc = -1; break; }
+        if (r == 0) continue;
+
+        uint32_t i = (va >> 21) & 511;
+        if (pd[i] & PTE_PRESENT) continue;
+        pd[i] = va | PTE_PRESENT | PTE_WRITE | PTE_PCD | PTE_PWT | PTE_LARGE;
+        asm volatile("invlpg (%0)" : : "r"(va) : "memory");
+    }
+    spinlock_unlock_irqrestore(&map_lock, flags);
+    return rc;
+}
+
+volatile void *pci_map_bar(pci_dev_t *d, int bar) {
+    if (!d || bar < 0 || bar >= PCI_MAX_BARS) return NULL;
+    pci_bar_t *b = &d->bars[bar];
+    if (!b->size || (b->flags & PCI_BAR_IO) || !b->base) return NULL;
+    if (pci_map_mmio(b->base, b->size) < 0) return NULL;
+    return (volatile void *)b->base;
+}
+
+/* ===================== VARREDURA ===================== */
+
+/* Dimensiona o BAR 'i' (decodificação já desligada); quantos índices usa */
+static int pci_size_bar(pci_dev_t *d, int i) {
+    pci_addr_t a = d->addr;
+    uint16_t off = PCI_BAR0 + i * 4;
+    pci_bar_t *b = &d->bars[i];
+
+    uint32_t orig = pci_read32(a, off);
+    pci_write32(a, off, 0xFFFFFFFF);
+    uint32_t mask = pci_read32(a, off);
+    pci_write32(a, off, orig);
+
+    if (orig & 1) {
+        uint32_t m = mask & ~3u;
+        b->flags = PCI_BAR_IO;
+        b->base = orig & ~3u;
+        b->size = m ? (~m + 1) & 0xFFFF : 0;
+        return 1;
+    }
+
+    uint64_t base = orig & ~0xFu;
+    uint64_t m = mask & ~0xFu;
+    int used = 1;
+    if (orig & 0x8) b->flags |= PCI_BAR_PREFETCH;
+    if (((orig >> 1) & 3) == 2 && i + 1 < PCI_MAX_BARS) {
+        uint32_t hi = pci_read32(a, off + 4);
+        pci_write32(a, off + 4, 0xFFFFFFFF);
+        uint32_t mask_hi = pci_read32(a, off + 4);
+        pci_write32(a, off + 4, hi);
+        base |= (uint64_t)hi << 32;
+        m |= (uint64_t)mask_hi << 32;
+        b->flags |= PCI_BAR_64;
+        used = 2;
+    } else if (m) {
+        /* Estende só BAR implementado: um vazio lê 0 e tem tamanho 0 */
+        m |= 0xFFFFFFFF00000000ULL;
+    }
+    b->base = base;
+    b->size = m ? ~m + 1 : 0;
+    return used;
+}
+
+static void pci_read_bars(pci_dev_t *d, int count) {
+    uint16_t cmd = pci_read16(d->addr, PCI_COMMAND);
+    pci_write16(d->addr, PCI_COMMAND, cmd & ~(PCI_CMD_IO | PCI_CMD_MEMORY));
+    for (int i = 0; i < count; ) i += pci_size_bar(d, i);
+    pci_write16(d->addr, PCI_COMMAND, cmd);
+}
+
+static void pci_read_caps(pci_dev_t *d) {
+    pci_addr_t a = d->addr;
+    if (!(pci_read16(a, PCI_STATUS) & PCI_STATUS_CAP_LIST)) return;
+
+    uint8_t ptr = pci_read8(a, PCI_CAPABILITIES) & 0xFC;
+    for (int guard = 0; ptr && guard < 48; guard++) {
+        uint8_t id = pci_read8(a, ptr);
+        uint16_t ctrl = pci_read16(a, ptr + 2);
+
+        if (id == PCI_CAP_ID_PCIE) {
+            d->pcie_cap = ptr;
+        } else if (id == PCI_CAP_ID_MSI) {
+            d->msi_cap = ptr;
+            d->msi_vectors = (uint8_t)(1u << ((ctrl >> 1) & 7));
+            d->msi_64 = (ctrl >> 7) & 1;
+        } else if (id == PCI_CAP_ID_MSIX) {
+            uint32_t table = pci_read32(a, ptr + 4);
+            uint32_t pba = pci_read32(a, ptr + 8);
+            d->msix_cap = ptr;
+            d->msix_vectors = (ctrl & 0x7FF) + 1;
+            d->msix_table_bar = table & 7;
+            d->msix_table_off = table & ~7u;
+            d->msix_pba_bar = pba & 7;
+            d->msix_pba_off = pba & ~7u;
+        }
+        ptr = pci_read8(a, ptr + 1) & 0xFC;
+    }
+}
+
+static uint8_t bus_seen[256 / 8];
+
+static void pci_scan_bus(uint8_t bus);
+
+static void pci_add_func(pci_addr_t a) {
+    pci_dev_t *d = kmalloc(sizeof(*d));
+    if (!d) return;
+    memset(d, 0, sizeof(*d));
+
+    d->addr = a;
+    d->vendor = pci_read16(a, PCI_VENDOR_ID);
+    d->device = pci_read16(a, PCI_DEVICE_ID);
+    d->revision = pci_read8(a, PCI_REVISION);
+    d->prog_if = pci_read8(a, PCI_PROG_IF);
+    d->subclass = pci_read8(a, PCI_SUBCLASS);
+    d->class = pci_read8(a, PCI_CLASS);
+    d->header_type = pci_read8(a, PCI_HEADER_TYPE) & 0x7F;
+    d->irq_line = pci_read8(a, PCI_INTERRUPT_LINE);
+
+    if (d->header_type == 0) pci_read_bars(d, 6);
+    else if (d->header_type == 1) pci_read_bars(d, 2);
+    pci_read_caps(d);
+
+    /* Lista na ordem da varredura */
+    pci_dev_t **pp = &dev_list;
+    while (*pp) pp = &(*pp)->next;
+    *pp = d;
+    ndevs++;
+
+    if (d->header_type == 1) {
+        uint8_t sec = pci_read8(a, PCI_SECONDARY_BUS);
+        if (sec > a.bus) pci_scan_bus(sec);
+    }
+}
+
+static void pci_scan_bus(uint8_t bus) {
+    if (bus_seen[bus / 8] & (1u << (bus % 8))) return;
+    bus_seen[bus / 8] |= (uint8_t)(1u << (bus % 8));
+
+    for (uint8_t dev = 0; dev < 32; dev++) {
+        pci_addr_t a = { bus, dev, 0 };
+        if (pci_read16(a, PCI_VENDOR_ID) == 0xFFFF) continue;
+
+        /* Só olha as funções 1-7 em dispositivos multi-função */
+        uint8_t nfunc = (pci_read8(a, PCI_HEADER_TYPE) & 0x80) ? 8 : 1;
+        for (uint8_t f = 0; f < nfunc; f++) {
+            a.func = f;
+            if (pci_read16(a, PCI_VENDOR_ID) == 0xFFFF) continue;
+            pci_add_func(a);
+        }
+    }
+}
+
+void pci_init(void) {
+    if (pci_ready) return;
+    pci_ready = 1;
+
+    pci_ecam_init();
+
+    /* Host bridge multi-função: cada função é a raiz de um barramento */
+    pci_addr_t host = { 0, 0, 0 };
+    if (pci_read8(host, PCI_HEADER_TYPE) & 0x80) {
+        for (uint8_t f = 0; f < 8; f++) {
+            host.func = f;
+            if (pci_read16(host, PCI_VENDOR_ID) != 0xFFFF) pci_scan_bus(f);
+        }
+    } else {
+        pci_scan_bus(0);
+    }
+
+    for (pci_dev_t *d = dev_list; d; d = d->next) {
+        klog(KLOG_INFO, "[PCI] %x:%x.%x %x:%x class %x.%x.%x%s%s%s",
+             d->addr.bus, d->addr.dev, d->addr.func, d->vendor, d->device,
+             d->class, d->subclass, d->prog_if,
+             d->pcie_cap ? " PCIe" : "", d->msi_cap ? " MSI" : "", d->msix_cap ? " MSI-X" : "");
+    }
+    klog(KLOG_INFO, "[PCI] %d function(s), config via %s", ndevs, necam ? "ECAM" : "port I/O");
+}
+
+pci_dev_t *pci_devices(void) {
+    pci_init();
+    return dev_list;
+}
+
+pci_dev_t *pci_get_dev(pci_addr_t a) {
+    for (pci_dev_t *d = pci_devices(); d; d = d->next) {
+        if (d->addr.bus == a.bus && d->addr.dev == a.dev && d->addr.func == a.func) return d;
+    }
+    return NULL;
+}
+
+int pci_find_class(uint8_t class, uint8_t subclass, pci_addr_t *out) {
+    for (pci_dev_t *d = pci_devices(); d; d = d->next) {
+        if (d->class == class && d->subclass == subclass) {
+            *out = d->addr;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int pci_find_id(uint16_t vendor, uint16_t device, int index, pci_addr_t *out) {
+    for (pci_dev_t *d = pci_devices(); d; d = d->next) {
+        if (d->vendor != vendor || d->device != device) continue;
+        if (index-- == 0) {
+            *out = d->addr;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void pci_enable_bus_master(pci_addr_t a) {
+    uint16_t cmd = pci_read16(a, PCI_COMMAND);
+    cmd |= PCI_CMD_IO | PCI_CMD_MEMORY | PCI_CMD_BUS_MASTER;
+    pci_write16(a, PCI_COMMAND, cmd);
+}
+
+/* ===================== DRIVERS ===================== */
+
+static int pci_match_one(const pci_match_t *m, const pci_dev_t *d) {
+    return (m->vendor == PCI_ANY || m->vendor == d->vendor) &&
+           (m->device == PCI_ANY || m->device == d->device) &&
+           (m->class == PCI_ANY || m->class == d->class) &&
+           (m->subclass == PCI_ANY || m->subclass == d->subclass) &&
+           (m->prog_if == PCI_ANY || m->prog_if == d->prog_if);
+}
+
+static int pci_match(const pci_driver_t *drv, const pci_dev_t *d) {
+    for (const pci_match_t *m = drv->ids; m->vendor; m++) {
+        if (pci_match_one(m, d)) return 1;
+    }
+    return 0;
+}
+
+int pci_register_driver(const pci_driver_t *drv) {
+    if (ndrivers >= PCI_MAX_DRIVERS) return -1;
+    drivers[ndrivers++] = drv;
+
+    int bound = 0;
+    for (pci_dev_t *d = pci_devices(); d; d = d->next) {
+        if (d->driver || !pci_match(drv, d)) continue;
+        if (drv->probe(d) == 0) {
+            d->driver = drv;
+            bound++;
+        }
+    }
+    return bound;
+}
+
+/* ===================== MSI / MSI-X ===================== */
+
+#define MSI_ADDRESS(apic)   (0xFEE00000u | ((apic) << 12))
+
+static void pci_intx_off(pci_dev_t *d) {
+    pci_write16(d->addr, PCI_COMMAND, pci_read16(d->addr, PCI_COMMAND) | PCI_CMD_INTX_OFF);
+}
+
+int pci_msi_enable(pci_dev_t *d, uint8_t vector, uint32_t apic_id) {
+    if (!d || !d->msi_cap) return -1;
+    uint8_t cap = d->msi_cap;
+
+    pci_write32(d->addr, cap + 4, MSI_ADDRESS(apic_id));
+    if (d->msi_64) {
+        pci_write32(d->addr, cap + 8, 0);
+        pci_write16(d->addr, cap + 12, vector);
+    } else {
+        pci_write16(d->addr, cap + 8, vector);
+    }
+    uint16_t ctrl = pci_read16(d->addr, cap + 2);
+    ctrl &= ~(7u << 4);                     /* Um vetor só */
+    pci_write16(d->addr, cap + 2, ctrl | 1);
+    pci_intx_off(d);
+    return 0;
+}
+
+int pci_msix_enable(pci_dev_t *d, uint16_t entry, uint8_t vector, uint32_t apic_id) {
+    if (!d || !d->msix_cap || entry >= d->msix_vectors) return -1;
+    volatile uint8_t *bar = pci_map_bar(d, d->msix_table_bar);
+    if (!bar) return -1;
+    uint8_t cap = d->msix_cap;
+
+    /* Function Mask enquanto a entrada é escrita */
+    uint16_t ctrl = pci_read16(d->addr, cap + 2);
+    pci_write16(d->addr, cap + 2, ctrl | 0xC000);
+
+    volatile uint32_t *e = (volatile uint32_t *)(bar + d->msix_table_off + entry * 16u);
+    e[0] = MSI_ADDRESS(apic_id);
+    e[1] = 0;
+    e[2] = vector;
+    e[3] &= ~1u;                            /* Tira a máscara da entrada */
+
+    pci_write16(d->addr, cap + 2, (ctrl | 0x8000) & ~0x4000);
+    pci_intx_off(d);
+    return 0;
+}
@@ -0,0 +1,147 @@
+// pci.h - PCI/PCIe: espaço de configuração, lista de devices e drivers
+//
+// Configuração pelo ECAM (MMIO, da tabela ACPI MCFG) quando existe, senão
+// pelo mecanismo #1 (0xCF8/0xCFC, só os 256 bytes clássicos). pci_init()
+// varre os barramentos a partir das pontes, dimensiona os BARs e lê as
+// capabilities; drivers se registram com uma tabela de vendor/device/classe
+// e são chamados para cada device que casa.
+#pragma once
+#include <stdint.h>
+
+/* Offsets do cabeçalho de configuração */
+#define PCI_VENDOR_ID       0x00
+#define PCI_DEVICE_ID       0x02
+#define PCI_COMMAND         0x04
+#define PCI_STATUS          0x06
+#define PCI_REVISION        0x08
+#define PCI_PROG_IF         0x09
+#define PCI_SUBCLASS        0x0A
+#define PCI_CLASS           0x0B
+#define PCI_HEADER_TYPE     0x0E
+#define PCI_BAR0            0x10
+#define PCI_SECONDARY_BUS   0x19        /* Pontes (header tipo 1) */
+#define PCI_CAPABILITIES    0x34
+#define PCI_INTERRUPT_LINE  0x3C
+
+/* Bits do registrador COMMAND */
+#define PCI_CMD_IO          0x0001
+#define PCI_CMD_MEMORY      0x0002
+#define PCI_CMD_BUS_MASTER  0x0004
+#define PCI_CMD_INTX_OFF    0x0400
+
+#define PCI_STATUS_CAP_LIST 0x0010
+
+/* Capabilities */
+#define PCI_CAP_ID_MSI      0x05
+#define PCI_CAP_ID_PCIE     0x10
+#define PCI_CAP_ID_MSIX     0x11
+
+/* Classes usadas pelos drivers */
+#define PCI_CLASS_STORAGE   0x01
+#define PCI_SUBCLASS_IDE    0x01
+
+#define PCI_MAX_BARS        6
+#define PCI_MAX_DRIVERS     16
+#define PCI_ANY             0xFFFF      /* Curinga em pci_match_t */
+
+typedef struct {
+    uint8_t bus;
+    uint8_t dev;
+    uint8_t func;
+} pci_addr_t;
+
+/* Flags de pci_bar_t */
+#define PCI_BAR_IO          0x01
+#define PCI_BAR_64          0x02
+#define PCI_BAR_PREFETCH    0x04
+
+typedef struct pci_bar {
+    uint64_t base;                      /* Físico (porta, se PCI_BAR_IO) */
+    uint64_t size;                      /* 0 = BAR não implementado */
+    uint32_t flags;
+} pci_bar_t;
+
+struct pci_driver;
+
+typedef struct pci_dev {
+    pci_addr_t addr;
+    uint16_t vendor;
+    uint16_t device;
+    uint8_t class;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t revision;
+    uint8_t header_type;                /* Sem o bit de multi-função */
+    uint8_t irq_line;
+    pci_bar_t bars[PCI_MAX_BARS];       /* 64 bits ocupam o índice baixo */
+
+    /* Capabilities (offset no espaço de configuração; 0 = ausente) */
+    uint8_t pcie_cap;
+    uint8_t msi_cap;
+    uint8_t msi_vectors;                /* Multiple Message Capable */
+    uint8_t msi_64;
+    uint8_t msix_cap;
+    uint16_t msix_vectors;              /* Tamanho da tabela */
+    uint8_t msix_table_bar;
+    uint32_t msix_table_off;
+    uint8_t msix_pba_bar;
+    uint32_t msix_pba_off;
+
+    const struct pci_driver *driver;    /* Quem assumiu o device */
+    void *driver_data;
+    struct pci_dev *next;
+} pci_dev_t;
+
+/* Uma entrada da tabela de um driver; PCI_ANY casa com qualquer valor.
+ * A tabela termina com uma entrada toda zero. */
+typedef struct pci_match {
+    uint16_t vendor;
+    uint16_t device;
+    uint16_t class;
+    uint16_t subclass;
+    uint16_t prog_if;
+} pci_match_t;
+
+#define PCI_MATCH_ID(v, d)          { (v), (d), PCI_ANY, PCI_ANY, PCI_ANY }
+#define PCI_MATCH_CLASS(c, s, p)    { PCI_ANY, PCI_ANY, (c), (s), (p) }
+
+typedef struct pci_driver {
+    const char *name;
+    const pci_match_t *ids;
+    int (*probe)(pci_dev_t *dev);       /* 0 = assumiu o device */
+} pci_driver_t;
+
+uint32_t pci_read32(pci_addr_t a, uint16_t off);
+uint16_t pci_read16(pci_addr_t a, uint16_t off);
+uint8_t pci_read8(pci_addr_t a, uint16_t off);
+void pci_write32(pci_addr_t a, uint16_t off, uint32_t val);
+void pci_write16(pci_addr_t a, uint16_t off, uint16_t val);
+
+/* Acha o ECAM (MCFG) e monta a lista de devices (só na primeira chamada) */
+void pci_init(void);
+
+/* Lista de devices (ordem da varredura) */
+pci_dev_t *pci_devices(void);
+pci_dev_t *pci_get_dev(pci_addr_t a);
+
+/* Primeira função com class/subclass; 0 se achou, -1 se não */
+int pci_find_class(uint8_t class, uint8_t subclass, pci_addr_t *out);
+
+/* 'index'-ésima função com vendor/device; 0 se achou, -1 se não */
+int pci_find_id(uint16_t vendor, uint16_t device, int index, pci_addr_t *out);
+
+/* Liga decodificação de I/O e memória e o bus mastering (DMA) */
+void pci_enable_bus_master(pci_addr_t a);
+
+/* Põe o driver na tabela e chama probe() para cada device livre que
+ * casa; devolve quantos ele assumiu (-1 se a tabela está cheia) */
+int pci_register_driver(const pci_driver_t *drv);
+
+/* Ponteiro para o BAR de memória 'bar' (identidade; acima de 4 GiB cria
+ * o mapeamento sem cache); NULL se é de I/O ou não existe */
+volatile void *pci_map_bar(pci_dev_t *d, int bar);
+
+/* MSI / MSI-X para 'vector' no LAPIC 'apic_id' (desliga o INTx);
+ * 0 ou -1 se o device não tem a capability */
+int pci_msi_enable(pci_dev_t *d, uint8_t vector, uint32_t apic_id);
+int pci_msix_enable(pci_dev_t *d, uint16_t entry, uint8_t vector, uint32_t apic_id);
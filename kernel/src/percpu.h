@@ -0,0 +1,56 @@
+// percpu.h - Acesso à área por CPU via segmento GS
+//
+// Cada CPU aponta IA32_GS_BASE para o seu cpu_t. Os acessores abaixo viram
+// uma única instrução "mov %gs:offset" - sem lock, sem lookup de APIC ID.
+// Só são válidos depois de percpu_install() no CPU atual (smp_init no BSP,
+// ap_main nos APs). Quem lê/escreve campos compartilhados entre CPUs
+// continua precisando de atomics; aqui é só o caminho rápido local.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "smp.h"
+#include "cpu.h"
+
+#define this_cpu_read(field) ({                                        \
+    __typeof__(((cpu_t *)0)->field) __v;                               \
+    asm volatile("mov %%gs:%c1, %0"                                    \
+                 : "=r"(__v)                                           \
+                 : "i"(offsetof(cpu_t, field)));                       \
+    __v;                                                               \
+})
+
+#define this_cpu_write(field, val) do {                                \
+    __typeof__(((cpu_t *)0)->field) __v = (val);                       \
+    asm volatile("mov %0, %%gs:%c1"                                    \
+                 : : "r"(__v), "i"(offsetof(cpu_t, field))             \
+                 : "memory");                                          \
+} while (0)
+
+/* Soma local (não atômica entre CPUs, mas atômica contra interrupções) */
+#define this_cpu_add(field, val) do {                                  \
+    __typeof__(((cpu_t *)0)->field) __v = (val);                       \
+    asm volatile("add %0, %%gs:%c1"                                    \
+                 : : "r"(__v), "i"(offsetof(cpu_t, field))             \
+                 : "memory", "cc");                                    \
+} while (0)
+
+#define this_cpu_inc(field) this_cpu_add(field, 1)
+#define this_cpu_dec(field) this_cpu_add(field, -1)
+
+/* Ponteiro para a área do CPU atual */
+static inline cpu_t *this_cpu(void) {
+    return this_cpu_read(self);
+}
+
+/* Índice lógico do CPU atual */
+static inline uint32_t smp_current_id(void) {
+    return this_cpu_read(id);
+}
+
+/* Instala 'cpu' como área do CPU atual. Recarregar o seletor GS (gdt_load)
+ * zera a base, então isto vem sempre depois da GDT. */
+static inline void percpu_install(cpu_t *cpu) {
+    cpu->self = cpu;
+    wrmsr(MSR_IA32_GS_BASE, (uint64_t)cpu);
+    wrmsr(MSR_IA32_KERNEL_GS, (uint64_t)cpu);
+}
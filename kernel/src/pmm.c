@@ -399,6 +399,15 @@ void pfree(void *ptr, size_t pages) {
     spinlock_unlock(&pmm_lock);
 }
 
+/* Tradução para DMA: endereços devolvidos por pmalloc <-> físicos */
+uint64_t pmm_virt_to_phys(const void *virt) {
+    return VIRT_TO_PHYS(virt);
+}
+
+void *pmm_phys_to_virt(uint64_t phys) {
+    return PHYS_TO_VIRT(phys);
+}
+
 uint64_t pmm_get_free(void) {
     return pmm.free_pages * PMM_PAGE_SIZE;
 }
@@ -26,6 +26,8 @@ void *pmalloc(size_t pages);          // Aloca páginas (múltiplas de 4K)
 void *pmalloc_aligned(size_t pages, size_t alignment);
 void pfree(void *ptr, size_t pages);
 void pmm_set_region(uint64_t base, uint64_t size, bool used);
+uint64_t pmm_virt_to_phys(const void *virt);  // Só para memória do PMM
+void *pmm_phys_to_virt(uint64_t phys);
 uint64_t pmm_get_free(void);
 uint64_t pmm_get_total(void);
 void pmm_dump(void);                  // Debug
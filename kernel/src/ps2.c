@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <stdbool.h>
+#include "waitqueue.h"
 
 extern void printk(const char *fmt, ...);
 
@@ -17,13 +18,15 @@ static inline void outb(uint16_t port, uint8_t val) {
     asm volatile("outb %0, %1" : : "a"(val), "Nd"(port));
 }
 
-/* Esperas utilitárias para o controlador PS/2 */
+/* Esperas utilitárias para o controlador PS/2.
+ * O controlador não gera IRQ para "input buffer vazio", então continua
+ * sendo polling - mas cedendo o CPU entre leituras quando dá. */
 static inline void wait_input_empty(void) {
-    while (inb(PS2_STATUS_PORT) & 0x02) { asm volatile("nop"); }
+    while (inb(PS2_STATUS_PORT) & 0x02) { wait_poll_relax(); }
 }
 
 static inline void wait_output_full(void) {
-    while (!(inb(PS2_STATUS_PORT) & 0x01)) { asm volatile("nop"); }
+    while (!(inb(PS2_STATUS_PORT) & 0x01)) { wait_poll_relax(); }
 }
 
 /* Mapas básicos de scancodes (set 1) para ASCII (simplificado) */
@@ -0,0 +1,99 @@
+// ramdisk.c - Disco em RAM sobre um módulo do Limine ou páginas do PMM
+//
+// O módulo fica na HHDM, em memória EXECUTABLE_AND_MODULES que o PMM não
+// entrega a ninguém; o disco vazio vem de pmalloc (páginas contíguas).
+// Não há fila: submit copia os segmentos e chama bio_endio() ali mesmo.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <limine.h>
+#include "ramdisk.h"
+#include "blockdev.h"
+#include "pmm.h"
+#include "string.h"
+
+extern void klog(int level, const char *fmt, ...);
+extern volatile struct limine_module_request module_request;
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+#define RAMDISK_SECTOR 512
+
+static struct {
+    uint8_t *base;
+    blockdev_t bdev;
+    int present;
+} rd;
+
+static int ramdisk_submit(blockdev_t *dev, bio_t *bio) {
+    (void)dev;
+    if (bio->op == BIO_FLUSH) {
+        bio_endio(bio, 0);
+        return 0;
+    }
+
+    /* submit_bio já validou o intervalo */
+    uint8_t *p = rd.base + bio->lba * RAMDISK_SECTOR;
+    for (uint32_t i = 0; i < bio->seg_count; i++) {
+        size_t len = (size_t)bio->segs[i].sectors * RAMDISK_SECTOR;
+        if (bio->op == BIO_WRITE) memcpy(p, bio->segs[i].buf, len);
+        else memcpy(bio->segs[i].buf, p, len);
+        p += len;
+    }
+    bio_endio(bio, 0);
+    return 0;
+}
+
+/* Path do módulo termina em RAMDISK_MODULE? */
+static int ramdisk_module_match(const char *path) {
+    size_t n = strlen(path), m = strlen(RAMDISK_MODULE);
+    return n >= m && strcmp(path + n - m, RAMDISK_MODULE) == 0;
+}
+
+static struct limine_file *ramdisk_find_module(void) {
+    struct limine_module_response *r = module_request.response;
+    if (!r) return NULL;
+    for (uint64_t i = 0; i < r->module_count; i++) {
+        struct limine_file *f = r->modules[i];
+        if (f->path && ramdisk_module_match(f->path)) return f;
+    }
+    return NULL;
+}
+
+int ramdisk_init(void) {
+    uint64_t bytes;
+    struct limine_file *mod = ramdisk_find_module();
+
+    if (mod) {
+        rd.base = mod->address;
+        bytes = mod->size & ~(uint64_t)(RAMDISK_SECTOR - 1);
+        klog(KLOG_INFO, "[RAMDISK] Module %s, %u KiB", mod->path, (uint32_t)(bytes / 1024));
+    } else if (RAMDISK_MB > 0) {
+        bytes = (uint64_t)RAMDISK_MB * 1024 * 1024;
+        rd.base = pmalloc(bytes / PMM_PAGE_SIZE);
+        if (!rd.base) {
+            klog(KLOG_ERROR, "[RAMDISK] Cannot allocate %u MiB", (uint32_t)RAMDISK_MB);
+            return -1;
+        }
+        memset(rd.base, 0, bytes);
+        klog(KLOG_INFO, "[RAMDISK] Empty disk, %u MiB", (uint32_t)RAMDISK_MB);
+    } else {
+        return -1;
+    }
+    if (!bytes) return -1;
+
+    rd.bdev.name = "ram0";
+    rd.bdev.sector_size = RAMDISK_SECTOR;
+    rd.bdev.sectors = bytes / RAMDISK_SECTOR;
+    rd.bdev.priv = &rd;
+    rd.bdev.submit = ramdisk_submit;
+    rd.present = 1;
+    return blockdev_add_disk(&rd.bdev);
+}
+
+blockdev_t *ramdisk_blockdev(void) {
+    return rd.present ? &rd.bdev : NULL;
+}
@@ -0,0 +1,25 @@
+// ramdisk.h - Disco em RAM ("ram0"): módulo do Limine ou vazio
+//
+// Com um módulo cujo path termina em RAMDISK_MODULE (module_path no
+// limine.conf), o disco é a própria imagem na memória onde o Limine a
+// carregou; sem módulo e com RAMDISK_MB > 0, um disco zerado desse tamanho.
+// Leitura e escrita são memcpy completados na hora, sem fila nem thread:
+// o mesmo FAT32 montado daqui mede fat32.c/vfs.c sem custo de emulação.
+#pragma once
+#include <stdint.h>
+#include "blockdev.h"
+
+#ifndef RAMDISK_MODULE
+#define RAMDISK_MODULE "ramdisk.img"
+#endif
+
+/* make CPPFLAGS=-DRAMDISK_MB=16: disco vazio quando não há módulo */
+#ifndef RAMDISK_MB
+#define RAMDISK_MB 0
+#endif
+
+/* Cria e registra o disco; 0 se existe */
+int ramdisk_init(void);
+
+/* O disco como blockdev; NULL se não foi criado */
+blockdev_t *ramdisk_blockdev(void);
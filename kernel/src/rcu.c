@@ -0,0 +1,73 @@
+// rcu.c - Grace periods baseados em passagem pelo scheduler
+
+#include "rcu.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "workqueue.h"
+
+static spinlock_t rcu_lock = SPINLOCK_INIT;
+static struct rcu_head *rcu_pending = NULL;
+static int rcu_batch_queued = 0;
+
+void synchronize_rcu(void) {
+    /* Antes do scheduler só existe a thread boot: nada para esperar */
+    if (!sched_active()) return;
+
+    uint32_t ncpu = smp_cpu_count();
+    uint32_t self = smp_current_id();
+    uint64_t snap[SMP_MAX_CPUS];
+
+    for (uint32_t i = 0; i < ncpu; i++) {
+        snap[i] = __atomic_load_n(&smp_get_cpu(i)->rcu_qs, __ATOMIC_ACQUIRE);
+    }
+
+    for (uint32_t i = 0; i < ncpu; i++) {
+        if (i == self) continue;
+        cpu_t *c = smp_get_cpu(i);
+
+        /* Passou pelo scheduler ou está na idle (que nunca lê sob RCU) */
+        while (__atomic_load_n(&c->rcu_qs, __ATOMIC_ACQUIRE) == snap[i] &&
+               c->current != c->idle) {
+            thread_sleep(1000 / SCHED_HZ);
+        }
+    }
+}
+
+static void rcu_batch_work(void *arg) {
+    (void)arg;
+
+    for (;;) {
+        uint64_t flags = spinlock_lock_irqsave(&rcu_lock);
+        struct rcu_head *list = rcu_pending;
+        rcu_pending = NULL;
+        if (!list) {
+            rcu_batch_queued = 0;
+            spinlock_unlock_irqrestore(&rcu_lock, flags);
+            return;
+        }
+        spinlock_unlock_irqrestore(&rcu_lock, flags);
+
+        synchronize_rcu();
+
+        while (list) {
+            struct rcu_head *next = list->next;
+            list->func(list);
+            list = next;
+        }
+    }
+}
+
+void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head)) {
+    head->func = func;
+
+    uint64_t flags = spinlock_lock_irqsave(&rcu_lock);
+    head->next = rcu_pending;
+    rcu_pending = head;
+    int need_batch = !rcu_batch_queued;
+    rcu_batch_queued = 1;
+    spinlock_unlock_irqrestore(&rcu_lock, flags);
+
+    if (need_batch) {
+        queue_work(rcu_batch_work, NULL);
+    }
+}
@@ -0,0 +1,42 @@
+// rcu.h - Recuperação por grace period (RCU-lite) para leitores sem lock
+//
+// Leitores: rcu_read_lock()/rcu_read_unlock() só desligam a preempção no
+// CPU local (um inc/dec em gs:, sem atomics nem cache lines compartilhadas).
+// Dentro da seção não pode bloquear nem ceder o CPU.
+//
+// Escritores: publicam com rcu_assign_pointer(), tiram o objeto da
+// estrutura e só liberam depois de synchronize_rcu() (bloqueia) ou via
+// call_rcu() (callback roda num kworker depois do grace period).
+//
+// Grace period: cada CPU incrementa rcu_qs a cada passagem pelo scheduler.
+// Como a troca de contexto nunca acontece dentro de uma seção de leitura,
+// ver o contador de todos os outros CPUs mudar (ou o CPU ocioso) garante
+// que nenhum leitor antigo sobrou.
+#pragma once
+#include <stdint.h>
+#include "sched.h"
+
+struct rcu_head {
+    struct rcu_head *next;
+    void (*func)(struct rcu_head *head);
+};
+
+static inline void rcu_read_lock(void) {
+    preempt_disable();
+}
+
+static inline void rcu_read_unlock(void) {
+    preempt_enable();
+}
+
+/* Leitura de ponteiro publicado (no x86 é um mov comum) */
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+
+/* Publica 'v' depois de todas as escritas de inicialização */
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+/* Espera todos os leitores que começaram antes desta chamada terminarem */
+void synchronize_rcu(void);
+
+/* Agenda func(head) para depois do próximo grace period. Não bloqueia. */
+void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head));
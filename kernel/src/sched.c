@@ -0,0 +1,448 @@
+// sched.c - Scheduler round-robin preemptivo para threads de kernel
+//
+// Modelo:
+// - Uma run queue global (FIFO) protegida por rq_lock, sempre tomada com
+//   interrupções desligadas (o timer também a usa).
+// - Cada CPU tem uma thread idle própria; ela só roda quando a fila está vazia.
+// - O timer do LAPIC (SCHED_HZ) marca need_resched; a troca acontece no
+//   retorno do handler, se preempt_count == 0.
+// - rq_lock fica preso durante a troca de contexto e é liberado pela thread
+//   que entra (em schedule() ou em sched_thread_start() para threads novas).
+//   Assim nenhum outro CPU pega uma thread cuja stack ainda está em uso.
+
+#include "sched.h"
+#include "smp.h"
+#include "lapic.h"
+#include "cpu.h"
+#include "pmm.h"
+#include "kmalloc.h"
+#include "string.h"
+#include "spinlock.h"
+#include "blkqueue.h"
+
+extern void klog(int level, const char *fmt, ...);
+extern void panic(const char *msg);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+/* switch.asm */
+extern void sched_switch(uint64_t *old_rsp, uint64_t new_rsp);
+extern void sched_thread_trampoline(void);
+
+static spinlock_t rq_lock = SPINLOCK_INIT;
+static thread_t *rq_head = NULL;
+static thread_t *rq_tail = NULL;
+static thread_t *sleepers = NULL;
+static thread_t *zombies = NULL;
+
+static volatile int sched_started = 0;
+static volatile uint64_t ticks = 0;
+static uint32_t next_tid = 0;
+
+static thread_t boot_thread;
+
+/* ===================== RUN QUEUE (rq_lock preso) ===================== */
+
+static void rq_push(thread_t *t) {
+    t->next = NULL;
+    if (rq_tail) {
+        rq_tail->next = t;
+    } else {
+        rq_head = t;
+    }
+    rq_tail = t;
+}
+
+static thread_t *rq_pop(void) {
+    thread_t *t = rq_head;
+    if (t) {
+        rq_head = t->next;
+        if (!rq_head) rq_tail = NULL;
+        t->next = NULL;
+    }
+    return t;
+}
+
+/* Acorda um CPU ocioso (se houver) para pegar trabalho novo */
+static void kick_idle_cpu(void) {
+    uint32_t self = smp_current_id();
+    for (uint32_t i = 0; i < smp_cpu_count(); i++) {
+        if (i == self) continue;
+        cpu_t *c = smp_get_cpu(i);
+        if (c->idle && c->current == c->idle) {
+            lapic_send_ipi(c->lapic_id, IPI_WAKEUP_VECTOR);
+            return;
+        }
+    }
+}
+
+static void make_ready(thread_t *t) {
+    t->state = THREAD_READY;
+    rq_push(t);
+    kick_idle_cpu();
+}
+
+/* Escolhe a próxima thread e troca. rq_lock preso, IF=0. */
+static void schedule_locked(void) {
+    thread_t *prev = this_cpu_read(current);
+    thread_t *idle = this_cpu_read(idle);
+
+    /* Estado quiescente para o RCU: nenhuma seção de leitura cruza daqui */
+    this_cpu_inc(rcu_qs);
+
+    if (prev->state == THREAD_RUNNING && prev != idle) {
+        prev->state = THREAD_READY;
+        rq_push(prev);
+    }
+
+    thread_t *next = rq_pop();
+    if (!next) {
+        next = (prev->state == THREAD_RUNNING) ? prev : idle;
+    }
+
+    this_cpu_write(need_resched, 0);
+
+    if (next == prev) {
+        prev->state = THREAD_RUNNING;
+        return;
+    }
+
+    if (prev->state == THREAD_DEAD && prev->stack) {
+        prev->next = zombies;
+        zombies = prev;
+    }
+
+    next->state = THREAD_RUNNING;
+    next->cpu = (int)smp_current_id();
+    this_cpu_write(current, next);
+
+    sched_switch(&prev->rsp, next->rsp);
+}
+
+static void schedule(void) {
+    uint64_t flags = spinlock_lock_irqsave(&rq_lock);
+    schedule_locked();
+    spinlock_unlock_irqrestore(&rq_lock, flags);
+}
+
+/* ===================== ENTRADA DE THREADS NOVAS ===================== */
+
+/* Chamada por sched_thread_trampoline com rq_lock ainda preso */
+void sched_thread_start(thread_t *t) {
+    spinlock_unlock_raw(&rq_lock);
+    asm volatile("sti" ::: "memory");
+
+    t->fn(t->arg);
+    thread_exit();
+}
+
+/* Libera stacks de threads mortas. Só em contexto de thread (pfree usa lock
+ * sem irqsave), nunca de dentro do schedule. */
+static void reap_zombies(void) {
+    uint64_t flags = spinlock_lock_irqsave(&rq_lock);
+    thread_t *list = zombies;
+    zombies = NULL;
+    spinlock_unlock_irqrestore(&rq_lock, flags);
+
+    while (list) {
+        thread_t *next = list->next;
+        pfree(list->stack, SCHED_STACK_PAGES);
+        kfree(list);
+        list = next;
+    }
+}
+
+/* ===================== IDLE ===================== */
+
+static void idle_loop(void) {
+    for (;;) {
+        asm volatile("cli" ::: "memory");
+        if (__atomic_load_n(&rq_head, __ATOMIC_RELAXED) != NULL) {
+            asm volatile("sti" ::: "memory");
+            thread_yield();
+            continue;
+        }
+        /* sti;hlt atômico: IPI/timer depois da checagem acorda o hlt */
+        asm volatile("sti; hlt" ::: "memory");
+    }
+}
+
+static void idle_thread_fn(void *arg) {
+    (void)arg;
+    idle_loop();
+}
+
+/* ===================== API ===================== */
+
+static thread_t *thread_alloc(const char *name, thread_fn fn, void *arg) {
+    thread_t *t = kmalloc(sizeof(thread_t));
+    if (!t) return NULL;
+
+    memset(t, 0, sizeof(thread_t));
+    t->stack = pmalloc(SCHED_STACK_PAGES);
+    if (!t->stack) {
+        kfree(t);
+        return NULL;
+    }
+
+    t->tid = __atomic_fetch_add(&next_tid, 1, __ATOMIC_RELAXED);
+    t->name = name;
+    t->fn = fn;
+    t->arg = arg;
+
+    /* Frame inicial para sched_switch: r15,r14,r13,r12,rbx,rbp,ret.
+     * Depois do ret o rsp fica no topo (alinhado em 16). */
+    uint64_t *sp = (uint64_t *)((uint8_t *)t->stack + SCHED_STACK_PAGES * PMM_PAGE_SIZE);
+    *--sp = (uint64_t)sched_thread_trampoline;  /* ret */
+    *--sp = 0;                                  /* rbp */
+    *--sp = 0;                                  /* rbx */
+    *--sp = (uint64_t)t;                        /* r12 -> trampoline */
+    *--sp = 0;                                  /* r13 */
+    *--sp = 0;                                  /* r14 */
+    *--sp = 0;                                  /* r15 */
+    t->rsp = (uint64_t)sp;
+
+    return t;
+}
+
+thread_t *thread_create(const char *name, thread_fn fn, void *arg) {
+    if (!fn) return NULL;
+
+    reap_zombies();
+
+    thread_t *t = thread_alloc(name, fn, arg);
+    if (!t) {
+        klog(KLOG_ERROR, "SCHED: out of memory creating '%s'", name);
+        return NULL;
+    }
+
+    uint64_t flags = spinlock_lock_irqsave(&rq_lock);
+    make_ready(t);
+    spinlock_unlock_irqrestore(&rq_lock, flags);
+
+    return t;
+}
+
+void thread_yield(void) {
+    if (!sched_started) return;
+    schedule();
+}
+
+/* Bios presos no plug de quem vai dormir só sairiam quando ela voltasse:
+ * solta antes (pode chamar kick() do driver, então fora do rq_lock) */
+static void sched_flush_plugs(void) {
+    thread_t *self = this_cpu_read(current);
+    if (self->nr_plugs) blk_flush_thread_plugs();
+}
+
+void thread_block(void) {
+    sched_flush_plugs();
+    uint64_t flags = spinlock_lock_irqsave(&rq_lock);
+    thread_t *self = this_cpu_read(current);
+
+    if (self->wake_pending) {
+        self->wake_pending = 0;
+    } else {
+        self->state = THREAD_BLOCKED;
+        schedule_locked();
+    }
+
+    spinlock_unlock_irqrestore(&rq_lock, flags);
+}
+
+void thread_block_timeout(uint64_t deadline) {
+    sched_flush_plugs();
+    uint64_t flags = spinlock_lock_irqsave(&rq_lock);
+    thread_t *self = this_cpu_read(current);
+
+    if (self->wake_pending) {
+        self->wake_pending = 0;
+    } else if (ticks < deadline) {
+        self->wake_tick = deadline;
+        self->state = THREAD_SLEEPING;
+        self->next = sleepers;
+        sleepers = self;
+        schedule_locked();
+    }
+
+    spinlock_unlock_irqrestore(&rq_lock, flags);
+}
+
+void thread_wake(thread_t *t) {
+    if (!t) return;
+
+    uint64_t flags = spinlock_lock_irqsave(&rq_lock);
+
+    if (t->state == THREAD_BLOCKED) {
+        make_ready(t);
+    } else if (t->state == THREAD_SLEEPING) {
+        /* Tira da lista de sleepers antes de enfileirar */
+        thread_t **pp = &sleepers;
+        while (*pp && *pp != t) pp = &(*pp)->next;
+        if (*pp) *pp = t->next;
+        make_ready(t);
+    } else if (t->state != THREAD_DEAD) {
+        t->wake_pending = 1;
+    }
+
+    spinlock_unlock_irqrestore(&rq_lock, flags);
+}
+
+void thread_sleep(uint32_t ms) {
+    if (!sched_started) {
+        /* Antes do scheduler: espera ocupada aproximada */
+        for (volatile uint64_t i = 0; i < (uint64_t)ms * 10000; i++) {
+            cpu_relax();
+        }
+        return;
+    }
+
+    uint64_t delta = ((uint64_t)ms * SCHED_HZ + 999) / 1000;
+    if (delta == 0) delta = 1;
+
+    sched_flush_plugs();
+    uint64_t flags = spinlock_lock_irqsave(&rq_lock);
+    thread_t *self = this_cpu_read(current);
+    self->wake_tick = ticks + delta;
+    self->state = THREAD_SLEEPING;
+    self->next = sleepers;
+    sleepers = self;
+    schedule_locked();
+    spinlock_unlock_irqrestore(&rq_lock, flags);
+}
+
+void thread_exit(void) {
+    asm volatile("cli" ::: "memory");
+    spinlock_lock_raw(&rq_lock);
+
+    thread_t *self = this_cpu_read(current);
+    self->state = THREAD_DEAD;
+    schedule_locked();
+
+    /* Nunca volta */
+    panic("SCHED: dead thread rescheduled");
+    __builtin_unreachable();
+}
+
+int sched_active(void) {
+    return sched_started;
+}
+
+/* ===================== PREEMPÇÃO DOS SPINLOCKS ===================== */
+
+volatile int sched_preempt_ready = 0;
+
+void sched_preempt_disable(void) {
+    preempt_disable();
+}
+
+/* Como preempt_enable, mas o unlock pode vir de um handler de IRQ: com
+ * IF=0 não troca de thread (o próximo tick faz isso) */
+void sched_preempt_enable(void) {
+    asm volatile("" ::: "memory");
+    this_cpu_dec(preempt_count);
+    if (this_cpu_read(preempt_count) == 0 && this_cpu_read(need_resched) &&
+        irq_enabled()) {
+        thread_yield();
+    }
+}
+
+uint64_t sched_ticks(void) {
+    return ticks;
+}
+
+/* ===================== TIMER ===================== */
+
+/* Acorda sleepers vencidos. rq_lock preso. */
+static void wake_sleepers(void) {
+    thread_t **pp = &sleepers;
+    while (*pp) {
+        thread_t *t = *pp;
+        if (t->wake_tick <= ticks) {
+            *pp = t->next;
+            make_ready(t);
+        } else {
+            pp = &t->next;
+        }
+    }
+}
+
+/* Chamado pelo lapic_timer_handler (interrupts.asm), IF=0 */
+void sched_timer_irq(void) {
+    lapic_eoi();
+
+    if (!sched_started) return;
+
+    spinlock_lock_raw(&rq_lock);
+
+    /* Só o BSP avança o relógio global */
+    if (smp_current_id() == 0) {
+        ticks++;
+        wake_sleepers();
+    }
+
+    this_cpu_write(need_resched, 1);
+    if (this_cpu_read(preempt_count) == 0) {
+        schedule_locked();
+    }
+
+    spinlock_unlock_raw(&rq_lock);
+}
+
+/* ===================== INICIALIZAÇÃO ===================== */
+
+/* Converte o contexto atual do AP (stack do smp.c) em thread idle dele */
+static void sched_ap_enter(void *arg) {
+    (void)arg;
+
+    thread_t *idle = kmalloc(sizeof(thread_t));
+    if (!idle) {
+        panic("SCHED: out of memory for AP idle thread");
+    }
+    memset(idle, 0, sizeof(thread_t));
+    idle->tid = __atomic_fetch_add(&next_tid, 1, __ATOMIC_RELAXED);
+    idle->name = "idle";
+    idle->state = THREAD_RUNNING;
+    idle->cpu = (int)smp_current_id();
+
+    this_cpu_write(idle, idle);
+    this_cpu_write(current, idle);
+
+    lapic_timer_start(SCHED_HZ);
+    idle_loop();
+}
+
+void sched_init(void) {
+    cpu_t *bsp = smp_get_cpu(0);
+
+    /* kmain vira a thread "boot" (stack do Limine, nunca liberada) */
+    memset(&boot_thread, 0, sizeof(thread_t));
+    boot_thread.tid = next_tid++;
+    boot_thread.name = "boot";
+    boot_thread.state = THREAD_RUNNING;
+    bsp->current = &boot_thread;
+
+    thread_t *idle = thread_alloc("idle", idle_thread_fn, NULL);
+    if (!idle) {
+        panic("SCHED: out of memory for BSP idle thread");
+    }
+    idle->state = THREAD_READY;
+    bsp->idle = idle;
+
+    lapic_timer_calibrate();
+    sched_started = 1;
+    sched_preempt_ready = 1;
+    lapic_timer_start(SCHED_HZ);
+
+    for (uint32_t i = 1; i < smp_cpu_count(); i++) {
+        if (smp_call_on(i, sched_ap_enter, NULL) < 0) {
+            klog(KLOG_WARN, "SCHED: CPU %d did not join the scheduler", (int)i);
+        }
+    }
+
+    klog(KLOG_INFO, "SCHED: running at %d Hz on %d CPU(s)",
+         SCHED_HZ, (int)smp_cpu_count());
+}
@@ -0,0 +1,96 @@
+// sched.h - Threads de kernel e scheduler preemptivo
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "percpu.h"
+
+#define SCHED_HZ           100   /* Frequência do timer por CPU */
+#define SCHED_STACK_PAGES  4     /* 16KB de stack por thread */
+
+typedef void (*thread_fn)(void *arg);
+
+typedef enum {
+    THREAD_READY = 0,
+    THREAD_RUNNING,
+    THREAD_BLOCKED,
+    THREAD_SLEEPING,
+    THREAD_DEAD
+} thread_state_t;
+
+#define THREAD_MAX_PLUGS   4     /* Filas plugadas ao mesmo tempo */
+
+struct request_queue;
+
+/* Plug de uma request_queue segurado pela thread (blkqueue.c) */
+typedef struct thread_plug {
+    struct request_queue *q;
+    uint32_t depth;                 /* blk_plug aninhados nesta fila */
+} thread_plug_t;
+
+typedef struct thread {
+    uint64_t rsp;                   /* DEVE ser o primeiro campo (switch.asm) */
+    uint32_t tid;
+    volatile thread_state_t state;
+    const char *name;
+    void *stack;                    /* NULL = stack não é nossa (boot/AP) */
+    thread_fn fn;
+    void *arg;
+    uint64_t wake_tick;             /* THREAD_SLEEPING */
+    int wake_pending;               /* thread_wake() chegou antes do block */
+    int cpu;                        /* Último CPU onde rodou */
+    thread_plug_t plugs[THREAD_MAX_PLUGS];
+    uint32_t nr_plugs;              /* Entradas em uso de plugs[] */
+    struct thread *next;            /* Run queue / listas de espera */
+} thread_t;
+
+/* Inicializa o scheduler no BSP e coloca os APs para rodar threads.
+ * O contexto que chama (kmain) vira a thread "boot". */
+void sched_init(void);
+
+/* 1 depois de sched_init() */
+int sched_active(void);
+
+/* Ticks do timer desde sched_init (SCHED_HZ por segundo) */
+uint64_t sched_ticks(void);
+
+/* Cria thread pronta para rodar; NULL se sem memória */
+thread_t *thread_create(const char *name, thread_fn fn, void *arg);
+
+/* Thread atual */
+static inline thread_t *thread_current(void) {
+    return this_cpu_read(current);
+}
+
+/* Cede o CPU para a próxima thread pronta */
+void thread_yield(void);
+
+/* Dorme pelo menos 'ms' milissegundos */
+void thread_sleep(uint32_t ms);
+
+/* Bloqueia até alguém chamar thread_wake(). Se o wake chegou antes,
+ * retorna imediatamente (semântica de "token", sem wakeup perdido). */
+void thread_block(void);
+
+/* Como thread_block(), mas volta também quando sched_ticks() chega a
+ * 'deadline'. Quem chama recheca a condição/prazo. */
+void thread_block_timeout(uint64_t deadline);
+
+/* Acorda thread bloqueada/dormindo. Pode ser chamada de IRQ. */
+void thread_wake(thread_t *t);
+
+/* Termina a thread atual */
+void thread_exit(void) __attribute__((noreturn));
+
+/* Desabilita/reabilita preempção no CPU atual (aninhável) */
+static inline void preempt_disable(void) {
+    this_cpu_inc(preempt_count);
+    asm volatile("" ::: "memory");
+}
+
+static inline void preempt_enable(void) {
+    asm volatile("" ::: "memory");
+    this_cpu_dec(preempt_count);
+    if (this_cpu_read(preempt_count) == 0 && this_cpu_read(need_resched)) {
+        thread_yield();
+    }
+}
@@ -1,4 +1,5 @@
 #include "serial.h"
+#include "waitqueue.h"
 
 /* COM1 base */
 #define SERIAL_PORT 0x3F8
@@ -15,6 +16,7 @@ static inline uint8_t inb(uint16_t port) {
 
 /* Line Status Register */
 #define SERIAL_LSR 5
+#define SERIAL_DATA_READY 0x01
 #define SERIAL_THR_EMPTY 0x20
 
 static int serial_is_transmit_empty(void) {
@@ -32,7 +34,9 @@ void serial_init(void) {
 }
 
 void serial_write_char(char c) {
-    while (!serial_is_transmit_empty());
+    while (!serial_is_transmit_empty()) {
+        wait_poll_relax();
+    }
     outb(SERIAL_PORT, c);
 }
 
@@ -43,3 +47,8 @@ void serial_write(const char *s) {
         serial_write_char(*s++);
     }
 }
+
+int serial_read_char(void) {
+    if (!(inb(SERIAL_PORT + SERIAL_LSR) & SERIAL_DATA_READY)) return -1;
+    return inb(SERIAL_PORT);
+}
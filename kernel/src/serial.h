@@ -4,3 +4,6 @@
 void serial_init(void);
 void serial_write_char(char c);
 void serial_write(const char *s);
+
+/* Próximo byte recebido, ou -1 se não há (não bloqueia) */
+int serial_read_char(void);
@@ -0,0 +1,186 @@
+// smp.c - Bring-up dos Application Processors
+//
+// Cada AP recebido do Limine:
+// - carrega a mesma GDT/IDT do BSP
+// - habilita o seu LAPIC
+// - troca a stack do Limine por uma stack própria (pmalloc)
+// - fica parado em "sti; hlt" esperando trabalho na caixa de correio,
+//   que o BSP entrega com smp_call_on() + IPI de wakeup.
+
+#include "smp.h"
+#include "percpu.h"
+#include "lapic.h"
+#include "cpu.h"
+#include "pmm.h"
+#include "string.h"
+#include <limine.h>
+
+extern volatile struct LIMINE_MP(request) mp_request; // de limine_requests.c
+extern void klog(int level, const char *fmt, ...);
+extern void gdt_load(void);
+extern void idt_load(void);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+/* Espera máxima (em iterações de pause) pelos APs ficarem online */
+#define SMP_ONLINE_TIMEOUT 100000000ULL
+
+static cpu_t cpus[SMP_MAX_CPUS];
+static uint32_t cpu_count = 1;
+
+void ap_main(cpu_t *cpu) __attribute__((noreturn));
+
+/* Loop ocioso: pega trabalho da caixa de correio ou dorme até a próxima IPI.
+ * O "sti; hlt" é atômico (shadow do sti), então uma IPI que chegue depois
+ * da checagem sempre acorda o hlt. */
+static void __attribute__((noreturn)) smp_idle_loop(cpu_t *cpu) {
+    for (;;) {
+        asm volatile("cli" ::: "memory");
+
+        smp_work_fn fn = __atomic_load_n(&cpu->work_fn, __ATOMIC_ACQUIRE);
+        if (fn) {
+            void *arg = cpu->work_arg;
+            cpu->work_arg = NULL;
+            __atomic_store_n(&cpu->work_fn, NULL, __ATOMIC_RELEASE);
+
+            asm volatile("sti" ::: "memory");
+            fn(arg);
+            continue;
+        }
+
+        asm volatile("sti; hlt" ::: "memory");
+    }
+}
+
+void ap_main(cpu_t *cpu) {
+    gdt_load();
+    percpu_install(cpu);
+    idt_load();
+    lapic_init();
+
+    __atomic_store_n(&cpu->online, 1, __ATOMIC_RELEASE);
+
+    smp_idle_loop(cpu);
+}
+
+/* Ponto de entrada do Limine: ainda na stack do bootloader */
+static void ap_entry(struct LIMINE_MP(info) *info) {
+    cpu_t *cpu = (cpu_t *)info->extra_argument;
+
+    asm volatile(
+        "mov %0, %%rsp\n"
+        "xor %%rbp, %%rbp\n"
+        "call ap_main\n"
+        : : "r"(cpu->stack_top), "D"(cpu) : "memory");
+
+    __builtin_unreachable();
+}
+
+static int cpu_setup(cpu_t *cpu, uint32_t id, uint32_t lapic) {
+    memset(cpu, 0, sizeof(cpu_t));
+    cpu->id = id;
+    cpu->lapic_id = lapic;
+
+    uint8_t *stack = pmalloc(SMP_STACK_PAGES);
+    if (!stack) {
+        return -1;
+    }
+    cpu->stack_top = (uint64_t)stack + SMP_STACK_PAGES * PMM_PAGE_SIZE;
+    return 0;
+}
+
+/* Espera o AP anunciar que está online; -1 se passar do timeout */
+static int smp_wait_online(cpu_t *cpu) {
+    uint64_t spins = 0;
+    while (!__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) {
+        if (++spins > SMP_ONLINE_TIMEOUT) return -1;
+        cpu_relax();
+    }
+    return 0;
+}
+
+void smp_init(void) {
+    /* BSP ocupa sempre o índice 0 */
+    lapic_init();
+    memset(&cpus[0], 0, sizeof(cpu_t));
+    cpus[0].lapic_id = lapic_id();
+    cpus[0].online = 1;
+    cpu_count = 1;
+    percpu_install(&cpus[0]);
+
+    struct LIMINE_MP(response) *resp = mp_request.response;
+    if (resp == NULL) {
+        klog(KLOG_WARN, "SMP: no MP response from Limine, running on BSP only");
+        return;
+    }
+
+    cpus[0].lapic_id = resp->bsp_lapic_id;
+
+    uint32_t started = 0;
+    for (uint64_t i = 0; i < resp->cpu_count; i++) {
+        struct LIMINE_MP(info) *info = resp->cpus[i];
+        if (info->lapic_id == resp->bsp_lapic_id) {
+            continue;
+        }
+        if (cpu_count >= SMP_MAX_CPUS) {
+            klog(KLOG_WARN, "SMP: limit of %d CPUs reached", SMP_MAX_CPUS);
+            break;
+        }
+
+        cpu_t *cpu = &cpus[cpu_count];
+        if (cpu_setup(cpu, cpu_count, info->lapic_id) < 0) {
+            klog(KLOG_ERROR, "SMP: out of memory for CPU %d stack", (int)cpu_count);
+            break;
+        }
+
+        info->extra_argument = (uint64_t)cpu;
+        /* Escrever goto_address dispara o AP */
+        __atomic_store_n(&info->goto_address, ap_entry, __ATOMIC_SEQ_CST);
+        started++;
+
+        /* Só entra na conta depois de visto online, e um de cada vez: os
+         * índices (ids) ficam contíguos em [0, cpu_count) */
+        if (smp_wait_online(cpu) < 0) {
+            klog(KLOG_WARN, "SMP: CPU %d (LAPIC %d) did not come online",
+                 (int)cpu_count, (int)cpu->lapic_id);
+            /* Ele ainda pode acordar usando este cpu_t e esta stack:
+             * o slot não é reaproveitado e os APs seguintes ficam de fora */
+            break;
+        }
+        cpu_count++;
+    }
+
+    klog(KLOG_INFO, "SMP: %d of %d AP(s) online, %d CPU(s) total",
+         (int)(cpu_count - 1), (int)started, (int)cpu_count);
+}
+
+uint32_t smp_cpu_count(void) {
+    return cpu_count;
+}
+
+cpu_t *smp_get_cpu(uint32_t idx) {
+    if (idx >= cpu_count) return NULL;
+    return &cpus[idx];
+}
+
+int smp_call_on(uint32_t idx, smp_work_fn fn, void *arg) {
+    if (!fn || idx == 0 || idx >= cpu_count) return -1;
+
+    cpu_t *cpu = &cpus[idx];
+    if (!cpu->online) return -1;
+
+    spinlock_lock(&cpu->mailbox_lock);
+    if (__atomic_load_n(&cpu->work_fn, __ATOMIC_ACQUIRE) != NULL) {
+        spinlock_unlock(&cpu->mailbox_lock);
+        return -1;
+    }
+    cpu->work_arg = arg;
+    __atomic_store_n(&cpu->work_fn, fn, __ATOMIC_RELEASE);
+    spinlock_unlock(&cpu->mailbox_lock);
+
+    lapic_send_ipi(cpu->lapic_id, IPI_WAKEUP_VECTOR);
+    return 0;
+}
@@ -0,0 +1,47 @@
+// smp.h - Bring-up dos Application Processors via Limine MP request
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "spinlock.h"
+
+#define SMP_MAX_CPUS     32
+#define SMP_STACK_PAGES  4     /* 16KB de stack por CPU */
+
+typedef void (*smp_work_fn)(void *arg);
+
+struct thread;
+
+/* Área por CPU - apontada por IA32_GS_BASE (ver percpu.h).
+ * 'self' precisa ser o primeiro campo: gs:0 devolve o ponteiro da área. */
+typedef struct cpu {
+    struct cpu *self;
+    uint32_t id;                    /* Índice lógico (0 = BSP) */
+    uint32_t lapic_id;
+    uint64_t stack_top;
+    volatile int online;
+
+    /* Caixa de correio: um trabalho pendente por vez */
+    spinlock_t mailbox_lock;
+    smp_work_fn volatile work_fn;
+    void *work_arg;
+
+    /* Scheduler (sched.c) */
+    struct thread *current;
+    struct thread *idle;
+    int need_resched;
+    int preempt_count;
+    uint64_t rcu_qs;                /* Passagens pelo scheduler (rcu.c) */
+} cpu_t;
+
+/* Inicia os APs (chamar depois de gdt_init/idt_init e do heap) */
+void smp_init(void);
+
+/* Número de CPUs online (inclui o BSP) */
+uint32_t smp_cpu_count(void);
+
+/* Área do CPU de índice 'idx' (NULL se não existir) */
+cpu_t *smp_get_cpu(uint32_t idx);
+
+/* Entrega 'fn(arg)' ao CPU ocioso 'idx' e o acorda por IPI.
+ * Retorna 0 em sucesso, -1 se o CPU não existe ou já tem trabalho pendente. */
+int smp_call_on(uint32_t idx, smp_work_fn fn, void *arg);
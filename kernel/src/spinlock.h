@@ -5,12 +5,24 @@
 
 typedef struct {
     uint8_t lock;
+    uint8_t preempt;  // Dono desligou a preempção (spinlock_lock)
     uint32_t cpu_id;  // Para debugging
 } spinlock_t;
 
-#define SPINLOCK_INIT {0, 0}
+#define SPINLOCK_INIT {0, 0, 0}
 
-static inline void spinlock_lock(spinlock_t *lock) {
+/* Preempção (sched.c): spinlock_lock/unlock a desligam enquanto o lock
+ * está preso, senão o tick trocaria a thread dona e quem quer o lock no
+ * mesmo CPU giraria um timeslice inteiro. Só vale depois do scheduler
+ * (área por CPU pronta em todos); cada lock guarda se desligou, para o
+ * unlock casar mesmo se a chave virou no meio. */
+extern volatile int sched_preempt_ready;
+void sched_preempt_disable(void);
+void sched_preempt_enable(void);
+
+/* Só o lock, sem mexer na preempção: variantes irqsave e o próprio
+ * scheduler (rq_lock atravessa a troca de contexto) */
+static inline void spinlock_lock_raw(spinlock_t *lock) {
     asm volatile (
         "1:\n"
         "lock bts $0, %0\n"   // Test and set bit 0
@@ -21,7 +33,7 @@ static inline void spinlock_lock(spinlock_t *lock) {
     );
 }
 
-static inline void spinlock_unlock(spinlock_t *lock) {
+static inline void spinlock_unlock_raw(spinlock_t *lock) {
     asm volatile (
         "movb $0, %0\n"
         : "+m"(lock->lock)
@@ -30,7 +42,7 @@ static inline void spinlock_unlock(spinlock_t *lock) {
     );
 }
 
-static inline bool spinlock_trylock(spinlock_t *lock) {
+static inline bool spinlock_trylock_raw(spinlock_t *lock) {
     bool result;
     asm volatile (
         "lock bts $0, %1\n"
@@ -41,3 +53,44 @@ static inline bool spinlock_trylock(spinlock_t *lock) {
     );
     return result;
 }
+
+static inline void spinlock_lock(spinlock_t *lock) {
+    int p = sched_preempt_ready;
+    if (p) sched_preempt_disable();
+    spinlock_lock_raw(lock);
+    lock->preempt = (uint8_t)p;
+}
+
+static inline void spinlock_unlock(spinlock_t *lock) {
+    int p = lock->preempt;
+    spinlock_unlock_raw(lock);
+    if (p) sched_preempt_enable();
+}
+
+static inline bool spinlock_trylock(spinlock_t *lock) {
+    int p = sched_preempt_ready;
+    if (p) sched_preempt_disable();
+    if (!spinlock_trylock_raw(lock)) {
+        if (p) sched_preempt_enable();
+        return false;
+    }
+    lock->preempt = (uint8_t)p;
+    return true;
+}
+
+/* Variantes que desabilitam interrupções - obrigatórias para locks que
+ * também são tomados em handlers de IRQ (ex.: run queue do scheduler) */
+static inline uint64_t spinlock_lock_irqsave(spinlock_t *lock) {
+    uint64_t flags;
+    asm volatile("pushfq; popq %0; cli" : "=r"(flags) : : "memory");
+    spinlock_lock_raw(lock);
+    lock->preempt = 0;
+    return flags;
+}
+
+static inline void spinlock_unlock_irqrestore(spinlock_t *lock, uint64_t flags) {
+    spinlock_unlock_raw(lock);
+    if (flags & 0x200) {
+        asm volatile("sti" ::: "memory");
+    }
+}
@@ -0,0 +1,39 @@
+; switch.asm - Troca de contexto entre threads de kernel
+BITS 64
+
+global sched_switch
+global sched_thread_trampoline
+extern sched_thread_start
+
+section .text
+
+; void sched_switch(uint64_t *old_rsp, uint64_t new_rsp)
+; Salva os registradores callee-saved na stack atual, guarda o rsp em
+; *old_rsp e restaura o contexto da stack nova.
+sched_switch:
+    push rbp
+    push rbx
+    push r12
+    push r13
+    push r14
+    push r15
+
+    mov [rdi], rsp
+    mov rsp, rsi
+
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbx
+    pop rbp
+    ret
+
+; Primeira execução de uma thread: r12 = thread_t* (montado em thread_alloc)
+sched_thread_trampoline:
+    mov rdi, r12
+    xor rbp, rbp
+    call sched_thread_start
+    ; sched_thread_start nunca retorna
+    cli
+    hlt
@@ -5,11 +5,26 @@
  * 2. VFS cria bind automático / -> /mnt
  * 3. Acesso a /root/file.txt é traduzido para /mnt/root/file.txt
  * 4. Usuário não vê /mnt, apenas /
+ *
+ * Concorrência: a lista de mounts e root_bind são lidos sob RCU (lookup de
+ * path sem locks nem atomics); mount/umount serializam em mount_lock. As
+ * operações do FS dormem, então não rodam dentro da seção RCU: o lookup
+ * soma 1 no contador do CPU local (m->refs[cpu]), que vale até o fim da
+ * operação ou até o close de um arquivo/diretório aberto; a devolução
+ * subtrai no CPU onde estiver. vfs_umount marca o mount, espera um grace
+ * period (daí em diante nenhum lookup o pega) e soma os contadores: se
+ * sobrou referência recusa com VFS_ERR_BUSY, senão tira da lista e libera
+ * por call_rcu().
  */
 
 #include "vfs.h"
 #include "string.h"
 #include "kmalloc.h"
+#include "rcu.h"
+#include "waitqueue.h"
+#include "sched.h"
+#include "smp.h"
+#include "pmm.h"
 
 extern void klog(int level, const char *fmt, ...);
 
@@ -33,6 +48,7 @@ struct vfs_file {
 static struct vfs_mount *mounts = NULL;
 static struct vfs_mount *root_bind = NULL;  /* Bind de / para /mnt */
 static int vfs_initialized = 0;
+static mutex_t mount_lock = MUTEX_INIT;     /* Escritores de mounts/root_bind */
 
 /* ===================== PATH TRANSLATION ===================== */
 
@@ -96,31 +112,38 @@ static int translate_path(const char *user_path, char *real_path, size_t size) {
         return -1;
     }
     
+    rcu_read_lock();
+    struct vfs_mount *bind = rcu_dereference(root_bind);
+    
     /* Se não há bind, copia direto */
-    if (!root_bind) {
+    if (!bind) {
+        rcu_read_unlock();
         strncpy(real_path, user_path, size - 1);
         real_path[size - 1] = '\0';
         return normalize_path(real_path);
     }
     
     /* Constrói /mnt + path_do_usuario */
-    size_t mnt_len = strlen(root_bind->path);
+    size_t mnt_len = strlen(bind->path);
     size_t user_len = strlen(user_path);
     
     /* Caso especial: / -> /mnt */
     if (user_len == 1 && user_path[0] == '/') {
-        strncpy(real_path, root_bind->path, size - 1);
+        strncpy(real_path, bind->path, size - 1);
         real_path[size - 1] = '\0';
+        rcu_read_unlock();
         return 0;
     }
     
     /* Caso geral: /algo -> /mnt/algo */
     if (mnt_len + user_len >= size) {
+        rcu_read_unlock();
         klog(KLOG_ERROR, "[VFS] Path too long after translation");
         return -1;
     }
     
-    strcpy(real_path, root_bind->path);
+    strcpy(real_path, bind->path);
+    rcu_read_unlock();
     strcat(real_path, user_path);
     
     return normalize_path(real_path);
@@ -128,7 +151,41 @@ static int translate_path(const char *user_path, char *real_path, size_t size) {
 
 /* ===================== MOUNT POINT LOOKUP ===================== */
 
-/* Encontra mount point para um path REAL (já traduzido) */
+/* Solta a referência de find_mount_for_real_path, no CPU atual (que pode
+ * não ser o do lookup: só a soma de todos importa) */
+static void mount_put(struct vfs_mount *m) {
+    preempt_disable();
+    m->refs[smp_current_id()].count--;
+    preempt_enable();
+}
+
+_Static_assert(SMP_MAX_CPUS * sizeof(struct vfs_mount_ref) <= PMM_PAGE_SIZE,
+               "per-CPU mount refs fit in one page");
+
+/* Soma dos contadores por CPU. Depois do grace period do umount só há
+ * devoluções, então um valor lido nunca é menor que o atual: soma 0
+ * significa que não sobrou ninguém. */
+static int64_t mount_refs(struct vfs_mount *m) {
+    int64_t sum = 0;
+    for (uint32_t i = 0; i < SMP_MAX_CPUS; i++) {
+        sum += *(volatile int64_t *)&m->refs[i].count;
+    }
+    return sum;
+}
+
+static void mount_free(struct rcu_head *head) {
+    struct vfs_mount *m = (struct vfs_mount *)((char *)head - offsetof(struct vfs_mount, rcu));
+    pfree(m->refs, 1);
+    kfree(m->path);
+    kfree(m);
+}
+
+/* Encontra mount point para um path REAL (já traduzido)
+ *
+ * Caminho quente de todo open/stat/mkdir: percorre a lista sob RCU, sem
+ * locks nem atomics. O mount volta com uma referência (mount_put quando
+ * acabar); um mount sendo desmontado é ignorado.
+ */
 static struct vfs_mount* find_mount_for_real_path(const char *real_path, 
                                                    const char **rel_path) {
     if (!real_path || !*real_path) return NULL;
@@ -137,7 +194,10 @@ static struct vfs_mount* find_mount_for_real_path(const char *real_path,
     struct vfs_mount *best = NULL;
     size_t best_len = 0;
     
-    for (struct vfs_mount *m = mounts; m; m = m->next) {
+    rcu_read_lock();
+    for (struct vfs_mount *m = rcu_dereference(mounts); m;
+         m = rcu_dereference(m->next)) {
+        if (m->unmounting) continue;
         size_t mlen = strlen(m->path);
         
         /* Checa se path começa com mount point */
@@ -151,6 +211,10 @@ static struct vfs_mount* find_mount_for_real_path(const char *real_path,
             }
         }
     }
+    /* Ainda na seção (preempção desligada): o umount só soma os contadores
+     * depois que ela termina */
+    if (best) best->refs[smp_current_id()].count++;
+    rcu_read_unlock();
     
     if (best && rel_path) {
         /* Retorna path relativo ao mount point */
@@ -200,9 +264,12 @@ int vfs_mount(const char *path, struct vfs_fs_ops *ops, void *private_data) {
         return VFS_ERR_GENERIC;
     }
     
+    mutex_lock(&mount_lock);
+    
     /* Verifica se já existe */
     for (struct vfs_mount *m = mounts; m; m = m->next) {
         if (strcmp(m->path, norm_path) == 0) {
+            mutex_unlock(&mount_lock);
             klog(KLOG_ERROR, "[VFS] mount: Path '%s' already mounted", norm_path);
             return VFS_ERR_EXISTS;
         }
@@ -211,6 +278,7 @@ int vfs_mount(const char *path, struct vfs_fs_ops *ops, void *private_data) {
     /* Aloca mount point */
     struct vfs_mount *m = kmalloc(sizeof(struct vfs_mount));
     if (!m) {
+        mutex_unlock(&mount_lock);
         klog(KLOG_ERROR, "[VFS] mount: Out of memory");
         return VFS_ERR_NOMEM;
     }
@@ -218,24 +286,39 @@ int vfs_mount(const char *path, struct vfs_fs_ops *ops, void *private_data) {
     m->path = kmalloc(strlen(norm_path) + 1);
     if (!m->path) {
         kfree(m);
+        mutex_unlock(&mount_lock);
         return VFS_ERR_NOMEM;
     }
     
+    /* Uma página: SMP_MAX_CPUS contadores de 64 bytes, alinhados */
+    m->refs = pmalloc(1);
+    if (!m->refs) {
+        kfree(m->path);
+        kfree(m);
+        mutex_unlock(&mount_lock);
+        return VFS_ERR_NOMEM;
+    }
+    memset(m->refs, 0, PMM_PAGE_SIZE);
+    
     strcpy(m->path, norm_path);
     m->ops = ops;
     m->private_data = private_data;
+    m->unmounting = 0;
     m->next = mounts;
-    mounts = m;
+    
+    /* Publica só depois do mount estar completo */
+    rcu_assign_pointer(mounts, m);
     
     klog(KLOG_INFO, "[VFS] Mounted at '%s'", m->path);
     
     /* Se montou em /mnt, cria bind automático / -> /mnt */
     if (strcmp(norm_path, "/mnt") == 0) {
-        root_bind = m;
+        rcu_assign_pointer(root_bind, m);
         klog(KLOG_INFO, "[VFS] Auto-bind: / -> /mnt");
         klog(KLOG_INFO, "[VFS] User paths like /root/file.txt map to /mnt/root/file.txt");
     }
     
+    mutex_unlock(&mount_lock);
     return VFS_OK;
 }
 
@@ -247,27 +330,49 @@ int vfs_umount(const char *path) {
     norm_path[255] = '\0';
     normalize_path(norm_path);
     
+    mutex_lock(&mount_lock);
+    
     struct vfs_mount **prev = &mounts;
     
     for (struct vfs_mount *m = mounts; m; m = m->next) {
         if (strcmp(m->path, norm_path) == 0) {
-            *prev = m->next;
+            /* Lookups novos ignoram m; os que já o pegaram somaram a
+             * referência antes de sair da seção RCU */
+            m->unmounting = 1;
+            synchronize_rcu();
+
+            /* Arquivo aberto ou operação em curso: não desmonta */
+            int64_t refs = mount_refs(m);
+            if (refs) {
+                m->unmounting = 0;
+                mutex_unlock(&mount_lock);
+                klog(KLOG_ERROR, "[VFS] umount: '%s' busy (%u references)", norm_path, (uint32_t)refs);
+                return VFS_ERR_BUSY;
+            }
+
+            /* m->next continua válido para leitores que estão em m */
+            rcu_assign_pointer(*prev, m->next);
             
             /* Remove bind se era o /mnt */
             if (m == root_bind) {
-                root_bind = NULL;
+                rcu_assign_pointer(root_bind, NULL);
                 klog(KLOG_INFO, "[VFS] Removed auto-bind / -> /mnt");
             }
             
+            mutex_unlock(&mount_lock);
             klog(KLOG_INFO, "[VFS] Unmounted '%s'", m->path);
             
-            kfree(m->path);
-            kfree(m);
+            /* Nada sujo do FS pode ficar para trás */
+            if (m->ops->sync_fs) m->ops->sync_fs(m);
+            /* Leitores ainda podem estar percorrendo m->next */
+            call_rcu(&m->rcu, mount_free);
             return VFS_OK;
         }
         prev = &m->next;
     }
     
+    mutex_unlock(&mount_lock);
+    
     klog(KLOG_ERROR, "[VFS] umount: Path '%s' not mounted", norm_path);
     return VFS_ERR_NOTFOUND;
 }
@@ -303,12 +408,16 @@ int vfs_open(const char *path, int flags, vfs_file_t **file) {
     }
     
     if (!m->ops->open) {
+        mount_put(m);
         return VFS_ERR_NOTSUPP;
     }
     
-    /* Aloca handle */
+    /* Aloca handle; a referência em m fica com ele até o close */
     vfs_file_t *f = kmalloc(sizeof(vfs_file_t));
-    if (!f) return VFS_ERR_NOMEM;
+    if (!f) {
+        mount_put(m);
+        return VFS_ERR_NOMEM;
+    }
     
     memset(f, 0, sizeof(vfs_file_t));
     f->mount = m;
@@ -323,6 +432,7 @@ int vfs_open(const char *path, int flags, vfs_file_t **file) {
     
     if (ret < 0) {
         kfree(f);
+        mount_put(m);
         klog(KLOG_ERROR, "[VFS] open: Driver error %d for '%s'", ret, path);
         return ret;
     }
@@ -341,6 +451,7 @@ int vfs_close(vfs_file_t *file) {
         ret = file->mount->ops->close(file->fs_handle);
     }
     
+    mount_put(file->mount);
     kfree(file);
     return ret;
 }
@@ -458,9 +569,11 @@ int vfs_mkdir(const char *path) {
     const char *rel_path;
     struct vfs_mount *m = find_mount_for_real_path(real_path, &rel_path);
     
-    if (!m || !m->ops->mkdir) return VFS_ERR_NOTSUPP;
+    if (!m) return VFS_ERR_NOTSUPP;
     
-    return m->ops->mkdir(m, rel_path);
+    int ret = m->ops->mkdir ? m->ops->mkdir(m, rel_path) : VFS_ERR_NOTSUPP;
+    mount_put(m);
+    return ret;
 }
 
 int vfs_rmdir(const char *path) {
@@ -474,9 +587,11 @@ int vfs_rmdir(const char *path) {
     const char *rel_path;
     struct vfs_mount *m = find_mount_for_real_path(real_path, &rel_path);
     
-    if (!m || !m->ops->rmdir) return VFS_ERR_NOTSUPP;
+    if (!m) return VFS_ERR_NOTSUPP;
     
-    return m->ops->rmdir(m, rel_path);
+    int ret = m->ops->rmdir ? m->ops->rmdir(m, rel_path) : VFS_ERR_NOTSUPP;
+    mount_put(m);
+    return ret;
 }
 
 int vfs_unlink(const char *path) {
@@ -490,9 +605,11 @@ int vfs_unlink(const char *path) {
     const char *rel_path;
     struct vfs_mount *m = find_mount_for_real_path(real_path, &rel_path);
     
-    if (!m || !m->ops->unlink) return VFS_ERR_NOTSUPP;
+    if (!m) return VFS_ERR_NOTSUPP;
     
-    return m->ops->unlink(m, rel_path);
+    int ret = m->ops->unlink ? m->ops->unlink(m, rel_path) : VFS_ERR_NOTSUPP;
+    mount_put(m);
+    return ret;
 }
 
 int vfs_rename(const char *oldpath, const char *newpath) {
@@ -509,11 +626,14 @@ int vfs_rename(const char *oldpath, const char *newpath) {
     struct vfs_mount *old_m = find_mount_for_real_path(old_real, &old_rel);
     struct vfs_mount *new_m = find_mount_for_real_path(new_real, &new_rel);
     
-    if (old_m != new_m || !old_m || !old_m->ops->rename) {
-        return VFS_ERR_NOTSUPP;
+    int ret = VFS_ERR_NOTSUPP;
+    if (old_m && old_m == new_m && old_m->ops->rename) {
+        ret = old_m->ops->rename(old_m, old_rel, new_rel);
     }
     
-    return old_m->ops->rename(old_m, old_rel, new_rel);
+    if (old_m) mount_put(old_m);
+    if (new_m) mount_put(new_m);
+    return ret;
 }
 
 int vfs_stat(const char *path, struct vfs_stat *st) {
@@ -527,9 +647,11 @@ int vfs_stat(const char *path, struct vfs_stat *st) {
     const char *rel_path;
     struct vfs_mount *m = find_mount_for_real_path(real_path, &rel_path);
     
-    if (!m || !m->ops->stat) return VFS_ERR_NOTSUPP;
+    if (!m) return VFS_ERR_NOTSUPP;
     
-    return m->ops->stat(m, rel_path, st);
+    int ret = m->ops->stat ? m->ops->stat(m, rel_path, st) : VFS_ERR_NOTSUPP;
+    mount_put(m);
+    return ret;
 }
 
 /* ===================== ITERAÇÃO ===================== */
@@ -546,10 +668,18 @@ int vfs_opendir(const char *path, vfs_file_t **dir) {
     const char *rel_path;
     struct vfs_mount *m = find_mount_for_real_path(real_path, &rel_path);
     
-    if (!m || !m->ops->opendir) return VFS_ERR_NOTSUPP;
+    if (!m) return VFS_ERR_NOTSUPP;
+    if (!m->ops->opendir) {
+        mount_put(m);
+        return VFS_ERR_NOTSUPP;
+    }
     
+    /* Como no open: a referência fica com o diretório até o closedir */
     vfs_file_t *d = kmalloc(sizeof(vfs_file_t));
-    if (!d) return VFS_ERR_NOMEM;
+    if (!d) {
+        mount_put(m);
+        return VFS_ERR_NOMEM;
+    }
     
     memset(d, 0, sizeof(vfs_file_t));
     d->mount = m;
@@ -560,6 +690,7 @@ int vfs_opendir(const char *path, vfs_file_t **dir) {
     
     if (ret < 0) {
         kfree(d);
+        mount_put(m);
         return ret;
     }
     
@@ -590,6 +721,7 @@ int vfs_closedir(vfs_file_t *dir) {
         ret = dir->mount->ops->closedir(dir->fs_handle);
     }
     
+    mount_put(dir->mount);
     kfree(dir);
     return ret;
 }
@@ -622,6 +754,8 @@ uint32_t vfs_get_size(const char *path) {
 int vfs_sync_all(void) {
     int errors = 0;
     
+    /* sync_fs bloqueia: segura mount_lock em vez de uma seção RCU */
+    mutex_lock(&mount_lock);
     for (struct vfs_mount *m = mounts; m; m = m->next) {
         if (m->ops->sync_fs) {
             if (m->ops->sync_fs(m) < 0) {
@@ -629,6 +763,7 @@ int vfs_sync_all(void) {
             }
         }
     }
+    mutex_unlock(&mount_lock);
     
     return errors ? VFS_ERR_GENERIC : VFS_OK;
 }
@@ -636,8 +771,11 @@ int vfs_sync_all(void) {
 void vfs_dump_mounts(void) {
     klog(KLOG_INFO, "=== VFS Mount Points ===");
     
+    mutex_lock(&mount_lock);
+    
     if (!mounts) {
         klog(KLOG_INFO, "(No mounts)");
+        mutex_unlock(&mount_lock);
         return;
     }
     
@@ -646,4 +784,6 @@ void vfs_dump_mounts(void) {
              m->path,
              (m == root_bind) ? " [BIND: / -> /mnt]" : "");
     }
+    
+    mutex_unlock(&mount_lock);
 }
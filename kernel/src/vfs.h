@@ -11,6 +11,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "rcu.h"
 
 /* ===================== CONSTANTES ===================== */
 
@@ -46,6 +47,7 @@
 #define VFS_ERR_PERM    -7
 #define VFS_ERR_NOSPACE -8
 #define VFS_ERR_NOTSUPP -9
+#define VFS_ERR_BUSY    -10
 
 /* ===================== ESTRUTURAS PÚBLICAS ===================== */
 
@@ -98,11 +100,20 @@ struct vfs_fs_ops {
     int (*statfs)(struct vfs_mount *mnt, uint64_t *total, uint64_t *free);
 };
 
+/* Contador de referências de um CPU, numa cache line só dele */
+struct vfs_mount_ref {
+    int64_t count;
+    uint8_t pad[56];
+};
+
 struct vfs_mount {
     char *path;
     struct vfs_fs_ops *ops;
     void *private_data;
     struct vfs_mount *next;
+    struct vfs_mount_ref *refs;   /* Por CPU (uma página): operações + abertos */
+    volatile int unmounting;      /* umount em andamento: lookup ignora */
+    struct rcu_head rcu;          /* Liberação depois do grace period */
 };
 
 /* ===================== API PÚBLICA ===================== */
@@ -0,0 +1,560 @@
+/*
+virtio_blk.c - Driver virtio-blk (PCI legado/transicional, BAR0 de I/O)
+
+O device é assumido pelo driver PCI "virtio-blk" (1AF4:1001) e configurado
+pela interface legada: reset, ACKNOWLEDGE/DRIVER, negociação de features,
+uma virtqueue (split ring: tabela de descritores, avail ring e used ring
+numa área contígua, used alinhado em 4 KiB) e DRIVER_OK.
+
+Cada pedido da request_queue ocupa um slot com cabeçalho, status e uma
+tabela indireta própria (cabeçalho, segmentos de dados, status): no ring
+vai um descritor só, então a profundidade não depende do número de
+segmentos. Sem VIRTIO_F_INDIRECT_DESC a mesma cadeia é copiada para o
+ring.
+
+Notificações em lote: a thread do disco põe no avail ring todos os
+pedidos que cabem e só então publica avail->idx e escreve QUEUE_NOTIFY,
+uma vez, e só se o device pediu (avail_event com EVENT_IDX, ou
+VRING_USED_F_NO_NOTIFY). No sentido contrário o driver não quer
+interrupção (VRING_AVAIL_F_NO_INTERRUPT / used_event lá na frente): o
+used ring é lido por polling, como no AHCI.
+
+Dados vão direto dos segmentos (memória identidade); fora disso, pelo
+bounce do disco, um pedido por vez.
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include "virtio_blk.h"
+#include "blockdev.h"
+#include "blkqueue.h"
+#include "waitqueue.h"
+#include "sched.h"
+#include "cpu.h"
+#include "pci.h"
+#include "pmm.h"
+#include "kmalloc.h"
+#include "string.h"
+
+extern void klog(int level, const char *fmt, ...);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+static inline void outb(uint16_t port, uint8_t val) { asm volatile("outb %0, %1" : : "a"(val), "Nd"(port)); }
+static inline uint16_t inw(uint16_t port) { uint16_t ret; asm volatile("inw %1, %0" : "=a"(ret) : "Nd"(port)); return ret; }
+static inline void outw(uint16_t port, uint16_t val) { asm volatile("outw %0, %1" : : "a"(val), "Nd"(port)); }
+static inline uint32_t inl(uint16_t port) { uint32_t ret; asm volatile("inl %1, %0" : "=a"(ret) : "Nd"(port)); return ret; }
+static inline void outl(uint16_t port, uint32_t val) { asm volatile("outl %0, %1" : : "a"(val), "Nd"(port)); }
+
+/* ===================== REGISTRADORES ===================== */
+
+#define VIRTIO_VENDOR           0x1AF4
+#define VIRTIO_DEV_BLK_LEGACY   0x1001
+
+/* Interface legada (BAR0, I/O) */
+#define VIO_DEVICE_FEATURES     0x00
+#define VIO_GUEST_FEATURES      0x04
+#define VIO_QUEUE_PFN           0x08
+#define VIO_QUEUE_SIZE          0x0C
+#define VIO_QUEUE_SELECT        0x0E
+#define VIO_QUEUE_NOTIFY        0x10
+#define VIO_STATUS              0x12
+#define VIO_ISR                 0x13
+#define VIO_CONFIG              0x14        /* Sem MSI-X */
+
+#define VIO_STATUS_ACK          0x01
+#define VIO_STATUS_DRIVER       0x02
+#define VIO_STATUS_DRIVER_OK    0x04
+#define VIO_STATUS_FAILED       0x80
+
+#define VIRTIO_BLK_F_SIZE_MAX   (1u << 1)
+#define VIRTIO_BLK_F_SEG_MAX    (1u << 2)
+#define VIRTIO_BLK_F_RO         (1u << 5)
+#define VIRTIO_BLK_F_FLUSH      (1u << 9)
+#define VIRTIO_F_INDIRECT_DESC  (1u << 28)
+#define VIRTIO_F_EVENT_IDX      (1u << 29)
+
+#define VBLK_FEATURES (VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO | \
+                       VIRTIO_BLK_F_FLUSH | VIRTIO_F_INDIRECT_DESC | VIRTIO_F_EVENT_IDX)
+
+/* Config do virtio-blk (a partir de VIO_CONFIG) */
+#define VBLK_CFG_CAPACITY       0x00
+#define VBLK_CFG_SIZE_MAX       0x08
+#define VBLK_CFG_SEG_MAX        0x0C
+
+#define VIRTIO_BLK_T_IN         0
+#define VIRTIO_BLK_T_OUT        1
+#define VIRTIO_BLK_T_FLUSH      4
+#define VIRTIO_BLK_S_OK         0
+
+/* ===================== VIRTQUEUE ===================== */
+
+#define VRING_DESC_F_NEXT       1
+#define VRING_DESC_F_WRITE      2
+#define VRING_DESC_F_INDIRECT   4
+#define VRING_AVAIL_F_NO_INTERRUPT 1
+#define VRING_USED_F_NO_NOTIFY  1
+#define VRING_ALIGN             4096
+
+typedef struct vring_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) vring_desc_t;
+
+typedef struct vring_avail {
+    uint16_t flags;
+    volatile uint16_t idx;
+    uint16_t ring[];                        /* + used_event no fim */
+} vring_avail_t;
+
+typedef struct vring_used_elem {
+    uint32_t id;
+    uint32_t len;
+} __attribute__((packed)) vring_used_elem_t;
+
+typedef struct vring_used {
+    volatile uint16_t flags;
+    volatile uint16_t idx;
+    vring_used_elem_t ring[];               /* + avail_event no fim */
+} vring_used_t;
+
+#define VBLK_MAX_INFLIGHT       32
+#define VBLK_MAX_SG             BLK_MAX_REQ_SEGS
+#define VBLK_MAX_SECTORS        1024        /* 512 KiB por pedido juntado */
+#define VBLK_BOUNCE_PAGES       (VBLK_MAX_SECTORS * 512 / PMM_PAGE_SIZE)
+
+typedef struct vblk_hdr {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) vblk_hdr_t;
+
+/* Memória de DMA de um pedido: tabela indireta, cabeçalho e status */
+typedef struct vblk_slot {
+    vring_desc_t table[VBLK_MAX_SG + 2];
+    vblk_hdr_t hdr;
+    volatile uint8_t status;
+} __attribute__((aligned(16))) vblk_slot_t;
+
+#define VBLK_SLOT_PAGES \
+    ((VBLK_MAX_INFLIGHT * sizeof(vblk_slot_t) + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE)
+
+typedef struct vblk {
+    uint16_t io;
+    uint32_t features;
+    uint64_t sectors;
+    uint32_t seg_max;                       /* Segmentos de dados por pedido */
+    uint32_t size_max;                      /* Bytes por segmento (0 = sem limite) */
+
+    /* Virtqueue 0 */
+    uint16_t qsize;
+    vring_desc_t *desc;
+    vring_avail_t *avail;
+    vring_used_t *used;
+    volatile uint16_t *used_event;          /* Nosso: quando queremos IRQ */
+    volatile uint16_t *avail_event;         /* Do device: quando quer notify */
+    uint16_t free_head;
+    uint16_t num_free;
+    uint16_t avail_idx;                     /* Próximo avail->idx (ainda não publicado) */
+    uint16_t last_used;
+    uint8_t *head_slot;                     /* Descritor de cabeça -> slot */
+
+    /* Pedidos em voo; só a thread do disco (ou o kick inline) mexe */
+    vblk_slot_t *slots;
+    request_t *slot_rq[VBLK_MAX_INFLIGHT];
+    blk_slots_t inflight;                   /* Bit por slot */
+    uint8_t *bounce;
+    int bounce_slot;                        /* -1 = livre */
+
+    blockdev_t bdev;
+    request_queue_t queue;
+    blk_poller_t poller;
+    char name[8];
+
+    /* Estatísticas */
+    uint64_t requests;
+    uint64_t notifies;
+    uint64_t published;                     /* Publicações do avail->idx */
+    uint64_t bounced;
+    uint64_t errors;
+} vblk_t;
+
+static vblk_t *vblk_disks[VIRTIO_BLK_MAX_DISKS];
+static int vblk_ndisks;
+
+static int vblk_direct_ok(const void *buf, uint32_t bytes) {
+    uint64_t v = (uint64_t)buf;
+    return v + bytes <= 0x100000000ULL;
+}
+
+/* ===================== DESCRITORES ===================== */
+
+static uint16_t vblk_desc_alloc(vblk_t *v) {
+    uint16_t d = v->free_head;
+    v->free_head = v->desc[d].next;
+    v->num_free--;
+    return d;
+}
+
+/* Devolve a cadeia que começa em 'head' à lista livre */
+static void vblk_desc_free(vblk_t *v, uint16_t head) {
+    uint16_t d = head;
+    for (;;) {
+        v->num_free++;
+        if (!(v->desc[d].flags & VRING_DESC_F_NEXT)) break;
+        d = v->desc[d].next;
+    }
+    v->desc[d].next = v->free_head;
+    v->free_head = head;
+}
+
+/* Acrescenta [phys, phys+bytes) aos dados da tabela (entradas 1..n),
+ * juntando com a anterior e respeitando size_max; novo n ou -1 */
+static int vblk_sg_add(vblk_t *v, vring_desc_t *t, int n, uint64_t phys,
+                       uint32_t bytes, uint16_t flags) {
+    uint32_t max = v->size_max ? v->size_max : 0xFFFFFFFFu;
+    while (bytes) {
+        if (n > 0) {
+            vring_desc_t *last = &t[n];
+            if (last->addr + last->len == phys && last->len < max) {
+                uint32_t k = max - last->len < bytes ? max - last->len : bytes;
+                last->len += k;
+                phys += k;
+                bytes -= k;
+                continue;
+            }
+        }
+        if ((uint32_t)n >= v->seg_max) return -1;
+        uint32_t k = bytes < max ? bytes : max;
+        n++;
+        t[n] = (vring_desc_t){ .addr = phys, .len = k, .flags = flags };
+        phys += k;
+        bytes -= k;
+    }
+    return n;
+}
+
+/* Segmentos de dados direto dos bios; -1 se algum não serve */
+static int vblk_build_sg(vblk_t *v, vring_desc_t *t, request_t *rq, uint16_t flags) {
+    blk_cursor_t cur;
+    blk_cursor_init(&cur, rq->bio_head);
+    uint32_t left = rq->sectors;
+    int n = 0;
+    while (left) {
+        uint32_t k;
+        void *p = blk_cursor_next(&cur, left, &k);
+        if (!vblk_direct_ok(p, k * 512)) return -1;
+        n = vblk_sg_add(v, t, n, pmm_virt_to_phys(p), k * 512, flags);
+        if (n < 0) return -1;
+        left -= k;
+    }
+    return n;
+}
+
+/* ===================== SUBMISSÃO ===================== */
+
+/* Põe o pedido no avail ring (sem publicar). 1 = saiu; 0 = esperar
+ * recurso (descritores ou bounce); -1 = erro; 2 = já concluído */
+static int vblk_start_request(blk_slots_t *bs, int slot, request_t *rq, void *ctx) {
+    (void)ctx;
+    vblk_t *v = (vblk_t *)bs->driver;
+    vblk_slot_t *s = &v->slots[slot];
+    vring_desc_t *t = s->table;
+    int write = rq->op == BIO_WRITE;
+    int n = 0;
+
+    if (rq->op == BIO_FLUSH) {
+        /* Sem F_FLUSH o device é write-through */
+        if (!(v->features & VIRTIO_BLK_F_FLUSH)) return 2;
+        s->hdr = (vblk_hdr_t){ .type = VIRTIO_BLK_T_FLUSH };
+    } else {
+        if (write && (v->features & VIRTIO_BLK_F_RO)) return -1;
+        uint16_t flags = write ? 0 : VRING_DESC_F_WRITE;
+        n = vblk_build_sg(v, t, rq, flags);
+        if (n < 0) {
+            if (!v->bounce || rq->sectors > VBLK_MAX_SECTORS) return -1;
+            if (v->bounce_slot >= 0) return 0;
+            n = vblk_sg_add(v, t, 0, pmm_virt_to_phys(v->bounce), rq->sectors * 512, flags);
+            if (n < 0) return -1;
+            if (write) blk_bounce_copy(rq, v->bounce, 1);
+            v->bounce_slot = slot;
+            v->bounced++;
+        }
+        s->hdr = (vblk_hdr_t){
+            .type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, .sector = rq->lba,
+        };
+    }
+
+    /* Cabeçalho (device lê) ... dados ... status (device escreve) */
+    s->status = 0xFF;
+    t[0] = (vring_desc_t){ .addr = pmm_virt_to_phys(&s->hdr), .len = sizeof(vblk_hdr_t) };
+    t[n + 1] = (vring_desc_t){
+        .addr = pmm_virt_to_phys((void *)&s->status), .len = 1, .flags = VRING_DESC_F_WRITE,
+    };
+    for (int i = 0; i <= n; i++) {
+        t[i].flags |= VRING_DESC_F_NEXT;
+        t[i].next = (uint16_t)(i + 1);
+    }
+
+    uint16_t head;
+    if (v->features & VIRTIO_F_INDIRECT_DESC) {
+        if (v->num_free < 1) goto busy;
+        head = vblk_desc_alloc(v);
+        v->desc[head] = (vring_desc_t){
+            .addr = pmm_virt_to_phys(t), .len = (uint32_t)(n + 2) * sizeof(vring_desc_t),
+            .flags = VRING_DESC_F_INDIRECT,
+        };
+    } else {
+        if (v->num_free < n + 2) goto busy;
+        head = vblk_desc_alloc(v);
+        uint16_t d = head;
+        for (int i = 0; i < n + 2; i++) {
+            v->desc[d] = t[i];
+            if (i == n + 1) break;
+            uint16_t next = vblk_desc_alloc(v);
+            v->desc[d].next = next;
+            d = next;
+        }
+    }
+
+    v->head_slot[head] = (uint8_t)slot;
+    v->slot_rq[slot] = rq;
+    blk_slots_get(&v->inflight, slot);
+    v->avail->ring[v->avail_idx % v->qsize] = head;
+    v->avail_idx++;
+    v->requests++;
+    return 1;
+
+busy:
+    if (v->bounce_slot == slot) v->bounce_slot = -1;
+    return 0;
+}
+
+/* Publica o lote no avail ring e notifica se o device quer */
+static void vblk_publish(vblk_t *v) {
+    uint16_t old = v->avail->idx;
+    uint16_t new = v->avail_idx;
+    if (old == new) return;
+
+    __sync_synchronize();                   /* Entradas do ring antes do idx */
+    v->avail->idx = new;
+    __sync_synchronize();                   /* idx antes de ler a supressão */
+    v->published++;
+
+    int need;
+    if (v->features & VIRTIO_F_EVENT_IDX) {
+        uint16_t event = *v->avail_event;
+        need = (uint16_t)(new - event - 1) < (uint16_t)(new - old);
+    } else {
+        need = !(v->used->flags & VRING_USED_F_NO_NOTIFY);
+    }
+    if (need) {
+        outw(v->io + VIO_QUEUE_NOTIFY, 0);
+        v->notifies++;
+    }
+}
+
+/* ===================== CONCLUSÃO ===================== */
+
+static void vblk_finish_slot(vblk_t *v, int slot, int status) {
+    request_t *rq = v->slot_rq[slot];
+    v->slot_rq[slot] = NULL;
+    blk_slots_put(&v->inflight, slot);
+    if (status != 0) v->errors++;
+
+    if (v->bounce_slot == slot) {
+        if (status == 0 && rq->op == BIO_READ) blk_bounce_copy(rq, v->bounce, 0);
+        v->bounce_slot = -1;
+    }
+    blk_end_request(&v->queue, rq, status);
+}
+
+static void vblk_reap(vblk_t *v) {
+    while (v->last_used != v->used->idx) {
+        __sync_synchronize();               /* idx antes das entradas */
+        vring_used_elem_t *e = &v->used->ring[v->last_used % v->qsize];
+        uint16_t head = (uint16_t)e->id;
+        int slot = v->head_slot[head];
+
+        vblk_desc_free(v, head);
+        v->last_used++;
+        vblk_finish_slot(v, slot, v->slots[slot].status == VIRTIO_BLK_S_OK ? 0 : -1);
+    }
+    /* Polling: interrupção só daqui a meio ring (na prática nunca) */
+    if (v->features & VIRTIO_F_EVENT_IDX) *v->used_event = (uint16_t)(v->last_used + 0x8000);
+}
+
+static const blk_slot_ops_t vblk_slot_ops = { .start = vblk_start_request };
+
+static void vblk_service(void *arg) {
+    vblk_t *v = (vblk_t *)arg;
+    vblk_reap(v);
+    blk_slots_fill(&v->inflight);
+    vblk_publish(v);
+}
+
+static int vblk_busy(void *arg) {
+    return blk_slots_busy(&((vblk_t *)arg)->inflight);
+}
+
+static int vblk_inflight(void *arg) {
+    return ((vblk_t *)arg)->inflight.busy != 0;
+}
+
+static const blk_poll_ops_t vblk_poll_ops = {
+    .service = vblk_service, .busy = vblk_busy, .inflight = vblk_inflight,
+};
+
+static void vblk_queue_kick(request_queue_t *q) {
+    blk_poller_kick(&((vblk_t *)q->driver_data)->poller);
+}
+
+/* ===================== INICIALIZAÇÃO ===================== */
+
+static uint32_t vblk_ring_bytes(uint16_t q) {
+    uint32_t avail = (uint32_t)q * sizeof(vring_desc_t) + 6 + 2u * q;
+    uint32_t used = 6 + (uint32_t)q * sizeof(vring_used_elem_t);
+    return ((avail + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1)) +
+           ((used + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1));
+}
+
+static int vblk_setup_queue(vblk_t *v) {
+    outw(v->io + VIO_QUEUE_SELECT, 0);
+    uint16_t q = inw(v->io + VIO_QUEUE_SIZE);
+    if (!q || q > 32768) return -1;
+
+    uint32_t pages = vblk_ring_bytes(q) / PMM_PAGE_SIZE;
+    uint8_t *mem = pmalloc(pages);
+    if (!mem) return -1;
+    memset(mem, 0, pages * PMM_PAGE_SIZE);
+
+    uint32_t avail_end = (uint32_t)q * sizeof(vring_desc_t) + 6 + 2u * q;
+    v->qsize = q;
+    v->desc = (vring_desc_t *)mem;
+    v->avail = (vring_avail_t *)(mem + q * sizeof(vring_desc_t));
+    v->used = (vring_used_t *)(mem + ((avail_end + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1)));
+    v->used_event = &v->avail->ring[q];
+    v->avail_event = (volatile uint16_t *)&v->used->ring[q];
+
+    for (uint16_t i = 0; i < q; i++) v->desc[i].next = (uint16_t)(i + 1);
+    v->free_head = 0;
+    v->num_free = q;
+    v->avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
+
+    v->head_slot = kmalloc(q);
+    if (!v->head_slot) return -1;
+
+    outl(v->io + VIO_QUEUE_PFN, (uint32_t)(pmm_virt_to_phys(mem) / VRING_ALIGN));
+    return 0;
+}
+
+static int vblk_pci_probe(pci_dev_t *d) {
+    pci_addr_t pa = d->addr;
+    if (vblk_ndisks >= VIRTIO_BLK_MAX_DISKS) return -1;
+
+    if (!(d->bars[0].flags & PCI_BAR_IO) || !d->bars[0].base) {
+        klog(KLOG_WARN, "[VIRTIO] %x:%x.%x has no legacy I/O BAR", pa.bus, pa.dev, pa.func);
+        return -1;
+    }
+    vblk_t *v = kmalloc(sizeof(*v));
+    if (!v) return -1;
+    memset(v, 0, sizeof(*v));
+    v->io = (uint16_t)d->bars[0].base;
+    v->bounce_slot = -1;
+    blk_poller_init(&v->poller, &vblk_poll_ops, v);
+    pci_enable_bus_master(pa);
+
+    outb(v->io + VIO_STATUS, 0);                                /* Reset */
+    outb(v->io + VIO_STATUS, VIO_STATUS_ACK);
+    outb(v->io + VIO_STATUS, VIO_STATUS_ACK | VIO_STATUS_DRIVER);
+
+    v->features = inl(v->io + VIO_DEVICE_FEATURES) & VBLK_FEATURES;
+    outl(v->io + VIO_GUEST_FEATURES, v->features);
+
+    uint16_t cfg = v->io + VIO_CONFIG;
+    v->sectors = inl(cfg + VBLK_CFG_CAPACITY) |
+                 ((uint64_t)inl(cfg + VBLK_CFG_CAPACITY + 4) << 32);
+    v->size_max = (v->features & VIRTIO_BLK_F_SIZE_MAX) ? inl(cfg + VBLK_CFG_SIZE_MAX) : 0;
+    v->seg_max = VBLK_MAX_SG;
+    if (v->features & VIRTIO_BLK_F_SEG_MAX) {
+        uint32_t m = inl(cfg + VBLK_CFG_SEG_MAX);
+        if (m && m < v->seg_max) v->seg_max = m;
+    }
+
+    v->slots = pmalloc(VBLK_SLOT_PAGES);
+    if (!v->slots || vblk_setup_queue(v) < 0) {
+        outb(v->io + VIO_STATUS, VIO_STATUS_FAILED);
+        klog(KLOG_WARN, "[VIRTIO] %x:%x.%x: queue setup failed", pa.bus, pa.dev, pa.func);
+        return -1;
+    }
+    /* Sem indiretos a cadeia inteira precisa caber no ring */
+    if (!(v->features & VIRTIO_F_INDIRECT_DESC) && v->seg_max > (uint32_t)v->qsize - 2) {
+        v->seg_max = v->qsize - 2;
+    }
+    blk_slots_init(&v->inflight, &vblk_slot_ops, &v->queue, v,
+                   v->qsize < VBLK_MAX_INFLIGHT ? v->qsize : VBLK_MAX_INFLIGHT);
+    v->bounce = pmalloc(VBLK_BOUNCE_PAGES);
+
+    outb(v->io + VIO_STATUS, VIO_STATUS_ACK | VIO_STATUS_DRIVER | VIO_STATUS_DRIVER_OK);
+
+    int idx = vblk_ndisks++;
+    vblk_disks[idx] = v;
+    memcpy(v->name, "vblk0", 6);
+    v->name[4] = (char)('0' + idx);
+
+    v->bdev.name = v->name;
+    v->bdev.sector_size = 512;
+    v->bdev.sectors = v->sectors;
+    v->bdev.priv = v;
+    blk_queue_init(&v->queue, VBLK_MAX_SECTORS, vblk_queue_kick, v);
+    v->bdev.queue = &v->queue;
+
+    klog(KLOG_INFO, "[VIRTIO] %s: %u MiB, queue %u, %u segs/request%s%s%s%s",
+         v->name, (uint32_t)(v->sectors / 2048), v->qsize, v->seg_max,
+         (v->features & VIRTIO_F_INDIRECT_DESC) ? ", indirect" : "",
+         (v->features & VIRTIO_F_EVENT_IDX) ? ", event-idx" : "",
+         (v->features & VIRTIO_BLK_F_FLUSH) ? ", flush" : "",
+         (v->features & VIRTIO_BLK_F_RO) ? ", read-only" : "");
+
+    blk_poller_start(&v->poller, v->name);
+    blockdev_add_disk(&v->bdev);
+    d->driver_data = v;
+    return 0;
+}
+
+static const pci_match_t vblk_pci_ids[] = {
+    PCI_MATCH_ID(VIRTIO_VENDOR, VIRTIO_DEV_BLK_LEGACY),
+    { 0 },
+};
+
+static const pci_driver_t vblk_pci_driver = {
+    .name = "virtio-blk", .ids = vblk_pci_ids, .probe = vblk_pci_probe,
+};
+
+int virtio_blk_init(void) {
+    pci_register_driver(&vblk_pci_driver);
+    if (!vblk_ndisks) klog(KLOG_INFO, "[VIRTIO] No virtio-blk device");
+    return vblk_ndisks ? 0 : -1;
+}
+
+int virtio_blk_count(void) {
+    return vblk_ndisks;
+}
+
+blockdev_t *virtio_blk_blockdev(int idx) {
+    if (idx < 0 || idx >= vblk_ndisks) return NULL;
+    return &vblk_disks[idx]->bdev;
+}
+
+void virtio_blk_dump_stats(void) {
+    for (int i = 0; i < vblk_ndisks; i++) {
+        vblk_t *v = vblk_disks[i];
+        klog(KLOG_INFO, "[VIRTIO] %s: %u requests, %u batches, %u notifies, max %u in flight, %u bounced, %u errors",
+             v->name, (uint32_t)v->requests, (uint32_t)v->published, (uint32_t)v->notifies,
+             v->inflight.max_inflight, (uint32_t)v->bounced, (uint32_t)v->errors);
+    }
+}
@@ -0,0 +1,21 @@
+// virtio_blk.h - Driver virtio-blk (PCI, interface legada/transicional)
+//
+// Cada disco virtio vira um blockdev ("vblk0"...). Pedidos da request_queue
+// saem como um descritor indireto cada (cabeçalho, segmentos de dados e
+// status), vários por notificação; o used ring é lido por polling.
+#pragma once
+#include <stdint.h>
+#include "blockdev.h"
+
+#define VIRTIO_BLK_MAX_DISKS 4
+
+/* Acha os virtio-blk no PCI e os inicializa; 0 se achou algum */
+int virtio_blk_init(void);
+
+int virtio_blk_count(void);
+
+/* Disco 'idx' como blockdev; NULL se não existe */
+blockdev_t *virtio_blk_blockdev(int idx);
+
+/* Loga pedidos, notificações (e quantos pedidos cada uma levou), profundidade */
+void virtio_blk_dump_stats(void);
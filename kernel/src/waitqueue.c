@@ -0,0 +1,184 @@
+// waitqueue.c - Filas de espera, completions e mutex
+//
+// Uma wait_queue é uma lista de wait_entry_t (na stack de quem espera).
+// wake_up_* remove a entrada e chama thread_wake(); como thread_block()
+// tem semântica de token, um wake entre wait_prepare() e thread_block()
+// não se perde.
+
+#include "waitqueue.h"
+#include "string.h"
+
+void wait_queue_init(wait_queue_t *wq) {
+    wq->lock.lock = 0;
+    wq->lock.cpu_id = 0;
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+void wait_prepare(wait_queue_t *wq, wait_entry_t *entry) {
+    entry->thread = thread_current();
+    entry->next = NULL;
+
+    uint64_t flags = spinlock_lock_irqsave(&wq->lock);
+    entry->queued = 1;
+    if (wq->tail) {
+        wq->tail->next = entry;
+    } else {
+        wq->head = entry;
+    }
+    wq->tail = entry;
+    spinlock_unlock_irqrestore(&wq->lock, flags);
+}
+
+void wait_finish(wait_queue_t *wq, wait_entry_t *entry) {
+    uint64_t flags = spinlock_lock_irqsave(&wq->lock);
+
+    if (entry->queued) {
+        wait_entry_t *prev = NULL;
+        for (wait_entry_t *e = wq->head; e; prev = e, e = e->next) {
+            if (e != entry) continue;
+            if (prev) prev->next = e->next;
+            else wq->head = e->next;
+            if (wq->tail == e) wq->tail = prev;
+            break;
+        }
+        entry->queued = 0;
+    }
+
+    spinlock_unlock_irqrestore(&wq->lock, flags);
+}
+
+/* Remove e acorda o primeiro da fila. wq->lock preso. */
+static int wake_first_locked(wait_queue_t *wq) {
+    wait_entry_t *e = wq->head;
+    if (!e) return 0;
+
+    wq->head = e->next;
+    if (!wq->head) wq->tail = NULL;
+    e->queued = 0;
+
+    thread_wake(e->thread);
+    return 1;
+}
+
+void wake_up_one(wait_queue_t *wq) {
+    uint64_t flags = spinlock_lock_irqsave(&wq->lock);
+    wake_first_locked(wq);
+    spinlock_unlock_irqrestore(&wq->lock, flags);
+}
+
+void wake_up_all(wait_queue_t *wq) {
+    uint64_t flags = spinlock_lock_irqsave(&wq->lock);
+    while (wake_first_locked(wq)) { }
+    spinlock_unlock_irqrestore(&wq->lock, flags);
+}
+
+/* ===================== COMPLETION ===================== */
+
+void completion_init(completion_t *c) {
+    c->done = 0;
+    wait_queue_init(&c->wq);
+}
+
+void completion_reinit(completion_t *c) {
+    __atomic_store_n(&c->done, 0, __ATOMIC_RELEASE);
+}
+
+void complete(completion_t *c) {
+    uint64_t flags = spinlock_lock_irqsave(&c->wq.lock);
+    if (c->done != COMPLETION_ALL) c->done++;
+    wake_first_locked(&c->wq);
+    spinlock_unlock_irqrestore(&c->wq.lock, flags);
+}
+
+void complete_all(completion_t *c) {
+    uint64_t flags = spinlock_lock_irqsave(&c->wq.lock);
+    c->done = COMPLETION_ALL;
+    while (wake_first_locked(&c->wq)) { }
+    spinlock_unlock_irqrestore(&c->wq.lock, flags);
+}
+
+/* Consome um 'done' se houver. */
+static int try_consume(completion_t *c) {
+    int ok = 0;
+    uint64_t flags = spinlock_lock_irqsave(&c->wq.lock);
+    if (c->done) {
+        if (c->done != COMPLETION_ALL) c->done--;
+        ok = 1;
+    }
+    spinlock_unlock_irqrestore(&c->wq.lock, flags);
+    return ok;
+}
+
+void wait_for_completion(completion_t *c) {
+    if (!can_block() && irq_enabled()) {
+        /* Sem scheduler: dorme no hlt até o IRQ completar.
+         * cli/checa/"sti; hlt" evita perder um IRQ entre a checagem e o hlt. */
+        for (;;) {
+            asm volatile("cli" ::: "memory");
+            if (try_consume(c)) {
+                asm volatile("sti" ::: "memory");
+                return;
+            }
+            asm volatile("sti; hlt" ::: "memory");
+        }
+    }
+
+    wait_event(&c->wq, try_consume(c));
+}
+
+int wait_for_completion_timeout(completion_t *c, uint32_t ms) {
+    if (!can_block()) {
+        /* Sem scheduler não há relógio: espera ocupada aproximada */
+        for (uint64_t i = 0; i < (uint64_t)ms * 10000; i++) {
+            if (try_consume(c)) return 1;
+            cpu_relax();
+        }
+        return try_consume(c);
+    }
+
+    uint64_t deadline = sched_ticks() + ((uint64_t)ms * SCHED_HZ + 999) / 1000;
+    wait_entry_t we;
+
+    for (;;) {
+        wait_prepare(&c->wq, &we);
+        if (try_consume(c)) {
+            wait_finish(&c->wq, &we);
+            return 1;
+        }
+        if (sched_ticks() >= deadline) {
+            wait_finish(&c->wq, &we);
+            return 0;
+        }
+        thread_block_timeout(deadline);
+        wait_finish(&c->wq, &we);
+    }
+}
+
+/* ===================== MUTEX ===================== */
+
+void mutex_init(mutex_t *m) {
+    m->locked = 0;
+    m->owner = NULL;
+    wait_queue_init(&m->wq);
+}
+
+int mutex_trylock(mutex_t *m) {
+    int expected = 0;
+    if (__atomic_compare_exchange_n(&m->locked, &expected, 1, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        m->owner = sched_active() ? thread_current() : NULL;
+        return 1;
+    }
+    return 0;
+}
+
+void mutex_lock(mutex_t *m) {
+    wait_event(&m->wq, mutex_trylock(m));
+}
+
+void mutex_unlock(mutex_t *m) {
+    m->owner = NULL;
+    __atomic_store_n(&m->locked, 0, __ATOMIC_RELEASE);
+    wake_up_one(&m->wq);
+}
@@ -0,0 +1,102 @@
+// waitqueue.h - Filas de espera, completions e mutex bloqueante
+//
+// Tudo aqui pode ser sinalizado de IRQ (wake_up*, complete*). Esperar só é
+// permitido em contexto de thread. Antes do scheduler (ou com IF=0) as
+// esperas caem para pause; wait_for_completion usa hlt, já que quem
+// completa normalmente é o IRQ do dispositivo.
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "spinlock.h"
+#include "sched.h"
+#include "cpu.h"
+
+typedef struct wait_entry {
+    thread_t *thread;
+    struct wait_entry *next;
+    int queued;
+} wait_entry_t;
+
+typedef struct wait_queue {
+    spinlock_t lock;
+    wait_entry_t *head;
+    wait_entry_t *tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { SPINLOCK_INIT, NULL, NULL }
+
+void wait_queue_init(wait_queue_t *wq);
+
+/* Entra/sai da fila (base de wait_event) */
+void wait_prepare(wait_queue_t *wq, wait_entry_t *entry);
+void wait_finish(wait_queue_t *wq, wait_entry_t *entry);
+
+/* Acorda um / todos os esperando. Seguro em IRQ. */
+void wake_up_one(wait_queue_t *wq);
+void wake_up_all(wait_queue_t *wq);
+
+/* true se dá para bloquear (scheduler ativo, IF=1) */
+static inline bool can_block(void) {
+    return sched_active() && irq_enabled();
+}
+
+/* Passo de um loop de polling: cede o CPU se possível, senão pause */
+static inline void wait_poll_relax(void) {
+    if (can_block()) {
+        thread_yield();
+    } else {
+        cpu_relax();
+    }
+}
+
+/* Espera 'cond' ficar verdadeira. Acordadas espúrias são absorvidas pelo
+ * loop, então 'cond' precisa ser reavaliável sem efeitos colaterais. */
+#define wait_event(wq, cond) do {                                      \
+    if (!can_block()) {                                                \
+        while (!(cond)) cpu_relax();                                   \
+        break;                                                         \
+    }                                                                  \
+    wait_entry_t __we;                                                 \
+    for (;;) {                                                         \
+        wait_prepare((wq), &__we);                                     \
+        if (cond) {                                                    \
+            wait_finish((wq), &__we);                                  \
+            break;                                                     \
+        }                                                              \
+        thread_block();                                                \
+        wait_finish((wq), &__we);                                      \
+    }                                                                  \
+} while (0)
+
+/* ===================== COMPLETION ===================== */
+
+typedef struct completion {
+    volatile uint32_t done;
+    wait_queue_t wq;
+} completion_t;
+
+#define COMPLETION_ALL 0x7FFFFFFF
+
+void completion_init(completion_t *c);
+void completion_reinit(completion_t *c);
+void complete(completion_t *c);
+void complete_all(completion_t *c);
+void wait_for_completion(completion_t *c);
+
+/* 1 se completou, 0 se passou 'ms' sem completar */
+int wait_for_completion_timeout(completion_t *c, uint32_t ms);
+
+/* ===================== MUTEX ===================== */
+
+typedef struct mutex {
+    volatile int locked;
+    thread_t *owner;
+    wait_queue_t wq;
+} mutex_t;
+
+#define MUTEX_INIT { 0, NULL, WAIT_QUEUE_INIT }
+
+void mutex_init(mutex_t *m);
+void mutex_lock(mutex_t *m);
+int mutex_trylock(mutex_t *m);
+void mutex_unlock(mutex_t *m);
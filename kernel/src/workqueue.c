@@ -0,0 +1,230 @@
+// workqueue.c - Executor de trabalho adiado com work stealing
+//
+// Cada CPU tem um deque (anel fixo, sem alocação no caminho de IRQ) e um
+// worker dono dele. queue_work() empilha no deque do CPU atual:
+// - o dono consome pelo fundo (LIFO, dados ainda quentes no cache)
+// - workers ociosos roubam pelo topo (FIFO, trabalho mais antigo)
+// Os workers são threads normais do scheduler (a run queue é global), então
+// "por CPU" aqui é o deque de entrada; o balanceamento fica com o roubo.
+
+#include "workqueue.h"
+#include "sched.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "string.h"
+
+extern void klog(int level, const char *fmt, ...);
+
+#define KLOG_INFO  0
+#define KLOG_WARN  1
+#define KLOG_ERROR 2
+#define KLOG_DEBUG 3
+
+#define WQ_MASK (WQ_DEQUE_SIZE - 1)
+
+typedef struct {
+    work_fn fn;
+    void *arg;
+} work_t;
+
+typedef struct {
+    spinlock_t lock;
+    uint32_t top;              /* Próximo a ser roubado */
+    uint32_t bottom;           /* Próxima posição livre */
+    work_t items[WQ_DEQUE_SIZE];
+    thread_t *worker;
+    wq_stats_t stats;
+} wq_deque_t;
+
+static wq_deque_t deques[SMP_MAX_CPUS];
+static uint32_t deque_count = 0;
+static volatile uint64_t idle_mask = 0;   /* bit i = worker i bloqueado */
+static volatile int wq_ready = 0;
+
+/* ===================== DEQUE ===================== */
+
+static int deque_push(wq_deque_t *d, work_fn fn, void *arg) {
+    uint64_t flags = spinlock_lock_irqsave(&d->lock);
+
+    if (d->bottom - d->top >= WQ_DEQUE_SIZE) {
+        spinlock_unlock_irqrestore(&d->lock, flags);
+        return -1;
+    }
+
+    work_t *w = &d->items[d->bottom & WQ_MASK];
+    w->fn = fn;
+    w->arg = arg;
+    d->bottom++;
+
+    d->stats.queued++;
+    d->stats.depth = d->bottom - d->top;
+    if (d->stats.depth > d->stats.max_depth) {
+        d->stats.max_depth = d->stats.depth;
+    }
+
+    spinlock_unlock_irqrestore(&d->lock, flags);
+    return 0;
+}
+
+/* Dono: pega o mais recente */
+static int deque_pop(wq_deque_t *d, work_t *out) {
+    uint64_t flags = spinlock_lock_irqsave(&d->lock);
+
+    if (d->bottom == d->top) {
+        spinlock_unlock_irqrestore(&d->lock, flags);
+        return 0;
+    }
+
+    d->bottom--;
+    *out = d->items[d->bottom & WQ_MASK];
+    d->stats.executed++;
+    d->stats.depth = d->bottom - d->top;
+
+    spinlock_unlock_irqrestore(&d->lock, flags);
+    return 1;
+}
+
+/* Ladrão: pega o mais antigo */
+static int deque_steal(wq_deque_t *d, work_t *out) {
+    if (d->bottom == d->top) return 0;   /* Checagem barata sem lock */
+
+    uint64_t flags = spinlock_lock_irqsave(&d->lock);
+
+    if (d->bottom == d->top) {
+        spinlock_unlock_irqrestore(&d->lock, flags);
+        return 0;
+    }
+
+    *out = d->items[d->top & WQ_MASK];
+    d->top++;
+    d->stats.stolen++;
+    d->stats.depth = d->bottom - d->top;
+
+    spinlock_unlock_irqrestore(&d->lock, flags);
+    return 1;
+}
+
+/* Tenta roubar de algum outro deque, começando pelo vizinho */
+static int steal_any(uint32_t self, work_t *out) {
+    for (uint32_t i = 1; i < deque_count; i++) {
+        uint32_t victim = (self + i) % deque_count;
+        if (deque_steal(&deques[victim], out)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* ===================== WORKERS ===================== */
+
+static int any_pending(void) {
+    for (uint32_t i = 0; i < deque_count; i++) {
+        if (deques[i].bottom != deques[i].top) return 1;
+    }
+    return 0;
+}
+
+static void worker_main(void *arg) {
+    uint32_t self = (uint32_t)(uintptr_t)arg;
+    wq_deque_t *d = &deques[self];
+    work_t w;
+
+    for (;;) {
+        if (deque_pop(d, &w) || steal_any(self, &w)) {
+            w.fn(w.arg);
+            continue;
+        }
+
+        __atomic_fetch_or(&idle_mask, 1ULL << self, __ATOMIC_SEQ_CST);
+
+        /* Rechecagem: um push pode ter chegado antes do bit ficar visível */
+        if (any_pending()) {
+            __atomic_fetch_and(&idle_mask, ~(1ULL << self), __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        thread_block();
+        __atomic_fetch_and(&idle_mask, ~(1ULL << self), __ATOMIC_SEQ_CST);
+    }
+}
+
+/* Acorda o dono do deque; se ele estiver ocupado, acorda um ocioso para roubar */
+static void wake_workers(uint32_t owner) {
+    uint64_t idle = __atomic_load_n(&idle_mask, __ATOMIC_SEQ_CST);
+
+    if (idle & (1ULL << owner)) {
+        thread_wake(deques[owner].worker);
+        return;
+    }
+
+    if (idle) {
+        uint32_t victim = (uint32_t)__builtin_ctzll(idle);
+        thread_wake(deques[victim].worker);
+    }
+}
+
+/* ===================== API ===================== */
+
+void workqueue_init(void) {
+    deque_count = smp_cpu_count();
+    if (deque_count > SMP_MAX_CPUS) deque_count = SMP_MAX_CPUS;
+
+    for (uint32_t i = 0; i < deque_count; i++) {
+        memset(&deques[i], 0, sizeof(wq_deque_t));
+    }
+
+    for (uint32_t i = 0; i < deque_count; i++) {
+        deques[i].worker = thread_create("kworker", worker_main, (void *)(uintptr_t)i);
+        if (!deques[i].worker) {
+            klog(KLOG_ERROR, "WQ: failed to create worker %d", (int)i);
+            deque_count = i;
+            break;
+        }
+    }
+
+    if (deque_count == 0) return;
+
+    wq_ready = 1;
+    klog(KLOG_INFO, "WQ: %d worker(s), %d slots per deque",
+         (int)deque_count, WQ_DEQUE_SIZE);
+}
+
+int queue_work(work_fn fn, void *arg) {
+    if (!fn) return -1;
+
+    if (!wq_ready) {
+        fn(arg);
+        return 0;
+    }
+
+    uint32_t cpu = smp_current_id();
+    if (cpu >= deque_count) cpu = 0;
+
+    if (deque_push(&deques[cpu], fn, arg) < 0) {
+        return -1;
+    }
+
+    wake_workers(cpu);
+    return 0;
+}
+
+int workqueue_get_stats(uint32_t cpu, wq_stats_t *out) {
+    if (cpu >= deque_count || !out) return -1;
+
+    uint64_t flags = spinlock_lock_irqsave(&deques[cpu].lock);
+    *out = deques[cpu].stats;
+    spinlock_unlock_irqrestore(&deques[cpu].lock, flags);
+    return 0;
+}
+
+void workqueue_dump(void) {
+    klog(KLOG_INFO, "=== WORKQUEUE ===");
+    for (uint32_t i = 0; i < deque_count; i++) {
+        wq_stats_t st;
+        workqueue_get_stats(i, &st);
+        klog(KLOG_INFO, "  cpu%u: depth=%u max=%u queued=%u run=%u stolen=%u",
+             i, st.depth, st.max_depth,
+             (unsigned int)st.queued, (unsigned int)st.executed,
+             (unsigned int)st.stolen);
+    }
+}
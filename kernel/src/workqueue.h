@@ -0,0 +1,31 @@
+// workqueue.h - Execução adiada com deques por CPU e work stealing
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define WQ_DEQUE_SIZE  256    /* Itens por deque (potência de 2) */
+
+typedef void (*work_fn)(void *arg);
+
+/* Estatísticas de um deque */
+typedef struct {
+    uint64_t queued;      /* Itens enfileirados neste deque */
+    uint64_t executed;    /* Itens executados pelo dono */
+    uint64_t stolen;      /* Itens roubados deste deque por outros workers */
+    uint32_t depth;       /* Profundidade atual */
+    uint32_t max_depth;   /* Maior profundidade observada */
+} wq_stats_t;
+
+/* Cria um worker por CPU (chamar depois de sched_init) */
+void workqueue_init(void);
+
+/* Agenda fn(arg) no deque do CPU atual. Pode ser chamada de IRQ.
+ * Antes de workqueue_init() executa inline.
+ * Retorna 0 em sucesso, -1 se o deque está cheio. */
+int queue_work(work_fn fn, void *arg);
+
+/* Copia as estatísticas do deque 'cpu'; -1 se não existe */
+int workqueue_get_stats(uint32_t cpu, wq_stats_t *out);
+
+/* Imprime profundidade e contadores de todos os deques */
+void workqueue_dump(void);
@@ -1,13 +1,26 @@
+# DISK_BUS=ide (padrão), ahci, virtio ou nvme: onde disk.img aparece para o kernel.
+# both: IDE e, só leitura, também virtio-blk (comparar com BLK_BENCHMARK)
+case "${DISK_BUS:-ide}" in
+   ahci)   DISK_DEV="-device ahci,id=ahci0 -device ide-hd,drive=hd0,bus=ahci0.0" ;;
+   virtio) DISK_DEV="-device virtio-blk-pci,drive=hd0" ;;
+   nvme)   DISK_DEV="-device nvme,serial=nvme0,drive=hd0" ;;
+   both)   DISK_DEV="-device ide-hd,drive=hd0,bus=ide.0 \
+              -drive id=hd1,file=disk.img,format=raw,if=none,readonly=on,file.locking=off \
+              -device virtio-blk-pci,drive=hd1" ;;
+   *)      DISK_DEV="-device ide-hd,drive=hd0,bus=ide.0" ;;
+esac
+
 qemu-system-x86_64 \
    -m 128M \
    -cpu qemu64 \
+   -smp 4 \
    -machine pc \
    -drive if=pflash,format=raw,readonly=on,file=edk2-ovmf/ovmf-code-x86_64.fd \
    -drive if=pflash,format=raw,file=edk2-ovmf/ovmf-vars-x86_64.fd \
    -drive id=cdrom0,file=template-x86_64.iso,format=raw,if=none,media=cdrom \
    -device ide-cd,drive=cdrom0,bus=ide.1 \
    -drive id=hd0,file=disk.img,format=raw,if=none \
-   -device ide-hd,drive=hd0,bus=ide.0 \
+   $DISK_DEV \
    -boot order=d \
    -serial stdio \
    -display vnc=:0 \
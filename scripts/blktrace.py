@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+# blktrace.py - Resume o dump do blktrace do kernel capturado da serial
+#
+#   ./run.sh | tee serial.log        (no console: "blktrace" ou "blktrace bin")
+#   python3 scripts/blktrace.py serial.log [--elf kernel/bin-x86_64/kernel]
+#
+# Usa o último dump do arquivo (texto ou binário). Mostra, por device e
+# operação, bios (Q), pedidos (I), merges e latência Q->C; do cache (H/M),
+# hits, misses e os LBAs lidos mais de uma vez; e quem chamou, agrupado
+# por endereço (com --elf, pelo nome da função via addr2line).
+
+import argparse
+import collections
+import struct
+import subprocess
+import sys
+
+OPS = {0: "R", 1: "W", 2: "F"}
+OP_NAMES = {"R": "read", "W": "write", "F": "flush"}
+
+# blktrace_event_t: tsc, lba, caller, sectors, action, op, dev, cpu_flags
+EVENT = struct.Struct("<QQQIBBBB")
+FLAG_ERROR = 0x80
+
+Event = collections.namedtuple("Event", "cpu tsc action dev op lba sectors status caller")
+
+
+def parse(data):
+    """Eventos, ticks de TSC por ms e nomes dos devices do último dump."""
+    start = data.rfind(b"BLKTRACE TSC ")
+    if start < 0:
+        sys.exit("no BLKTRACE dump in the input")
+    data = data[start:]
+
+    tsc_per_ms = 0
+    devs = {}
+    events = []
+    pos = 0
+    while pos < len(data):
+        nl = data.find(b"\n", pos)
+        if nl < 0:
+            break
+        line = data[pos:nl].rstrip(b"\r").decode("latin-1")
+        pos = nl + 1
+        f = line.split()
+        if line.startswith("BLKTRACE TSC "):
+            tsc_per_ms = int(f[2])
+        elif line.startswith("BLKTRACE DEV "):
+            devs[int(f[2])] = f[3]
+        elif line.startswith("BLKTRACE BIN "):
+            n = int(f[2])
+            raw = data[pos:pos + n * EVENT.size]
+            if len(raw) < n * EVENT.size:
+                print("warning: binary dump truncated", file=sys.stderr)
+            for i in range(len(raw) // EVENT.size):
+                tsc, lba, caller, sectors, action, op, dev, cf = EVENT.unpack_from(raw, i * EVENT.size)
+                events.append(Event(cf & 0x7F, tsc, chr(action), devs.get(dev, "-"),
+                                    OPS.get(op, "?"), lba, sectors,
+                                    -1 if cf & FLAG_ERROR else 0, caller))
+            pos += n * EVENT.size
+        elif line.startswith("BT ") and len(f) == 10:
+            events.append(Event(int(f[1]), int(f[2]), f[3], f[4], f[5], int(f[6]),
+                                int(f[7]), int(f[8]), int(f[9], 16)))
+        elif line.startswith("BLKTRACE END"):
+            break
+    return events, tsc_per_ms, devs
+
+
+def us(tsc, tsc_per_ms):
+    return tsc * 1000 / tsc_per_ms if tsc_per_ms else float(tsc)
+
+
+def percentile(sorted_vals, p):
+    if not sorted_vals:
+        return 0.0
+    return sorted_vals[min(len(sorted_vals) - 1, int(len(sorted_vals) * p / 100))]
+
+
+def symbolize(addrs, elf):
+    """Endereço -> "função" (addr2line) ou o próprio endereço em hex."""
+    names = {a: "0x%x" % a for a in addrs}
+    if not elf or not addrs:
+        return names
+    order = sorted(addrs)
+    try:
+        out = subprocess.run(["addr2line", "-f", "-s", "-e", elf] + ["0x%x" % a for a in order],
+                             capture_output=True, text=True, check=True).stdout.splitlines()
+    except (OSError, subprocess.CalledProcessError) as e:
+        print("warning: addr2line failed: %s" % e, file=sys.stderr)
+        return names
+    for i, a in enumerate(order):
+        if 2 * i + 1 < len(out) and out[2 * i] != "??":
+            names[a] = "%s (%s)" % (out[2 * i], out[2 * i + 1])
+    return names
+
+
+def summarize_io(events, tsc_per_ms):
+    print("== I/O by device and operation ==")
+    print("%-10s %-5s %7s %9s %7s %6s %7s %9s %9s %9s %9s" % (
+        "device", "op", "bios", "KiB", "reqs", "merge", "errors",
+        "avg us", "p50 us", "p99 us", "max us"))
+
+    stats = collections.defaultdict(lambda: {"Q": 0, "sectors": 0, "I": 0, "errors": 0, "lat": []})
+    pending = collections.defaultdict(collections.deque)
+    for e in events:
+        key = (e.dev, e.op)
+        if e.action == "Q":
+            stats[key]["Q"] += 1
+            stats[key]["sectors"] += e.sectors
+            pending[(e.dev, e.op, e.lba, e.sectors)].append(e.tsc)
+        elif e.action == "I":
+            stats[key]["I"] += 1
+        elif e.action == "C":
+            if e.status:
+                stats[key]["errors"] += 1
+            q = pending.get((e.dev, e.op, e.lba, e.sectors))
+            if q:
+                stats[key]["lat"].append(us(e.tsc - q.popleft(), tsc_per_ms))
+
+    for (dev, op), s in sorted(stats.items()):
+        if not s["Q"] and not s["I"]:
+            continue
+        lat = sorted(s["lat"])
+        merged = s["Q"] - s["I"] if s["Q"] > s["I"] else 0
+        print("%-10s %-5s %7d %9d %7d %5d%% %7d %9.1f %9.1f %9.1f %9.1f" % (
+            dev, OP_NAMES.get(op, op), s["Q"], s["sectors"] // 2, s["I"],
+            merged * 100 // s["Q"] if s["Q"] else 0, s["errors"],
+            sum(lat) / len(lat) if lat else 0.0, percentile(lat, 50), percentile(lat, 99),
+            lat[-1] if lat else 0.0))
+    print()
+
+
+def summarize_cache(events, top):
+    print("== Block cache reads (bread) ==")
+    per_dev = collections.defaultdict(lambda: {"H": 0, "M": 0})
+    accesses = collections.Counter()
+    misses = collections.Counter()
+    for e in events:
+        if e.action not in "HM":
+            continue
+        per_dev[e.dev][e.action] += 1
+        accesses[(e.dev, e.lba)] += 1
+        if e.action == "M":
+            misses[(e.dev, e.lba)] += 1
+
+    for dev, s in sorted(per_dev.items()):
+        total = s["H"] + s["M"]
+        repeated = sum(n - 1 for (d, _), n in accesses.items() if d == dev and n > 1)
+        reread = sum(n - 1 for (d, _), n in misses.items() if d == dev and n > 1)
+        print("%s: %d breads, %d hits (%d%%), %d misses; %d repeated reads of a block, "
+              "%d of them went to disk again" % (
+                  dev, total, s["H"], s["H"] * 100 // total if total else 0, s["M"],
+                  repeated, reread))
+
+    hot = [(n, k) for k, n in accesses.items() if n > 1]
+    if hot:
+        print("most read blocks:")
+        for n, (dev, lba) in sorted(hot, reverse=True)[:top]:
+            print("  %-10s LBA %-10d %5d reads, %d from disk" % (dev, lba, n, misses[(dev, lba)]))
+    print()
+
+
+def summarize_callers(events, elf, top):
+    print("== Callers ==")
+    counts = collections.defaultdict(collections.Counter)
+    for e in events:
+        counts[e.caller][e.action + e.op] += 1
+    names = symbolize(set(counts), elf)
+    rows = sorted(counts.items(), key=lambda kv: -sum(kv[1].values()))
+    for caller, c in rows[:top]:
+        detail = ", ".join("%s %d" % (k, n) for k, n in sorted(c.items()))
+        print("  %-48s %7d  %s" % (names[caller], sum(c.values()), detail))
+    print("  (action+op: Q/I/C/H/M + R/W/F)")
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Summarize a blktrace dump captured from the serial port")
+    ap.add_argument("log", help="serial capture containing a 'blktrace' or 'blktrace bin' dump")
+    ap.add_argument("--elf", help="kernel ELF to turn caller addresses into function names")
+    ap.add_argument("--top", type=int, default=10, help="rows in the block and caller tables")
+    args = ap.parse_args()
+
+    with open(args.log, "rb") as f:
+        events, tsc_per_ms, devs = parse(f.read())
+    if not events:
+        sys.exit("dump has no events")
+
+    span = us(events[-1].tsc - events[0].tsc, tsc_per_ms) / 1000
+    print("%d events on %d CPU(s) over %.1f ms, devices: %s\n" % (
+        len(events), len({e.cpu for e in events}), span, " ".join(devs.values())))
+    summarize_io(events, tsc_per_ms)
+    summarize_cache(events, args.top)
+    summarize_callers(events, args.elf, args.top)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,28 +1,51 @@
 #!/usr/bin/env bash
-# disk.sh - Cria disk.img FAT32 com 1MB e arquivo hello.txt
+# disk.sh - Cria disk.img FAT32 com hello.txt e stream.bin (benchmark de leitura)
+#
+# DISK_MB=64 STREAM_MB=8 bash scripts/disk.sh
+# PTABLE=gpt: GPT com uma partição "XLDROOT" (basic data) a partir de 1 MiB
+# no lugar do FAT32 direto no disco (precisa de sgdisk)
 
-echo "=== Criando disco FAT32 de 1MB ==="
+DISK_MB=${DISK_MB:-64}
+STREAM_MB=${STREAM_MB:-8}
+PTABLE=${PTABLE:-raw}
 
-# 1. Cria imagem vazia de 1MB
-echo "[1/5] Criando imagem de 1MB..."
-dd if=/dev/zero of=disk.img bs=1M count=1 status=none
+# Alvo do mtools: o disco todo ou a partição (offset em bytes)
+IMG=disk.img
+MFORMAT_SIZE=
+
+echo "=== Criando disco FAT32 de ${DISK_MB}MB ==="
+
+# 1. Cria imagem vazia
+echo "[1/5] Criando imagem de ${DISK_MB}MB..."
+dd if=/dev/zero of=disk.img bs=1M count="$DISK_MB" status=none
 
 # 2. Cria tabela de partição MBR com uma partição FAT32
 echo "[2/5] Criando MBR e partição..."
-echo -e "o\nn\np\n1\n\n\nt\nc\nw" | fdisk disk.img > /dev/null 2>&1
+if [ "$PTABLE" = "gpt" ]; then
+    if ! command -v sgdisk > /dev/null 2>&1; then
+        echo "ERRO: PTABLE=gpt precisa do sgdisk (gdisk)"
+        exit 1
+    fi
+    sgdisk -o -n 1:2048:0 -t 1:0700 -c 1:XLDROOT disk.img > /dev/null
+    IMG="disk.img@@$((2048 * 512))"
+    # Do LBA 2048 ao último utilizável (antes da GPT de backup, 33 setores)
+    MFORMAT_SIZE="-T $((DISK_MB * 2048 - 2048 - 33))"
+else
+    echo -e "o\nn\np\n1\n\n\nt\nc\nw" | fdisk disk.img > /dev/null 2>&1
+fi
 
 # 3. Monta a imagem como loop device (no Termux precisa de proot ou método alternativo)
 # Como Termux não tem loop devices fácil, vamos usar mcopy do mtools
 
 echo "[3/5] Formatando como FAT32..."
 # Cria sistema de arquivos FAT32 usando mkfs.fat do pacote dosfstools
-if command -v mkfs.fat > /dev/null 2>&1; then
+if [ "$PTABLE" != "gpt" ] && command -v mkfs.fat > /dev/null 2>&1; then
     # Se mkfs.fat estiver disponível (pode não estar no Termux)
     mkfs.fat -F 32 disk.img
 else
     # Alternativa: usar mformat do mtools
     echo "Usando mtools para formatar..."
-    mformat -F -v XLDDISK -i disk.img ::
+    mformat -F $MFORMAT_SIZE -v XLDDISK -i "$IMG" ::
 fi
 
 # 4. Cria arquivo hello.txt
@@ -35,14 +58,19 @@ echo "Booted via Limine + FAT32!" >> hello.txt
 echo "[5/5] Copiando hello.txt para /root/hello.txt..."
 if command -v mcopy > /dev/null 2>&1; then
     # Cria diretório /root
-    mmd -i disk.img ::/root
+    mmd -i "$IMG" ::/root
     # Copia arquivo
-    mcopy -i disk.img hello.txt ::/root/hello.txt
+    mcopy -i "$IMG" hello.txt ::/root/hello.txt
+    # Arquivo grande para o benchmark de leitura sequencial (RA_BENCHMARK)
+    if [ "$STREAM_MB" -gt 0 ]; then
+        dd if=/dev/urandom of=stream.bin bs=1M count="$STREAM_MB" status=none
+        mcopy -i "$IMG" stream.bin ::/root/stream.bin
+    fi
     
     # Lista conteúdo para verificar
     echo "=== Conteúdo do disco ==="
-    mdir -i disk.img ::/
-    mdir -i disk.img ::/root
+    mdir -i "$IMG" ::/
+    mdir -i "$IMG" ::/root
 else
     echo "ERRO: mtools não instalado"
     echo "Instale: pkg install mtools"
@@ -50,7 +78,7 @@ else
 fi
 
 # 6. Limpa arquivo temporário
-rm -f hello.txt
+rm -f hello.txt stream.bin
 
 echo "=== Disco criado com sucesso! ==="
 echo "Tamanho: $(stat -c%s disk.img) bytes"